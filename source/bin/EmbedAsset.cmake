@@ -0,0 +1,27 @@
+# Embed a text asset into a C header as a null-terminated char array.
+#
+# Usage: cmake -DINPUT=<file> -DOUTPUT=<header> -DNAME=<array name>
+#              [-DMINIFY=ON] -P EmbedAsset.cmake
+#
+# MINIFY strips the indentation, the blank lines, and the lines holding only
+# comments of a JavaScript file; the code itself is left untouched.
+
+file(READ "${INPUT}" content)
+
+if (MINIFY)
+    set(content "\n${content}")
+    string(REGEX REPLACE "\n[ \t]+" "\n" content "${content}")
+    string(REGEX REPLACE "\n//[^\n]*" "\n" content "${content}")
+    string(REGEX REPLACE "\n/\\*([^*]|\\*+[^*/])*\\*+/[ \t]*" "\n" content "${content}")
+    string(REGEX REPLACE "\n\n+" "\n" content "${content}")
+    string(REGEX REPLACE "^\n" "" content "${content}")
+endif ()
+
+string(HEX "${content}" hex)
+# 16 bytes per line
+string(REGEX REPLACE "(................................)" "\\1\n" hex "${hex}")
+string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," hex "${hex}")
+
+file(WRITE "${OUTPUT}"
+    "/* Generated from ${INPUT} by EmbedAsset.cmake; do not edit. */\n"
+    "static const char ${NAME}[] = {\n${hex}0x00\n};\n")
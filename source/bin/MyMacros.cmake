@@ -11,3 +11,24 @@ macro(APPEND_ALL_SOURCE_FILES_IN_DIRLIST result)
 #    ENDFOREACH()
     unset(filelist)
 endmacro()
+
+# Generate a perfect hash table from a gperf input file
+macro(GENERATE_GPERF_TABLE input output)
+    add_custom_command(
+        OUTPUT ${output}
+        MAIN_DEPENDENCY ${input}
+        COMMAND ${GPERF_EXECUTABLE} --output-file=${output} ${input}
+        VERBATIM)
+endmacro()
+
+# Embed a (minified) JavaScript asset into a C header
+macro(EMBED_JS_ASSET input output name)
+    add_custom_command(
+        OUTPUT ${output}
+        MAIN_DEPENDENCY ${input}
+        DEPENDS ${XGUIPRO_BIN_DIR}/EmbedAsset.cmake
+        COMMAND ${CMAKE_COMMAND} -DINPUT=${input} -DOUTPUT=${output}
+                -DNAME=${name} -DMINIFY=ON
+                -P ${XGUIPRO_BIN_DIR}/EmbedAsset.cmake
+        VERBATIM)
+endmacro()
@@ -33,6 +33,8 @@ list(APPEND xguipro_SOURCES
     gtk/BrowserTabbedWindow.h
     gtk/PurcmcCallbacks.c
     gtk/PurcmcCallbacks.h
+    gtk/PurcmcGVariant.c
+    gtk/PurcmcGVariant.h
     gtk/HVMLURISchema.c
     gtk/HVMLURISchema.h
     gtk/LayouterWidgets.c
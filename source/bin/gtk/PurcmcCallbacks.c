@@ -21,6 +21,7 @@
 */
 
 #undef NDEBUG
+#define _GNU_SOURCE
 
 #include "config.h"
 #include "main.h"
@@ -28,16 +29,22 @@
 #include "BrowserPlainWindow.h"
 #include "BuildRevision.h"
 #include "PurcmcCallbacks.h"
+#include "PurcmcGVariant.h"
 #include "HVMLURISchema.h"
 #include "LayouterWidgets.h"
 
 #include "purcmc/purcmc.h"
 #include "layouter/layouter.h"
+#include "layouter/dom-mirror.h"
 
 #include <errno.h>
 #include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include <gtk/gtk.h>
 #include <gdk/gdk.h>
+#include <gio/gunixfdlist.h>
 #include <string.h>
 #include <webkit2/webkit2.h>
 
@@ -118,12 +125,35 @@ purcmc_endpoint* purcmc_get_endpoint_by_session(purcmc_session *sess)
     return purcmc_endpoint_from_name(sess->srv, endpoint_name);
 }
 
+/* the time (seconds) to wait for the response from the web page */
+#define PENDING_RESPONSE_TIMEOUT    10
+
 struct packed_result {
+    /* the timer for the deadline of the response */
+    struct tw_timer timer;
+    purcmc_session *sess;
+    /* the key in pending_responses */
+    const char *request_id;
+
     void *result_value;
     size_t plain_len;
     char plain[0];
 };
 
+static void finish_response(purcmc_session* sess, const char *request_id,
+        unsigned int ret_code, purc_variant_t ret_data);
+
+static void on_response_timeout(struct tw_timer *timer)
+{
+    struct packed_result *packed;
+    packed = container_of(timer, struct packed_result, timer);
+
+    LOG_WARN("Timeout to wait for the response of request: %s\n",
+            packed->request_id);
+    finish_response(packed->sess, packed->request_id,
+            PCRDR_SC_GATEWAY_TIMEOUT, PURC_VARIANT_INVALID);
+}
+
 bool gtk_pend_response(purcmc_session* sess, purcmc_page *page,
         const char *operation, const char *request_id, void *result_value,
         const char *plain)
@@ -142,13 +172,23 @@ bool gtk_pend_response(purcmc_session* sess, purcmc_page *page,
         size_t plain_len = plain ? strlen(plain) + 1 : 0;
         size_t sz = sizeof(*packed) + plain_len;
         packed = malloc(sz);
+        packed->sess = sess;
         packed->result_value = result_value;
         packed->plain_len = plain_len;
         if (plain_len > 0) {
             memcpy(packed->plain, plain, plain_len);
         }
 
-        kvlist_set(&sess->pending_responses, request_id, &packed);
+        packed->request_id = kvlist_set_ex(&sess->pending_responses,
+                request_id, &packed);
+        if (packed->request_id == NULL) {
+            free(packed);
+            return false;
+        }
+
+        tw_timer_init(&packed->timer, on_response_timeout);
+        purcmc_rdrsrv_arm_timer(sess->srv, &packed->timer,
+                PENDING_RESPONSE_TIMEOUT);
     }
 
     return true;
@@ -173,7 +213,8 @@ static void finish_response(purcmc_session* sess, const char *request_id,
                 purc_variant_make_string_static(request_id, false);
             response.retCode = ret_code;
             response.resultValue = PTR2U64(packed->result_value);
-            if (ret_code == PCRDR_SC_OK && ret_data) {
+            if ((ret_code == PCRDR_SC_OK ||
+                        ret_code == PCRDR_SC_PARTIAL_CONTENT) && ret_data) {
                 response.dataType = PCRDR_MSG_DATA_TYPE_JSON;
                 response.data = purc_variant_ref(ret_data);
             }
@@ -189,28 +230,24 @@ static void finish_response(purcmc_session* sess, const char *request_id,
             purcmc_endpoint_send_response(sess->srv, endpoint, &response);
         }
 
+        tw_timer_del(&packed->timer);
         free(packed);
         kvlist_delete(&sess->pending_responses, request_id);
     }
 }
 
+/* The perfect hash table (generated by gperf from page-states.gperf)
+   mapping the states to the return codes */
+#include "purcmc/page-states.inc"
+
 static int state_string_to_value(const char *state)
 {
     if (state) {
-        if (strcasecmp(state, "Ok") == 0) {
-            return PCRDR_SC_OK;
-        }
-        else if (strcasecmp(state, "NotFound") == 0) {
-            return PCRDR_SC_NOT_FOUND;
-        }
-        else if (strcasecmp(state, "NotImplemented") == 0) {
-            return PCRDR_SC_NOT_IMPLEMENTED;
-        }
-        else if (strcasecmp(state, "PartialContent") == 0) {
-            return PCRDR_SC_PARTIAL_CONTENT;
-        }
-        else if (strcasecmp(state, "BadRequest") == 0) {
-            return PCRDR_SC_BAD_REQUEST;
+        const struct page_state_entry *entry;
+
+        entry = purcmc_lookup_page_state(state, strlen(state));
+        if (entry) {
+            return entry->ret_code;
         }
         else {
             LOG_WARN("Unknown state: %s", state);
@@ -220,35 +257,255 @@ static int state_string_to_value(const char *state)
     return PCRDR_SC_INTERNAL_SERVER_ERROR;
 }
 
-static void handle_response_from_webpage(purcmc_session *sess,
-        const char * str, size_t len)
+static void handle_one_response(purcmc_session *sess, GVariant *result)
 {
-    purc_variant_t result;
-    result = purc_variant_make_from_json_string(str, len);
-
     const char *request_id = NULL;
     const char *state = NULL;
 
-    purc_variant_t tmp;
-    if ((tmp = purc_variant_object_get_by_ckey(result, "requestId"))) {
-        request_id = purc_variant_get_string_const(tmp);
+    if (!g_variant_is_of_type(result, G_VARIANT_TYPE_VARDICT)) {
+        LOG_ERROR("Bad response from webPage: %s\n",
+                g_variant_get_type_string(result));
+        return;
     }
 
-    if ((tmp = purc_variant_object_get_by_ckey(result, "state"))) {
-        state = purc_variant_get_string_const(tmp);
-    }
-
-    purc_variant_t ret_data;
-    ret_data = purc_variant_object_get_by_ckey(result, "data");
+    g_variant_lookup(result, "requestId", "&s", &request_id);
+    g_variant_lookup(result, "state", "&s", &state);
     if (request_id && strcmp(request_id, PCRDR_REQUESTID_NORETURN)) {
+        purc_variant_t ret_data = PURC_VARIANT_INVALID;
+        GVariant *data = g_variant_lookup_value(result, "data", NULL);
+        if (data) {
+            ret_data = pcmc_variant_make_from_gvariant(data);
+            g_variant_unref(data);
+        }
+
         finish_response(sess, request_id,
                 state_string_to_value(state), ret_data);
+        if (ret_data)
+            purc_variant_unref(ret_data);
     }
     else {
         LOG_DEBUG("No normal requestId in the user message from webPage.\n");
     }
+}
+
+static void handle_response_from_webpage(purcmc_session *sess,
+        GVariant *result)
+{
+    /* the responses to a sequence of coalesced requests come in an array */
+    if (g_variant_is_of_type(result, G_VARIANT_TYPE("av"))) {
+        GVariantIter iter;
+        GVariant *item;
+
+        g_variant_iter_init(&iter, result);
+        while (g_variant_iter_next(&iter, "v", &item)) {
+            handle_one_response(sess, item);
+            g_variant_unref(item);
+        }
+    }
+    else {
+        handle_one_response(sess, result);
+    }
+}
+
+static void post_event_to_endpoint(purcmc_session *sess,
+        WebKitWebView *webview, gchar **strv)
+{
+    purcmc_endpoint* endpoint = purcmc_get_endpoint_by_session(sess);
+    if (endpoint == NULL)
+        return;
+
+    pcrdr_msg event = { };
+
+    event.type = PCRDR_MSG_TYPE_EVENT;
+    event.target = PCRDR_MSG_TARGET_DOM;
+    event.targetValue = PTR2U64(webview);
+    event.eventName =
+        purc_variant_make_string(strv[0], false);
+    /* TODO: use URI for the sourceURI */
+    event.sourceURI = purc_variant_make_string_static(
+            PCRDR_APP_RENDERER, false);
+    if (strcasecmp(strv[1], "id") == 0) {
+        event.elementType = PCRDR_MSG_ELEMENT_TYPE_ID;
+        event.elementValue =
+            purc_variant_make_string(strv[2], false);
+    }
+    else {
+        event.elementType = PCRDR_MSG_ELEMENT_TYPE_HANDLE;
+        event.elementValue =
+            purc_variant_make_string(strv[2], false);
+    }
+    event.property = PURC_VARIANT_INVALID;
+
+    event.dataType = PCRDR_MSG_DATA_TYPE_JSON;
+    event.data =
+        purc_variant_make_from_json_string(strv[3],
+                strlen(strv[3]));
+    if (event.data == PURC_VARIANT_INVALID) {
+        LOG_ERROR("bad JSON: %s\n", strv[3]);
+    }
+
+    purcmc_endpoint_post_event(sess->srv, endpoint, &event);
+}
+
+/*
+ * The renderer caps the rate of the continuous events of the same name from
+ * the same element (see the option --max-event-rate), whatever the page
+ * does. An event coming too early is held back in the slot of the element;
+ * a later one replaces it, and the latest one is posted when the interval
+ * elapses. A slot is freed once its interval elapses with nothing held.
+ *
+ * The other events are never held back, but any event held for the element
+ * is posted first, so the events of an element keep their order. Hence
+ * at most one event is held for an element.
+ */
+static const char *continuous_events[] = {
+    "mousemove", "pointermove", "touchmove", "scroll", "wheel",
+    "input", "resize",
+};
+
+struct event_slot {
+    WebKitWebView  *webview;
+    purcmc_session *sess;
+    GHashTable     *slots;
+    gchar          *key;        /* owned by the hash table */
+    gchar          *element;    /* `type/value` of the element */
+    gchar         **pending;
+    guint           timeout_id;
+};
+
+static void destroy_event_slot(gpointer data)
+{
+    struct event_slot *slot = data;
+
+    if (slot->timeout_id)
+        g_source_remove(slot->timeout_id);
+    g_strfreev(slot->pending);
+    g_free(slot->element);
+    free(slot);
+}
+
+static void post_held_event(struct event_slot *slot)
+{
+    post_event_to_endpoint(slot->sess, slot->webview, slot->pending);
+    g_strfreev(slot->pending);
+    slot->pending = NULL;
+}
+
+static gboolean on_event_slot_timeout(gpointer user_data);
+
+static inline void start_event_interval(struct event_slot *slot,
+        size_t max_rate)
+{
+    slot->timeout_id = g_timeout_add((1000 + max_rate - 1) / max_rate,
+            on_event_slot_timeout, slot);
+}
+
+static gboolean on_event_slot_timeout(gpointer user_data)
+{
+    struct event_slot *slot = user_data;
+
+    slot->timeout_id = 0;
+    if (slot->pending) {
+        size_t max_rate = GPOINTER_TO_SIZE(g_object_get_data(
+                    G_OBJECT(slot->sess->webkit_settings), "max-event-rate"));
+        post_held_event(slot);
+        start_event_interval(slot, max_rate);
+    }
+    else {
+        g_hash_table_remove(slot->slots, slot->key);
+    }
+
+    return G_SOURCE_REMOVE;
+}
+
+/* Post the event held for the element, if any, except the one in `except`. */
+static void flush_held_events(GHashTable *slots, const char *element,
+        struct event_slot *except)
+{
+    GHashTableIter iter;
+    gpointer value;
+
+    g_hash_table_iter_init(&iter, slots);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        struct event_slot *slot = value;
+        if (slot != except && slot->pending &&
+                strcmp(slot->element, element) == 0) {
+            /* the slot is freed when its interval elapses */
+            post_held_event(slot);
+        }
+    }
+}
+
+static bool is_continuous_event(const char *name)
+{
+    for (size_t i = 0; i < G_N_ELEMENTS(continuous_events); i++) {
+        if (strcmp(name, continuous_events[i]) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+/* Post the event or hold it back; the event is consumed. */
+static void limit_event_rate(purcmc_session *sess, WebKitWebView *webview,
+        gchar **strv)
+{
+    GHashTable *slots = g_object_get_data(G_OBJECT(webview),
+            "purcmc-event-slots");
+    size_t max_rate = GPOINTER_TO_SIZE(g_object_get_data(
+                G_OBJECT(sess->webkit_settings), "max-event-rate"));
+    gchar *element = g_strjoin("/", strv[1], strv[2], NULL);
+
+    if (max_rate == 0 || !is_continuous_event(strv[0])) {
+        if (slots)
+            flush_held_events(slots, element, NULL);
+        post_event_to_endpoint(sess, webview, strv);
+        g_strfreev(strv);
+        g_free(element);
+        return;
+    }
+
+    if (slots == NULL) {
+        slots = g_hash_table_new_full(g_str_hash, g_str_equal,
+                g_free, destroy_event_slot);
+        g_object_set_data_full(G_OBJECT(webview), "purcmc-event-slots",
+                slots, (GDestroyNotify)g_hash_table_unref);
+    }
+
+    gchar *key = g_strjoin("/", strv[0], element, NULL);
+    struct event_slot *slot = g_hash_table_lookup(slots, key);
+    flush_held_events(slots, element, slot);
+
+    if (slot == NULL) {
+        /* the first event in an interval is posted at once */
+        slot = calloc(1, sizeof(*slot));
+        slot->webview = webview;
+        slot->sess = sess;
+        slot->slots = slots;
+        slot->key = key;
+        slot->element = element;
+        g_hash_table_insert(slots, key, slot);
+
+        post_event_to_endpoint(sess, webview, strv);
+        g_strfreev(strv);
+        start_event_interval(slot, max_rate);
+        return;
+    }
+
+    g_free(key);
+    g_free(element);
+
+    /* the latest event replaces the one held back */
+    g_strfreev(slot->pending);
+    slot->sess = sess;
+    slot->pending = strv;
+}
 
-    purc_variant_unref(result);
+/* The held events refer to the session; drop them, and stop the timers,
+   once the web view is destroyed or the session is removed. */
+static inline void drop_held_events(WebKitWebView *webview)
+{
+    g_object_set_data(G_OBJECT(webview), "purcmc-event-slots", NULL);
 }
 
 static gboolean
@@ -261,15 +518,11 @@ user_message_received_callback(WebKitWebView *webview,
     LOG_INFO("get message: %s\n", name);
     if (strcmp(name, "page-ready") == 0) {
         GVariant *param = webkit_user_message_get_parameters(message);
-        const char* type = g_variant_get_type_string(param);
-        if (strcmp(type, "s") == 0) {
-            size_t len;
-            const char *str = g_variant_get_string(param, &len);
-            handle_response_from_webpage(sess, str, len);
+        if (param) {
+            handle_response_from_webpage(sess, param);
         }
         else {
-            LOG_ERROR("the parameter of the message is not a string (%s)\n",
-                    type);
+            LOG_ERROR("No parameter in the message: %s\n", name);
         }
     }
     else if (strcmp(name, "event") == 0) {
@@ -277,54 +530,24 @@ user_message_received_callback(WebKitWebView *webview,
         const char* type = g_variant_get_type_string(param);
         if (strcmp(type, "as") == 0) {
             size_t len;
-            const char **strv = g_variant_get_strv(param, &len);
+            gchar **strv = g_variant_dup_strv(param, &len);
             if (strcmp(strv[0], "page-load-begin") == 0) {
                 // TODO
+                g_strfreev(strv);
                 goto out;
             }
             else if (strcmp(strv[0], "page-loaded") == 0) {
                 // TODO
+                g_strfreev(strv);
                 goto out;
             }
 
-            purcmc_endpoint* endpoint = purcmc_get_endpoint_by_session(sess);
-
-            if (len == 4 && endpoint) {
-                pcrdr_msg event = { };
-
-                event.type = PCRDR_MSG_TYPE_EVENT;
-                event.target = PCRDR_MSG_TARGET_DOM;
-                event.targetValue = PTR2U64(webview);
-                event.eventName =
-                    purc_variant_make_string(strv[0], false);
-                /* TODO: use URI for the sourceURI */
-                event.sourceURI = purc_variant_make_string_static(
-                        PCRDR_APP_RENDERER, false);
-                if (strcasecmp(strv[1], "id") == 0) {
-                    event.elementType = PCRDR_MSG_ELEMENT_TYPE_ID;
-                    event.elementValue =
-                        purc_variant_make_string(strv[2], false);
-                }
-                else {
-                    event.elementType = PCRDR_MSG_ELEMENT_TYPE_HANDLE;
-                    event.elementValue =
-                        purc_variant_make_string(strv[2], false);
-                }
-                event.property = PURC_VARIANT_INVALID;
-
-                event.dataType = PCRDR_MSG_DATA_TYPE_JSON;
-                event.data =
-                    purc_variant_make_from_json_string(strv[3],
-                            strlen(strv[3]));
-                if (event.data == PURC_VARIANT_INVALID) {
-                    LOG_ERROR("bad JSON: %s\n", strv[2]);
-                }
-
-                free(strv);
-                purcmc_endpoint_post_event(sess->srv, endpoint, &event);
+            if (len == 4) {
+                limit_event_rate(sess, webview, strv);
             }
             else {
                 LOG_ERROR("wrong parameters of event message (%s)\n", type);
+                g_strfreev(strv);
             }
         }
         else {
@@ -337,6 +560,88 @@ out:
     return TRUE;
 }
 
+static struct webview_pool *get_webview_pool(purcmc_session *sess);
+
+/*
+ * The sessions of the same app share a web context, so the runners of
+ * an app share the web processes, the caches, and the prewarmed web views.
+ * The web contexts are kept by `host/app` in the hash table
+ * "purcmc-web-contexts" of the settings, and a web context is freed once
+ * the last session using it is removed. The hvml URI scheme handler
+ * gets the session from the web view, not from the web context.
+ */
+static WebKitWebContext *get_web_context(WebKitSettings *webkit_settings,
+        purcmc_endpoint *endpt)
+{
+    GHashTable *web_contexts = g_object_get_data(G_OBJECT(webkit_settings),
+            "purcmc-web-contexts");
+    if (web_contexts == NULL) {
+        web_contexts = g_hash_table_new_full(g_str_hash, g_str_equal,
+                g_free, g_object_unref);
+        g_object_set_data_full(G_OBJECT(webkit_settings),
+                "purcmc-web-contexts", web_contexts,
+                (GDestroyNotify)g_hash_table_unref);
+    }
+
+    gchar *key = g_strdup_printf("%s/%s", purcmc_endpoint_host_name(endpt),
+            purcmc_endpoint_app_name(endpt));
+    WebKitWebContext *web_context = g_hash_table_lookup(web_contexts, key);
+    if (web_context) {
+        g_free(key);
+    }
+    else {
+        WebKitWebsiteDataManager *manager;
+        manager = g_object_get_data(G_OBJECT(webkit_settings),
+                "default-website-data-manager");
+
+        web_context = g_object_new(WEBKIT_TYPE_WEB_CONTEXT,
+                "website-data-manager", manager,
+                "process-swap-on-cross-site-navigation-enabled", TRUE,
+#if !GTK_CHECK_VERSION(3, 98, 0) && WEBKIT_CHECK_VERSION(2, 30, 0)
+                "use-system-appearance-for-scrollbars", FALSE,
+#endif
+                NULL);
+
+        g_signal_connect(web_context, "initialize-web-extensions",
+                G_CALLBACK(initializeWebExtensionsCallback), (gpointer)"HVML");
+
+        // hvml schema
+        webkit_web_context_register_uri_scheme(web_context,
+                BROWSER_HVML_SCHEME,
+                (WebKitURISchemeRequestCallback)hvmlURISchemeRequestCallback,
+                web_context, NULL);
+
+        g_object_set_data(G_OBJECT(web_context), "purcmc-key", key);
+        g_hash_table_insert(web_contexts, key, web_context);
+    }
+
+    unsigned nr_sessions = GPOINTER_TO_UINT(g_object_get_data(
+                G_OBJECT(web_context), "purcmc-nr-sessions"));
+    g_object_set_data(G_OBJECT(web_context), "purcmc-nr-sessions",
+            GUINT_TO_POINTER(nr_sessions + 1));
+    return web_context;
+}
+
+static void put_web_context(WebKitSettings *webkit_settings,
+        WebKitWebContext *web_context)
+{
+    unsigned nr_sessions = GPOINTER_TO_UINT(g_object_get_data(
+                G_OBJECT(web_context), "purcmc-nr-sessions"));
+    if (nr_sessions > 1) {
+        g_object_set_data(G_OBJECT(web_context), "purcmc-nr-sessions",
+                GUINT_TO_POINTER(nr_sessions - 1));
+        return;
+    }
+
+    /* the prewarmed web views refer to the web context; the others still
+       alive keep their own references */
+    g_object_set_data(G_OBJECT(web_context), "purcmc-webview-pool", NULL);
+    GHashTable *web_contexts = g_object_get_data(G_OBJECT(webkit_settings),
+            "purcmc-web-contexts");
+    g_hash_table_remove(web_contexts,
+            g_object_get_data(G_OBJECT(web_context), "purcmc-key"));
+}
+
 purcmc_session *gtk_create_session(purcmc_server *srv, purcmc_endpoint *endpt)
 {
     purcmc_session* sess = calloc(1, sizeof(purcmc_session));
@@ -362,30 +667,10 @@ purcmc_session *gtk_create_session(purcmc_server *srv, purcmc_endpoint *endpt)
 
     sess->srv = srv;
     WebKitSettings *webkit_settings = purcmc_rdrsrv_get_user_data(srv);
-    WebKitWebsiteDataManager *manager;
-    manager = g_object_get_data(G_OBJECT(webkit_settings),
-            "default-website-data-manager");
-
-    WebKitWebContext *web_context = g_object_new(WEBKIT_TYPE_WEB_CONTEXT,
-            "website-data-manager", manager,
-            "process-swap-on-cross-site-navigation-enabled", TRUE,
-#if !GTK_CHECK_VERSION(3, 98, 0) && WEBKIT_CHECK_VERSION(2, 30, 0)
-            "use-system-appearance-for-scrollbars", FALSE,
-#endif
-            NULL);
-    g_object_unref(manager);
-
-    g_signal_connect(web_context, "initialize-web-extensions",
-            G_CALLBACK(initializeWebExtensionsCallback), (gpointer)"HVML");
-
-    // hvml schema
-    webkit_web_context_register_uri_scheme(web_context,
-            BROWSER_HVML_SCHEME,
-            (WebKitURISchemeRequestCallback)hvmlURISchemeRequestCallback,
-            web_context, NULL);
 
     sess->webkit_settings = webkit_settings;
-    sess->web_context = web_context;
+    sess->web_context = get_web_context(webkit_settings, endpt);
+    get_webview_pool(sess);
 
     kvlist_init(&sess->pending_responses, NULL);
     return sess;
@@ -402,6 +687,21 @@ failed:
     return NULL;
 }
 
+static void drop_dom_updates(WebKitWebView *webview);
+
+/* Release the states of the web view which refer to the session. */
+static void release_webview_states(WebKitWebView *webview)
+{
+    drop_held_events(webview);
+    drop_dom_updates(webview);
+}
+
+static void on_webview_destroy(GtkWidget *widget, gpointer user_data)
+{
+    (void)user_data;
+    release_webview_states(WEBKIT_WEB_VIEW(widget));
+}
+
 static int on_each_ostack(void *ctxt, const char *name, void *data)
 {
     (void)name;
@@ -429,6 +729,16 @@ int gtk_remove_session(purcmc_session *sess)
 {
     LOG_DEBUG("removing session (%p)...\n", sess);
 
+    /* the web views may outlive the session */
+    LOG_DEBUG("release the states of the web views...\n");
+    size_t nr_handles = sorted_array_count(sess->all_handles);
+    for (size_t i = 0; i < nr_handles; i++) {
+        void *data;
+        uint64_t handle = sorted_array_get(sess->all_handles, i, &data);
+        if ((uintptr_t)data == HT_WEBVIEW)
+            release_webview_states(INT2PTR(handle));
+    }
+
     LOG_DEBUG("destroy all windows/widgets created by this session...\n");
     pcutils_kvlist_for_each_safe(sess->workspace->page_owners, sess,
             on_each_ostack);
@@ -448,10 +758,13 @@ int gtk_remove_session(purcmc_session *sess)
     kvlist_for_each(&sess->pending_responses, name, data) {
         struct packed_result *packed;
         packed = *(struct packed_result **)data;
+        tw_timer_del(&packed->timer);
         free(packed);
     }
     kvlist_free(&sess->pending_responses);
 
+    put_web_context(sess->webkit_settings, sess->web_context);
+
     LOG_DEBUG("free session...\n");
     free(sess);
 
@@ -512,21 +825,22 @@ static gboolean on_webview_close(WebKitWebView *webview, purcmc_session *sess)
     return FALSE;
 }
 
-static WebKitWebView *create_web_view(purcmc_session *sess)
+static WebKitWebView *new_web_view(WebKitWebContext *web_context,
+        WebKitSettings *webkit_settings)
 {
 #if WEBKIT_CHECK_VERSION(2, 30, 0)
     WebKitWebsitePolicies *website_policies;
-    website_policies = g_object_get_data(G_OBJECT(sess->webkit_settings),
+    website_policies = g_object_get_data(G_OBJECT(webkit_settings),
             "default-website-policies");
 #endif
 
     WebKitUserContentManager *uc_manager;
-    uc_manager = g_object_get_data(G_OBJECT(sess->webkit_settings),
+    uc_manager = g_object_get_data(G_OBJECT(webkit_settings),
             "default-user-content-manager");
 
     return WEBKIT_WEB_VIEW(g_object_new(WEBKIT_TYPE_WEB_VIEW,
-                "web-context", sess->web_context,
-                "settings", sess->webkit_settings,
+                "web-context", web_context,
+                "settings", webkit_settings,
                 "user-content-manager", uc_manager,
                 "is-controlled-by-automation", FALSE,
 #if WEBKIT_CHECK_VERSION(2, 30, 0)
@@ -535,12 +849,150 @@ static WebKitWebView *create_web_view(purcmc_session *sess)
                 NULL));
 }
 
+/*
+ * The pool of the prewarmed web views of a web context (see the option
+ * --webview-pool). A prewarmed web view has a web process attached and
+ * a blank HVML page loaded with hvml.js injected. A new page takes one
+ * from the pool and binds it to its own HVML URI (see web_view_load_uri()),
+ * and the pool is refilled in the background at idle priority.
+ */
+struct webview_pool {
+    WebKitWebContext *web_context;
+    WebKitSettings   *webkit_settings;
+    char             *uri_prefix;
+    GQueue            ready;
+    GQueue            warming;
+    unsigned          size;
+    guint             idle_id;
+};
+
+static void on_prewarm_load_failed(WebKitWebView *webview,
+        WebKitLoadEvent load_event, gchar *failing_uri, GError *error,
+        struct webview_pool *pool)
+{
+    LOG_WARN("Failed to prewarm web view: %s\n", error->message);
+    g_object_set_data(G_OBJECT(webview), "purcmc-prewarm-failed", webview);
+}
+
+static void on_prewarm_load_changed(WebKitWebView *webview,
+        WebKitLoadEvent load_event, struct webview_pool *pool)
+{
+    if (load_event != WEBKIT_LOAD_FINISHED)
+        return;
+
+    g_signal_handlers_disconnect_by_data(webview, pool);
+    g_queue_remove(&pool->warming, webview);
+    if (g_object_get_data(G_OBJECT(webview), "purcmc-prewarm-failed")) {
+        g_object_unref(webview);
+        return;
+    }
+
+    g_object_set_data(G_OBJECT(webview), "purcmc-prewarmed", webview);
+    g_queue_push_tail(&pool->ready, webview);
+}
+
+static gboolean refill_webview_pool(gpointer user_data)
+{
+    struct webview_pool *pool = user_data;
+
+    if (pool->ready.length + pool->warming.length >= pool->size) {
+        pool->idle_id = 0;
+        return G_SOURCE_REMOVE;
+    }
+
+    char id[PURC_LEN_UNIQUE_ID + 1];
+    purc_generate_unique_id(id, "prewarm");
+    gchar *uri = g_strdup_printf("%s-/prewarm?irId=%s", pool->uri_prefix, id);
+
+    WebKitWebView *webview = new_web_view(pool->web_context,
+            pool->webkit_settings);
+    g_object_ref_sink(webview);
+    g_signal_connect(webview, "load-failed",
+            G_CALLBACK(on_prewarm_load_failed), pool);
+    g_signal_connect(webview, "load-changed",
+            G_CALLBACK(on_prewarm_load_changed), pool);
+    g_queue_push_tail(&pool->warming, webview);
+    webkit_web_view_load_uri(webview, uri);
+    g_free(uri);
+
+    /* one web view per main loop iteration */
+    return G_SOURCE_CONTINUE;
+}
+
+static void destroy_webview_pool(gpointer data)
+{
+    struct webview_pool *pool = data;
+    WebKitWebView *webview;
+
+    if (pool->idle_id)
+        g_source_remove(pool->idle_id);
+
+    while ((webview = g_queue_pop_head(&pool->warming))) {
+        g_signal_handlers_disconnect_by_data(webview, pool);
+        g_object_unref(webview);
+    }
+    while ((webview = g_queue_pop_head(&pool->ready)))
+        g_object_unref(webview);
+
+    free(pool->uri_prefix);
+    free(pool);
+}
+
+static struct webview_pool *get_webview_pool(purcmc_session *sess)
+{
+    size_t size = GPOINTER_TO_SIZE(g_object_get_data(
+                G_OBJECT(sess->webkit_settings), "webview-pool-size"));
+    if (size == 0)
+        return NULL;
+
+    struct webview_pool *pool = g_object_get_data(G_OBJECT(sess->web_context),
+            "purcmc-webview-pool");
+    if (pool == NULL) {
+        pool = calloc(1, sizeof(*pool));
+        pool->web_context = sess->web_context;
+        pool->webkit_settings = sess->webkit_settings;
+        pool->uri_prefix = strdup(sess->uri_prefix);
+        g_queue_init(&pool->ready);
+        g_queue_init(&pool->warming);
+        pool->size = size;
+        g_object_set_data_full(G_OBJECT(sess->web_context),
+                "purcmc-webview-pool", pool, destroy_webview_pool);
+    }
+
+    if (pool->idle_id == 0 &&
+            pool->ready.length + pool->warming.length < pool->size) {
+        pool->idle_id = g_idle_add_full(G_PRIORITY_LOW,
+                refill_webview_pool, pool, NULL);
+    }
+
+    return pool;
+}
+
+/* Create a floating web view; a prewarmed one is taken if there is one. */
+static WebKitWebView *create_web_view(purcmc_session *sess)
+{
+    struct webview_pool *pool = get_webview_pool(sess);
+    WebKitWebView *webview;
+
+    if (pool && (webview = g_queue_pop_head(&pool->ready))) {
+        get_webview_pool(sess);     /* refill it */
+
+        /* hand our reference over to the container like a new one */
+        g_object_force_floating(G_OBJECT(webview));
+        return webview;
+    }
+
+    return new_web_view(sess->web_context, sess->webkit_settings);
+}
+
 static void web_view_load_uri(WebKitWebView *webview,
         purcmc_session *sess, const char *group, const char *name,
         const char *request_id)
 {
     g_signal_connect(webview, "close",
             G_CALLBACK(on_webview_close), sess);
+    g_signal_connect(webview, "destroy",
+            G_CALLBACK(on_webview_destroy), NULL);
     g_signal_connect(webview, "user-message-received",
             G_CALLBACK(user_message_received_callback),
             sess);
@@ -560,7 +1012,22 @@ static void web_view_load_uri(WebKitWebView *webview,
     strcat(uri, request_id);
 
     g_object_set_data(G_OBJECT(webview), "purcmc-session", sess);
-    webkit_web_view_load_uri(webview, uri);
+    if (g_object_get_data(G_OBJECT(webview), "purcmc-prewarmed")) {
+        /* the page replies page-ready once bound to the URI */
+        g_object_set_data(G_OBJECT(webview), "purcmc-prewarmed", NULL);
+
+        GVariantBuilder builder;
+        g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
+        g_variant_builder_add(&builder, "{sv}", "uri",
+                g_variant_new_string(uri));
+        webkit_web_view_send_message_to_page(webview,
+                webkit_user_message_new("bind",
+                    g_variant_builder_end(&builder)),
+                NULL, NULL, NULL);
+    }
+    else {
+        webkit_web_view_load_uri(webview, uri);
+    }
 }
 
 struct find_first_page {
@@ -1031,20 +1498,348 @@ request_ready_callback(GObject* obj, GAsyncResult* result, gpointer user_data)
 
     if (message) {
         GVariant *param = webkit_user_message_get_parameters(message);
-
-        const char* type = g_variant_get_type_string(param);
-        if (strcmp(type, "s") == 0) {
-            size_t len;
-            const char *str = g_variant_get_string(param, &len);
-
+        if (param) {
             LOG_DEBUG("The parameter of message named (%s): %s\n",
                     webkit_user_message_get_name(message),
-                    g_variant_get_string(param, NULL));
-            handle_response_from_webpage(sess, str, len);
+                    g_variant_get_type_string(param));
+            handle_response_from_webpage(sess, param);
         }
         else {
-            LOG_DEBUG("Not supported parameter type: %s\n", type);
+            LOG_DEBUG("No parameter in the reply: %s\n",
+                    webkit_user_message_get_name(message));
+        }
+
+        g_object_unref(message);
+    }
+}
+
+/*
+ * The DOM updates to a web view are queued and sent to the page in one
+ * message when the main loop gets idle, i.e., after the packets ready
+ * have been handled; the page applies them in order and answers with
+ * an array of the responses to the original requests. Any other request
+ * to the page flushes the queue first to keep the order.
+ */
+
+/* flush the queue if there are so many updates or bytes queued */
+#define MAX_QUEUED_DOM_UPDATES      256
+#define MAX_QUEUED_DOM_BYTES        (1024 * 1024)
+
+struct dom_update_queue {
+    WebKitWebView  *webview;
+    purcmc_session *sess;
+    GVariantBuilder *updates;
+    unsigned        nr_updates;
+    size_t          sz_updates;
+    guint           idle_id;
+};
+
+static void flush_dom_updates(WebKitWebView *webview)
+{
+    struct dom_update_queue *queue;
+
+    queue = g_object_get_data(G_OBJECT(webview), "purcmc-dom-updates");
+    if (queue == NULL || queue->nr_updates == 0)
+        return;
+
+    if (queue->idle_id) {
+        g_source_remove(queue->idle_id);
+        queue->idle_id = 0;
+    }
+
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_add(&builder, "{sv}", "operation",
+            g_variant_new_string("sequence"));
+    g_variant_builder_add(&builder, "{sv}", "data",
+            g_variant_builder_end(queue->updates));
+    g_variant_builder_unref(queue->updates);
+    queue->updates = NULL;
+    queue->nr_updates = 0;
+    queue->sz_updates = 0;
+
+    WebKitUserMessage * message = webkit_user_message_new("request",
+            g_variant_builder_end(&builder));
+
+    webkit_web_view_send_message_to_page(webview, message, NULL,
+            request_ready_callback, queue->sess);
+}
+
+static gboolean on_dom_updates_idle(gpointer user_data)
+{
+    struct dom_update_queue *queue = user_data;
+
+    queue->idle_id = 0;
+    flush_dom_updates(queue->webview);
+    return G_SOURCE_REMOVE;
+}
+
+static void destroy_dom_update_queue(gpointer data)
+{
+    struct dom_update_queue *queue = data;
+
+    if (queue->idle_id)
+        g_source_remove(queue->idle_id);
+    if (queue->updates)
+        g_variant_builder_unref(queue->updates);
+    free(queue);
+}
+
+/* The queued updates refer to the session, and the page is going away
+   or its session is removed; drop them and the pending idle source. */
+static void drop_dom_updates(WebKitWebView *webview)
+{
+    g_object_set_data(G_OBJECT(webview), "purcmc-dom-updates", NULL);
+}
+
+/* Queue a request of DOM update; the floating reference of request
+   is consumed. */
+static void queue_dom_update(purcmc_session *sess, WebKitWebView *webview,
+        GVariant *request, size_t size)
+{
+    struct dom_update_queue *queue;
+
+    queue = g_object_get_data(G_OBJECT(webview), "purcmc-dom-updates");
+    if (queue == NULL) {
+        queue = calloc(1, sizeof(*queue));
+        queue->webview = webview;
+        g_object_set_data_full(G_OBJECT(webview), "purcmc-dom-updates",
+                queue, destroy_dom_update_queue);
+    }
+    else if (queue->nr_updates > 0 && queue->sess != sess) {
+        /* the responses go to the session sending the message */
+        flush_dom_updates(webview);
+    }
+
+    if (queue->nr_updates == 0) {
+        queue->sess = sess;
+        queue->updates = g_variant_builder_new(G_VARIANT_TYPE("av"));
+    }
+
+    g_variant_builder_add(queue->updates, "v", request);
+    queue->nr_updates++;
+    queue->sz_updates += size;
+
+    if (queue->nr_updates >= MAX_QUEUED_DOM_UPDATES ||
+            queue->sz_updates >= MAX_QUEUED_DOM_BYTES) {
+        flush_dom_updates(webview);
+    }
+    else if (queue->idle_id == 0) {
+        /* run before GTK redraws the windows */
+        queue->idle_id = g_idle_add_full(G_PRIORITY_HIGH_IDLE,
+                on_dom_updates_idle, queue, NULL);
+    }
+}
+
+/* Add a string member to the request; nullable. */
+static inline void add_string_member(GVariantBuilder *builder,
+        const char *key, const char *str)
+{
+    if (str == NULL)
+        str = "";
+    g_variant_builder_add(builder, "{sv}", key,
+            pcmc_gvariant_new_string(str, strlen(str)));
+}
+
+/* Make a sealed memfd holding the content; returns -1 on failure. */
+static int make_content_memfd(const char *content, size_t length)
+{
+    int fd = memfd_create("xguipro-content", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0)
+        return -1;
+
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = write(fd, content + done, length - done);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            goto failed;
+        }
+        done += n;
+    }
+
+    /* the web process maps the memfd; it must never change */
+    if (fcntl(fd, F_ADD_SEALS,
+                F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL))
+        goto failed;
+
+    return fd;
+
+failed:
+    close(fd);
+    return -1;
+}
+
+/*
+ * Add the content to the request as the member `data`. A content not
+ * smaller than the memfd threshold is passed in a sealed memfd instead:
+ * the request has the members `dataFd` (the handle in the returned fd list)
+ * and `dataLength`, and the web extension maps the memfd to make the
+ * member `data`.
+ */
+static GUnixFDList *add_data_member(purcmc_session *sess,
+        GVariantBuilder *builder, const char *content, size_t length)
+{
+    size_t threshold = GPOINTER_TO_SIZE(g_object_get_data(
+                G_OBJECT(sess->webkit_settings), "memfd-threshold"));
+
+    if (threshold > 0 && length >= threshold) {
+        int fd = make_content_memfd(content, length);
+        if (fd >= 0) {
+            GUnixFDList *fds = g_unix_fd_list_new_from_array(&fd, 1);
+            g_variant_builder_add(builder, "{sv}", "dataFd",
+                    g_variant_new_handle(0));
+            g_variant_builder_add(builder, "{sv}", "dataLength",
+                    g_variant_new_uint64(length));
+            return fds;
         }
+
+        LOG_WARN("Failed to pass the content in memfd: %s\n",
+                strerror(errno));
+    }
+
+    g_variant_builder_add(builder, "{sv}", "data",
+            pcmc_gvariant_new_string(content ? content : "", length));
+    return NULL;
+}
+
+/* Make the message of a request; the fd list is consumed. */
+static WebKitUserMessage *new_request_message(GVariant *params,
+        GUnixFDList *fds)
+{
+    if (fds == NULL)
+        return webkit_user_message_new("request", params);
+
+    WebKitUserMessage *message =
+        webkit_user_message_new_with_fd_list("request", params, fds);
+    g_object_unref(fds);
+    return message;
+}
+
+/* Send a request carrying the content to the page; the source is nullable. */
+static void send_content_request(purcmc_session *sess, WebKitWebView *webview,
+        const char *op_name, const char *request_id, const char *source,
+        const char *content, size_t length)
+{
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
+    add_string_member(&builder, "operation", op_name);
+    add_string_member(&builder, "requestId", request_id);
+    if (source)
+        add_string_member(&builder, "source", source);
+    GUnixFDList *fds = add_data_member(sess, &builder, content, length);
+
+    WebKitUserMessage * message = new_request_message(
+            g_variant_builder_end(&builder), fds);
+
+    webkit_web_view_send_message_to_page(webview, message, NULL,
+            request_ready_callback, sess);
+}
+
+/* the chunks stop doubling at this size */
+#define MAX_LOAD_CHUNK_SIZE     (1024 * 1024)
+
+/*
+ * Stream a large document to the page in the requests writeBegin,
+ * writeMore, and writeEnd with the source `load`, so the page starts to
+ * parse and paint the document before the last chunk arrives. The first
+ * chunk is small for an early first paint, and each following chunk
+ * doubles the size up to MAX_LOAD_CHUNK_SIZE to keep the number of
+ * messages low. Only the last chunk carries the requestId.
+ */
+static void stream_document(purcmc_session *sess, WebKitWebView *webview,
+        const char *request_id, const char *content, size_t length,
+        size_t chunk_size)
+{
+    const char *op_name = PCRDR_OPERATION_WRITEBEGIN;
+    size_t pos = 0;
+
+    while (length - pos > chunk_size) {
+        size_t end = pos + chunk_size;
+
+        /* never split a UTF-8 sequence */
+        while (end > pos && (content[end] & 0xC0) == 0x80)
+            end--;
+        if (end == pos)
+            end = pos + chunk_size;
+
+        send_content_request(sess, webview, op_name,
+                PCRDR_REQUESTID_NORETURN, "load", content + pos, end - pos);
+        op_name = PCRDR_OPERATION_WRITEMORE;
+        pos = end;
+
+        if (chunk_size < MAX_LOAD_CHUNK_SIZE)
+            chunk_size *= 2;
+    }
+
+    send_content_request(sess, webview, PCRDR_OPERATION_WRITEEND,
+            request_id, "load", content + pos, length - pos);
+}
+
+/*
+ * When the option `--dom-mirror` is given, the renderer keeps a mirror of
+ * the document of each page, so the computable properties are answered
+ * without a round trip to the web process. The mirror is dropped once
+ * an operation it can not follow is sent to the page, till the next load.
+ */
+static struct dom_mirror *get_dom_mirror(WebKitWebView *webview)
+{
+    return g_object_get_data(G_OBJECT(webview), "purcmc-dom-mirror");
+}
+
+static inline void drop_dom_mirror(WebKitWebView *webview)
+{
+    g_object_set_data(G_OBJECT(webview), "purcmc-dom-mirror", NULL);
+}
+
+static void mirror_load_or_write(purcmc_session *sess, WebKitWebView *webview,
+        int op, const char *content, size_t length)
+{
+    struct dom_mirror *mirror;
+
+    if (op == PCRDR_K_OPERATION_LOAD || op == PCRDR_K_OPERATION_WRITEBEGIN) {
+        if (!GPOINTER_TO_INT(g_object_get_data(
+                        G_OBJECT(sess->webkit_settings), "dom-mirror")))
+            return;
+
+        mirror = dom_mirror_new();
+        if (mirror == NULL) {
+            drop_dom_mirror(webview);
+            return;
+        }
+
+        /* the previous mirror is deleted */
+        g_object_set_data_full(G_OBJECT(webview), "purcmc-dom-mirror",
+                mirror, (GDestroyNotify)dom_mirror_delete);
+    }
+    else if ((mirror = get_dom_mirror(webview)) == NULL) {
+        return;
+    }
+
+    if (!dom_mirror_write(mirror, content, length)) {
+        drop_dom_mirror(webview);
+        return;
+    }
+
+    if (op == PCRDR_K_OPERATION_LOAD || op == PCRDR_K_OPERATION_WRITEEND) {
+        if (!dom_mirror_close(mirror))
+            drop_dom_mirror(webview);
+    }
+}
+
+static void mirror_update(WebKitWebView *webview, const char *op_name,
+        const char *element_type, const char *element_value,
+        const char *property, const char *data_type,
+        const char *content, size_t length)
+{
+    struct dom_mirror *mirror = get_dom_mirror(webview);
+
+    if (mirror && !dom_mirror_update(mirror, op_name, element_type,
+                element_value, property, data_type, content, length)) {
+        LOG_INFO("DOM mirror dropped by %s on %s/%s\n", op_name,
+                element_type, element_value);
+        drop_dom_mirror(webview);
     }
 }
 
@@ -1092,11 +1887,6 @@ gtk_revoke_crtn(purcmc_session *sess, purcmc_page *page,
     return to_reload.corh;
 }
 
-#define PAGE_MESSAGE_FORMAT  "{"    \
-        "\"operation\":\"%s\","     \
-        "\"requestId\":\"%s\","     \
-        "\"data\":\"%s\"}"
-
 purcmc_udom *gtk_load_or_write(purcmc_session *sess, purcmc_page *page,
             int op, const char *op_name, const char* request_id,
             const char *content, size_t length,
@@ -1106,17 +1896,21 @@ purcmc_udom *gtk_load_or_write(purcmc_session *sess, purcmc_page *page,
     if (webview == NULL)
         return NULL;
 
-    char *escaped = pcutils_escape_string_for_json(content);
-    gchar *json = g_strdup_printf(PAGE_MESSAGE_FORMAT, op_name,
-            request_id, escaped ? escaped : "");
+    size_t chunk_size = GPOINTER_TO_SIZE(g_object_get_data(
+                G_OBJECT(sess->webkit_settings), "load-chunk-size"));
 
-    WebKitUserMessage * message = webkit_user_message_new("request",
-            g_variant_new_string(json));
-    g_free(json);
-    free(escaped);
+    mirror_load_or_write(sess, webview, op, content, length);
 
-    webkit_web_view_send_message_to_page(webview, message, NULL,
-            request_ready_callback, sess);
+    flush_dom_updates(webview);
+    if (op == PCRDR_K_OPERATION_LOAD && chunk_size > 0 &&
+            length > chunk_size) {
+        stream_document(sess, webview, request_id, content, length,
+                chunk_size);
+    }
+    else {
+        send_content_request(sess, webview, op_name, request_id, NULL,
+                content, length);
+    }
 
     if (op == PCRDR_K_OPERATION_LOAD || op == PCRDR_K_OPERATION_WRITEBEGIN) {
         purc_page_ostack_t ostack = g_object_get_data(G_OBJECT(webview),
@@ -1143,15 +1937,6 @@ purcmc_udom *gtk_load_or_write(purcmc_session *sess, purcmc_page *page,
     return (purcmc_udom *)webview;
 }
 
-#define DOM_MESSAGE_FORMAT  "{"     \
-        "\"operation\":\"%s\","     \
-        "\"requestId\":\"%s\","     \
-        "\"elementType\":\"%s\","   \
-        "\"element\":\"%s\","       \
-        "\"property\":\"%s\","      \
-        "\"dataType\":\"%s\","      \
-        "\"data\":\"%s\"}"
-
 int gtk_update_dom(purcmc_session *sess, purcmc_udom *dom,
             int op, const char *op_name, const char* request_id,
             const char* element_type, const char* element_value,
@@ -1175,42 +1960,114 @@ int gtk_update_dom(purcmc_session *sess, purcmc_udom *dom,
         }
     }
 
-    char *element_escaped = NULL;
-    if (element_value)
-        element_escaped = pcutils_escape_string_for_json(element_value);
+    mirror_update(webview, op_name, element_type, element_value, property,
+            pcrdr_data_type_name(text_type), content, length);
 
-    char *escaped = NULL;
-    if (content)
-        escaped = pcutils_escape_string_for_json(content);
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
+    add_string_member(&builder, "operation", op_name);
+    add_string_member(&builder, "requestId", request_id);
+    add_string_member(&builder, "elementType", element_type);
+    add_string_member(&builder, "element", element_value);
+    add_string_member(&builder, "property", property);
+    add_string_member(&builder, "dataType", pcrdr_data_type_name(text_type));
+    GUnixFDList *fds = add_data_member(sess, &builder, content, length);
 
-    gchar *json = g_strdup_printf(DOM_MESSAGE_FORMAT, op_name, request_id,
-            element_type, element_escaped ? element_escaped : "",
-            property ? property : "", pcrdr_data_type_name(text_type),
-            escaped ? escaped : "");
-    if (element_escaped)
-        free(element_escaped);
-    if (escaped)
-        free(escaped);
+    if (fds) {
+        /* the queued updates go in one message without any fd */
+        WebKitUserMessage * message = new_request_message(
+                g_variant_builder_end(&builder), fds);
+
+        flush_dom_updates(webview);
+        webkit_web_view_send_message_to_page(webview, message, NULL,
+                request_ready_callback, sess);
+    }
+    else {
+        queue_dom_update(sess, webview, g_variant_builder_end(&builder),
+                length);
+    }
+    return 0;
+}
+
+/* the members of an operation in a batch for the DOM mirror; `data` is
+   the last one */
+static const char *batch_op_keys[] = {
+    "operation", "elementType", "element", "property", "dataType", "data",
+};
+
+int gtk_update_dom_batch(purcmc_session *sess, purcmc_udom *dom,
+            const char* request_id, purc_variant_t ops)
+{
+    int retv = PCRDR_SC_OK;
+
+    WebKitWebView *webview = validate_handle(sess, (purcmc_page *)dom, &retv);
+    if (webview == NULL) {
+        LOG_ERROR("Bad DOM pointer: %p.\n", dom);
+        return retv;
+    }
+
+    size_t nr_ops = 0;
+    purc_variant_array_size(ops, &nr_ops);
+    for (size_t i = 0; i < nr_ops; i++) {
+        purc_variant_t tmp;
+        const char *property = NULL;
+
+        tmp = purc_variant_object_get_by_ckey(purc_variant_array_get(ops, i),
+                "property");
+        if (tmp)
+            property = purc_variant_get_string_const(tmp);
+
+        if (property && strncmp(property, "attr.", 5) == 0) {
+            if (!purc_is_valid_loose_token(property + 5, PURC_LEN_PROPERTY_NAME)) {
+                LOG_WARN("Bad property: %s.\n", property);
+                return PCRDR_SC_BAD_REQUEST;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < nr_ops && get_dom_mirror(webview); i++) {
+        purc_variant_t op = purc_variant_array_get(ops, i);
+        const char *members[G_N_ELEMENTS(batch_op_keys)] = { };
+        size_t length = 0;
+
+        for (size_t j = 0; j < G_N_ELEMENTS(batch_op_keys); j++) {
+            purc_variant_t tmp;
+            tmp = purc_variant_object_get_by_ckey(op, batch_op_keys[j]);
+            if (tmp == PURC_VARIANT_INVALID)
+                continue;
+
+            members[j] = purc_variant_get_string_const_ex(tmp, &length);
+            if (members[j] == NULL) {
+                /* the page converts the other values to strings */
+                drop_dom_mirror(webview);
+                break;
+            }
+        }
+
+        if (members[5] == NULL)
+            length = 0;
+        mirror_update(webview, members[0], members[1], members[2],
+                members[3], members[4], members[5], length);
+    }
+
+    /* all operations go to the page in one user message */
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
+    add_string_member(&builder, "operation", "batch");
+    add_string_member(&builder, "requestId", request_id);
+    g_variant_builder_add(&builder, "{sv}", "data",
+            pcmc_gvariant_new_from_variant(ops));
 
     WebKitUserMessage * message = webkit_user_message_new("request",
-            g_variant_new_string(json));
-    g_free(json);
+            g_variant_builder_end(&builder));
 
+    flush_dom_updates(webview);
     webkit_web_view_send_message_to_page(webview, message, NULL,
             request_ready_callback, sess);
 
     return 0;
 }
 
-#define DOM_MESSAGE_FORMAT_CALLMETHOD  "{"      \
-        "\"operation\":\"callMethod\","         \
-        "\"requestId\":\"%s\","                 \
-        "\"elementType\":\"%s\","               \
-        "\"element\":\"%s\","                   \
-        "\"data\":{"                            \
-        "\"method\":\"%s\","                    \
-        "\"arg\":%s}}"
-
 purc_variant_t
 gtk_call_method_in_dom(purcmc_session *sess, const char *request_id,
         purcmc_udom *dom, const char* element_type, const char* element_value,
@@ -1222,45 +2079,28 @@ gtk_call_method_in_dom(purcmc_session *sess, const char *request_id,
         return PURC_VARIANT_INVALID;
     }
 
-    char *element_escaped = NULL;
-    if (element_value)
-        element_escaped = pcutils_escape_string_for_json(element_value);
-
-    char *method_escaped;
-    method_escaped = pcutils_escape_string_for_json(method);
+    /* a method may change the element in any way */
+    drop_dom_mirror(webview);
 
-    char *arg_in_json = NULL;
-    if (arg) {
-        purc_rwstream_t buffer = NULL;
-        buffer = purc_rwstream_new_buffer(PCRDR_MIN_PACKET_BUFF_SIZE,
-                PCRDR_MAX_INMEM_PAYLOAD_SIZE);
-
-        if (purc_variant_serialize(arg, buffer, 0,
-                PCVRNT_SERIALIZE_OPT_PLAIN, NULL) < 0) {
-            *retv = PCRDR_SC_INSUFFICIENT_STORAGE;
-            return PURC_VARIANT_INVALID;
-        }
-
-        purc_rwstream_write(buffer, "", 1); // the terminating null byte.
-
-        arg_in_json = purc_rwstream_get_mem_buffer_ex(buffer,
-                NULL, NULL, true);
-        purc_rwstream_destroy(buffer);
-    }
+    GVariantBuilder data;
+    g_variant_builder_init(&data, G_VARIANT_TYPE_VARDICT);
+    add_string_member(&data, "method", method);
+    g_variant_builder_add(&data, "{sv}", "arg",
+            pcmc_gvariant_new_from_variant(arg));
 
-    gchar *json = g_strdup_printf(DOM_MESSAGE_FORMAT_CALLMETHOD, request_id,
-            element_type, element_escaped ? element_escaped : "",
-            method_escaped, arg_in_json ? arg_in_json : "null");
-    if (element_escaped)
-        free(element_escaped);
-    free(method_escaped);
-    if (arg_in_json)
-        free(arg_in_json);
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
+    add_string_member(&builder, "operation", "callMethod");
+    add_string_member(&builder, "requestId", request_id);
+    add_string_member(&builder, "elementType", element_type);
+    add_string_member(&builder, "element", element_value);
+    g_variant_builder_add(&builder, "{sv}", "data",
+            g_variant_builder_end(&data));
 
     WebKitUserMessage * message = webkit_user_message_new("request",
-            g_variant_new_string(json));
-    g_free(json);
+            g_variant_builder_end(&builder));
 
+    flush_dom_updates(webview);
     webkit_web_view_send_message_to_page(webview, message, NULL,
             request_ready_callback, sess);
 
@@ -1268,13 +2108,6 @@ gtk_call_method_in_dom(purcmc_session *sess, const char *request_id,
     return PURC_VARIANT_INVALID;
 }
 
-#define DOM_MESSAGE_FORMAT_GETPROPERTY  "{"     \
-        "\"operation\":\"getProperty\","        \
-        "\"requestId\":\"%s\","                 \
-        "\"elementType\":\"%s\","               \
-        "\"element\":\"%s\","                   \
-        "\"property\":\"%s\"}"                  \
-
 purc_variant_t
 gtk_get_property_in_dom(purcmc_session *sess, const char *request_id,
         purcmc_udom *dom, const char* element_type, const char* element_value,
@@ -1291,20 +2124,28 @@ gtk_get_property_in_dom(purcmc_session *sess, const char *request_id,
         return PURC_VARIANT_INVALID;
     }
 
-    char *element_escaped = NULL;
-    if (element_value)
-        element_escaped = pcutils_escape_string_for_json(element_value);
+    struct dom_mirror *mirror = get_dom_mirror(webview);
+    if (mirror) {
+        purc_variant_t result = dom_mirror_get_property(mirror,
+                element_type, element_value, property);
+        if (result != PURC_VARIANT_INVALID) {
+            *retv = PCRDR_SC_OK;
+            return result;
+        }
+    }
 
-    gchar *json = g_strdup_printf(DOM_MESSAGE_FORMAT_GETPROPERTY, request_id,
-            element_type ? element_type : "",
-            element_escaped ? element_escaped : "", property);
-    if (element_escaped)
-        free(element_escaped);
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
+    add_string_member(&builder, "operation", "getProperty");
+    add_string_member(&builder, "requestId", request_id);
+    add_string_member(&builder, "elementType", element_type);
+    add_string_member(&builder, "element", element_value);
+    add_string_member(&builder, "property", property);
 
     WebKitUserMessage * message = webkit_user_message_new("request",
-            g_variant_new_string(json));
-    g_free(json);
+            g_variant_builder_end(&builder));
 
+    flush_dom_updates(webview);
     webkit_web_view_send_message_to_page(webview, message, NULL,
             request_ready_callback, sess);
 
@@ -1312,14 +2153,6 @@ gtk_get_property_in_dom(purcmc_session *sess, const char *request_id,
     return PURC_VARIANT_INVALID;
 }
 
-#define DOM_MESSAGE_FORMAT_SETPROPERTY  "{"     \
-        "\"operation\":\"setProperty\","        \
-        "\"requestId\":\"%s\","                 \
-        "\"elementType\":\"%s\","               \
-        "\"element\":\"%s\","                   \
-        "\"property\":\"%s\","                  \
-        "\"value\":%s}"
-
 purc_variant_t
 gtk_set_property_in_dom(purcmc_session *sess, const char *request_id,
         purcmc_udom *dom, const char* element_type, const char* element_value,
@@ -1336,42 +2169,22 @@ gtk_set_property_in_dom(purcmc_session *sess, const char *request_id,
         return PURC_VARIANT_INVALID;
     }
 
-    char *element_escaped = NULL;
-    if (element_value)
-        element_escaped = pcutils_escape_string_for_json(element_value);
-
-    char *value_in_json = NULL;
-    if (value) {
-        purc_rwstream_t buffer = NULL;
-        buffer = purc_rwstream_new_buffer(PCRDR_MIN_PACKET_BUFF_SIZE,
-                PCRDR_MAX_INMEM_PAYLOAD_SIZE);
-
-        if (purc_variant_serialize(value, buffer, 0,
-                PCVRNT_SERIALIZE_OPT_PLAIN, NULL) < 0) {
-            *retv = PCRDR_SC_INSUFFICIENT_STORAGE;
-            return PURC_VARIANT_INVALID;
-        }
-
-        purc_rwstream_write(buffer, "", 1); // the terminating null byte.
-
-        value_in_json = purc_rwstream_get_mem_buffer_ex(buffer,
-                NULL, NULL, true);
-        purc_rwstream_destroy(buffer);
-    }
+    drop_dom_mirror(webview);
 
-    gchar *json = g_strdup_printf(DOM_MESSAGE_FORMAT_SETPROPERTY, request_id,
-            element_type ? element_type : "",
-            element_escaped ? element_escaped : "", property,
-            value_in_json ? value_in_json : "null");
-    if (element_escaped)
-        free(element_escaped);
-    if (value_in_json)
-        free(value_in_json);
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
+    add_string_member(&builder, "operation", "setProperty");
+    add_string_member(&builder, "requestId", request_id);
+    add_string_member(&builder, "elementType", element_type);
+    add_string_member(&builder, "element", element_value);
+    add_string_member(&builder, "property", property);
+    g_variant_builder_add(&builder, "{sv}", "value",
+            pcmc_gvariant_new_from_variant(value));
 
     WebKitUserMessage * message = webkit_user_message_new("request",
-            g_variant_new_string(json));
-    g_free(json);
+            g_variant_builder_end(&builder));
 
+    flush_dom_updates(webview);
     webkit_web_view_send_message_to_page(webview, message, NULL,
             request_ready_callback, sess);
 
@@ -87,6 +87,9 @@ int gtk_update_dom(purcmc_session *, purcmc_udom *,
             const char* property, pcrdr_msg_data_type text_type,
             const char *content, size_t length);
 
+int gtk_update_dom_batch(purcmc_session *, purcmc_udom *,
+            const char* request_id, purc_variant_t ops);
+
 purc_variant_t gtk_call_method_in_dom(purcmc_session *, const char *,
         purcmc_udom *, const char* element_type, const char* element_value,
         const char *method, purc_variant_t arg, int* retv);
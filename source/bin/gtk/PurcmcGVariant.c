@@ -0,0 +1,265 @@
+/*
+** PurcmcGVariant.c -- The conversion between PurC variants and GVariants.
+**
+** Copyright (C) 2023 FMSoft (http://www.fmsoft.cn)
+**
+** This file is part of xGUI Pro, an advanced HVML renderer.
+**
+** xGUI Pro is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** xGUI Pro is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/.
+*/
+
+#include "config.h"
+#include "PurcmcGVariant.h"
+
+#include <string.h>
+
+/* the containers nested deeper are converted to null */
+#define MAX_DEPTH       64
+
+static inline GVariant *new_null(void)
+{
+    return g_variant_new_maybe(G_VARIANT_TYPE_VARIANT, NULL);
+}
+
+GVariant *pcmc_gvariant_new_string(const char *str, size_t len)
+{
+    if (g_utf8_validate(str, len, NULL) && str[len] == '\0')
+        return g_variant_new_string(str);
+
+    /* the string has invalid sequences or a null byte inside, or it is
+       a part of a longer string */
+    return g_variant_new_take_string(g_utf8_make_valid(str, len));
+}
+
+static GVariant *new_from_variant(purc_variant_t v, int depth)
+{
+    enum purc_variant_type type = purc_variant_get_type(v);
+
+    switch (type) {
+    case PURC_VARIANT_TYPE_BOOLEAN:
+        return g_variant_new_boolean(purc_variant_is_true(v));
+
+    case PURC_VARIANT_TYPE_NUMBER:
+    case PURC_VARIANT_TYPE_LONGDOUBLE: {
+        double d = 0;
+        purc_variant_cast_to_number(v, &d, false);
+        return g_variant_new_double(d);
+    }
+
+    case PURC_VARIANT_TYPE_LONGINT: {
+        int64_t i = 0;
+        purc_variant_cast_to_longint(v, &i, false);
+        return g_variant_new_int64(i);
+    }
+
+    case PURC_VARIANT_TYPE_ULONGINT: {
+        uint64_t u = 0;
+        purc_variant_cast_to_ulongint(v, &u, false);
+        return g_variant_new_uint64(u);
+    }
+
+    case PURC_VARIANT_TYPE_STRING:
+    case PURC_VARIANT_TYPE_ATOMSTRING:
+    case PURC_VARIANT_TYPE_EXCEPTION: {
+        size_t len = 0;
+        const char *str = purc_variant_get_string_const_ex(v, &len);
+        if (str == NULL)
+            break;
+        return pcmc_gvariant_new_string(str, len);
+    }
+
+    case PURC_VARIANT_TYPE_BSEQUENCE: {
+        size_t nr_bytes = 0;
+        const unsigned char *bytes = purc_variant_get_bytes_const(v,
+                &nr_bytes);
+        return g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE,
+                bytes, nr_bytes, 1);
+    }
+
+    case PURC_VARIANT_TYPE_ARRAY:
+    case PURC_VARIANT_TYPE_SET:
+    case PURC_VARIANT_TYPE_TUPLE: {
+        size_t n = 0;
+        GVariantBuilder builder;
+
+        if (depth >= MAX_DEPTH)
+            break;
+
+        g_variant_builder_init(&builder, G_VARIANT_TYPE("av"));
+        purc_variant_linear_container_size(v, &n);
+        for (size_t i = 0; i < n; i++) {
+            purc_variant_t item = purc_variant_linear_container_get(v, i);
+            g_variant_builder_add(&builder, "v",
+                    new_from_variant(item, depth + 1));
+        }
+        return g_variant_builder_end(&builder);
+    }
+
+    case PURC_VARIANT_TYPE_OBJECT: {
+        purc_variant_t key, val;
+        GVariantBuilder builder;
+
+        if (depth >= MAX_DEPTH)
+            break;
+
+        g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
+        foreach_key_value_in_variant_object(v, key, val)
+            g_variant_builder_add(&builder, "{sv}",
+                    purc_variant_get_string_const(key),
+                    new_from_variant(val, depth + 1));
+        end_foreach;
+        return g_variant_builder_end(&builder);
+    }
+
+    default:
+        /* undefined, null, dynamic, and native */
+        break;
+    }
+
+    return new_null();
+}
+
+GVariant *pcmc_gvariant_new_from_variant(purc_variant_t v)
+{
+    if (v == PURC_VARIANT_INVALID)
+        return new_null();
+
+    return new_from_variant(v, 0);
+}
+
+static purc_variant_t make_from_gvariant(GVariant *gv, int depth);
+
+static purc_variant_t make_array_from_gvariant(GVariant *gv, int depth)
+{
+    purc_variant_t arr = purc_variant_make_array_0();
+    GVariantIter iter;
+    GVariant *item;
+
+    g_variant_iter_init(&iter, gv);
+    while ((item = g_variant_iter_next_value(&iter))) {
+        purc_variant_t v = make_from_gvariant(item, depth + 1);
+        purc_variant_array_append(arr, v);
+        purc_variant_unref(v);
+        g_variant_unref(item);
+    }
+
+    return arr;
+}
+
+static purc_variant_t make_from_gvariant(GVariant *gv, int depth)
+{
+    const GVariantType *type = g_variant_get_type(gv);
+
+    if (depth >= MAX_DEPTH)
+        return purc_variant_make_null();
+
+    switch (g_variant_classify(gv)) {
+    case G_VARIANT_CLASS_BOOLEAN:
+        return purc_variant_make_boolean(g_variant_get_boolean(gv));
+
+    case G_VARIANT_CLASS_BYTE:
+        return purc_variant_make_number(g_variant_get_byte(gv));
+    case G_VARIANT_CLASS_INT16:
+        return purc_variant_make_number(g_variant_get_int16(gv));
+    case G_VARIANT_CLASS_UINT16:
+        return purc_variant_make_number(g_variant_get_uint16(gv));
+    case G_VARIANT_CLASS_INT32:
+        return purc_variant_make_number(g_variant_get_int32(gv));
+    case G_VARIANT_CLASS_UINT32:
+        return purc_variant_make_number(g_variant_get_uint32(gv));
+    case G_VARIANT_CLASS_INT64:
+        return purc_variant_make_longint(g_variant_get_int64(gv));
+    case G_VARIANT_CLASS_UINT64:
+        return purc_variant_make_ulongint(g_variant_get_uint64(gv));
+    case G_VARIANT_CLASS_DOUBLE:
+        return purc_variant_make_number(g_variant_get_double(gv));
+
+    case G_VARIANT_CLASS_STRING:
+    case G_VARIANT_CLASS_OBJECT_PATH:
+    case G_VARIANT_CLASS_SIGNATURE: {
+        gsize len;
+        const gchar *str = g_variant_get_string(gv, &len);
+        return purc_variant_make_string_ex(str, len, false);
+    }
+
+    case G_VARIANT_CLASS_VARIANT: {
+        GVariant *inner = g_variant_get_variant(gv);
+        purc_variant_t v = make_from_gvariant(inner, depth + 1);
+        g_variant_unref(inner);
+        return v;
+    }
+
+    case G_VARIANT_CLASS_MAYBE: {
+        GVariant *inner = g_variant_get_maybe(gv);
+        if (inner == NULL)
+            return purc_variant_make_null();
+
+        purc_variant_t v = make_from_gvariant(inner, depth + 1);
+        g_variant_unref(inner);
+        return v;
+    }
+
+    case G_VARIANT_CLASS_ARRAY:
+        if (g_variant_type_equal(type, G_VARIANT_TYPE_BYTESTRING)) {
+            gsize n;
+            const guint8 *bytes = g_variant_get_fixed_array(gv, &n, 1);
+            return purc_variant_make_byte_sequence(bytes, n);
+        }
+        else if (g_variant_type_is_dict_entry(
+                    g_variant_type_element(type))) {
+            purc_variant_t obj = purc_variant_make_object_0();
+            GVariantIter iter;
+            GVariant *entry;
+
+            g_variant_iter_init(&iter, gv);
+            while ((entry = g_variant_iter_next_value(&iter))) {
+                GVariant *key = g_variant_get_child_value(entry, 0);
+                GVariant *val = g_variant_get_child_value(entry, 1);
+
+                /* only the string keys make sense in JSON */
+                if (g_variant_is_of_type(key, G_VARIANT_TYPE_STRING)) {
+                    purc_variant_t v = make_from_gvariant(val, depth + 1);
+                    purc_variant_object_set_by_ckey(obj,
+                            g_variant_get_string(key, NULL), v);
+                    purc_variant_unref(v);
+                }
+
+                g_variant_unref(key);
+                g_variant_unref(val);
+                g_variant_unref(entry);
+            }
+            return obj;
+        }
+        else {
+            return make_array_from_gvariant(gv, depth);
+        }
+
+    case G_VARIANT_CLASS_TUPLE:
+        return make_array_from_gvariant(gv, depth);
+
+    default:
+        /* handles and dictionary entries out of a dictionary */
+        break;
+    }
+
+    return purc_variant_make_null();
+}
+
+purc_variant_t pcmc_variant_make_from_gvariant(GVariant *gv)
+{
+    if (gv == NULL)
+        return purc_variant_make_null();
+
+    return make_from_gvariant(gv, 0);
+}
+
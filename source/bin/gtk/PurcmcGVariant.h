@@ -0,0 +1,51 @@
+/*
+** PurcmcGVariant.h -- The conversion between PurC variants and GVariants.
+**
+** Copyright (C) 2023 FMSoft (http://www.fmsoft.cn)
+**
+** This file is part of xGUI Pro, an advanced HVML renderer.
+**
+** xGUI Pro is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** xGUI Pro is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef PurcmcGVariant_h
+#define PurcmcGVariant_h
+
+#include <glib.h>
+#include <purc/purc.h>
+
+/*
+ * The messages to and from the web extension are GVariants of the same
+ * shape as JSON: null is `mv` (nothing), a boolean is `b`, a number is `d`,
+ * `x`, or `t`, a string is `s`, an array is `av`, and an object is `a{sv}`.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Make a floating string GVariant from a string which might not be
+   valid UTF-8; the invalid sequences are replaced. */
+GVariant *pcmc_gvariant_new_string(const char *str, size_t len);
+
+/* Make a floating GVariant from a PurC variant; never returns NULL. */
+GVariant *pcmc_gvariant_new_from_variant(purc_variant_t v);
+
+/* Make a PurC variant from a GVariant. */
+purc_variant_t pcmc_variant_make_from_gvariant(GVariant *gv);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* PurcmcGVariant_h */
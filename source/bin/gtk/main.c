@@ -37,6 +37,7 @@
 #include "purcmc/purcmc.h"
 
 #include <errno.h>
+#include <glib-unix.h>
 #include <gtk/gtk.h>
 #include <string.h>
 #include <webkit2/webkit2.h>
@@ -74,6 +75,11 @@ static gboolean enableSandbox;
 static gboolean exitAfterLoad;
 static gboolean webProcessCrashed;
 static gboolean printVersion;
+static gint memfdThreshold = 1024 * 1024;
+static gint loadChunkSize = 64 * 1024;
+static gint maxEventRate = 120;
+static gint webViewPoolSize = 1;
+static gboolean domMirror;
 
 static gchar *argumentToURL(const char *filename)
 {
@@ -161,6 +167,14 @@ static const GOptionEntry commandLineOptions[] =
 #endif
     { "pcmc-maxfrmsize", 0, 0, G_OPTION_ARG_INT, &pcmc_srvcfg.max_frm_size, "The maximum size of a socket frame", "BYTES" },
     { "pcmc-backlog", 0, 0, G_OPTION_ARG_INT, &pcmc_srvcfg.backlog, "The maximum length to which the queue of pending connections.", "NUMBER" },
+    { "pcmc-polling", 0, 0, G_OPTION_ARG_NONE, &pcmc_srvcfg.polling, "Poll the sockets every 10ms instead of dispatching on the socket events", NULL },
+    { "pcmc-maxevents", 0, 0, G_OPTION_ARG_INT, &pcmc_srvcfg.max_events, "The maximum number of socket events got by each wait (default: 64)", "NUMBER" },
+    { "pcmc-timebudget", 0, 0, G_OPTION_ARG_INT, &pcmc_srvcfg.time_budget, "The time budget to drain the sockets in each main loop iteration (default: 2000)", "USECS" },
+    { "pcmc-iothread", 0, 0, G_OPTION_ARG_NONE, &pcmc_srvcfg.iothread, "Handle the I/O of Unix socket clients in a dedicated thread", NULL },
+    { "pcmc-quantum", 0, 0, G_OPTION_ARG_INT, &pcmc_srvcfg.quantum, "The bytes of messages served for an endpoint in each scheduling round (default: 16384)", "BYTES" },
+    { "pcmc-maxops", 0, 0, G_OPTION_ARG_INT, &pcmc_srvcfg.max_ops, "The number of messages served for an endpoint in each scheduling round (default: 4)", "NUMBER" },
+    { "pcmc-appweights", 0, 0, G_OPTION_ARG_STRING, &pcmc_srvcfg.app_weights, "The scheduling weights of apps, e.g. cn.fmsoft.hvml.foo:4,cn.fmsoft.hvml.bar:2 (default weight: 1)", "APP:WEIGHT[,...]" },
+    { "pcmc-bufpool", 0, 0, G_OPTION_ARG_INT, &pcmc_srvcfg.buf_pool_cap, "The max bytes of free packet buffers kept for reuse; a negative value disables it (default: 4194304)", "BYTES" },
 
 #if WEBKIT_CHECK_VERSION(2, 30, 0)
     { "autoplay-policy", 0, 0, G_OPTION_ARG_CALLBACK, parseAutoplayPolicy, "Autoplay policy. Valid options are: allow, allow-without-sound, and deny", NULL },
@@ -186,6 +200,11 @@ static const GOptionEntry commandLineOptions[] =
 #endif
     { "enable-sandbox", 0, 0, G_OPTION_ARG_NONE, &enableSandbox, "Enable web process sandbox support", NULL },
     { "exit-after-load", 0, 0, G_OPTION_ARG_NONE, &exitAfterLoad, "Quit the browser after the load finishes", NULL },
+    { "memfd-threshold", 0, 0, G_OPTION_ARG_INT, &memfdThreshold, "The size from which a document is passed to the web process in shared memory; 0 to disable (default: 1048576)", "BYTES" },
+    { "load-chunk-size", 0, 0, G_OPTION_ARG_INT, &loadChunkSize, "The size of the first chunk in which a large document is streamed to the page; 0 to disable (default: 65536)", "BYTES" },
+    { "max-event-rate", 0, 0, G_OPTION_ARG_INT, &maxEventRate, "The max number of the continuous events (mousemove, scroll, input, resize, etc.) of the same name posted from an element per second; 0 for no limit (default: 120)", "NUMBER" },
+    { "webview-pool", 0, 0, G_OPTION_ARG_INT, &webViewPoolSize, "The number of prewarmed web views kept for the new pages of each web context; 0 to disable (default: 1)", "NUMBER" },
+    { "dom-mirror", 0, 0, G_OPTION_ARG_NONE, &domMirror, "Mirror the DOM of each page in the renderer to answer the computable properties without the web process", NULL },
     { "version", 'v', 0, G_OPTION_ARG_NONE, &printVersion, "Print the WebKitGTK version", NULL },
     { G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &uriArguments, 0, "[URL…]" },
     { 0, 0, 0, 0, 0, 0, 0 }
@@ -722,6 +741,37 @@ static void setDefaultWebsitePolicies(WebKitSettings *webkitSettings)
 }
 #endif
 
+static gboolean purcmcFdCallback(gint fd, GIOCondition condition, gpointer userData)
+{
+    return purcmc_rdrsrv_check((purcmc_server *)userData);
+}
+
+static void attachPurcmcServer(purcmc_server *srv, GMainContext *context)
+{
+    GSource *source;
+    int fd = purcmc_rdrsrv_get_fd(srv);
+
+    if (!pcmc_srvcfg.polling && fd >= 0) {
+        /* dispatch the packets as soon as the sockets get ready */
+        source = g_unix_fd_source_new(fd, G_IO_IN);
+        g_source_set_callback(source,
+                G_SOURCE_FUNC(purcmcFdCallback), srv, NULL);
+        g_source_attach(source, context);
+        g_source_unref(source);
+
+        /* the pings and timeouts are checked when there is no event */
+        source = g_timeout_source_new_seconds(1);
+    }
+    else {
+        source = g_timeout_source_new(10);
+    }
+
+    g_source_set_callback(source,
+            G_SOURCE_FUNC(purcmc_rdrsrv_check), srv, NULL);
+    g_source_attach(source, context);
+    g_source_unref(source);
+}
+
 static void startup(GApplication *application, WebKitSettings *webkitSettings)
 {
     const char *actionAccels[] = {
@@ -751,6 +801,16 @@ static void startup(GApplication *application, WebKitSettings *webkitSettings)
 
     /* use webkitSettings to store some global data */
     g_object_set_data(G_OBJECT(webkitSettings), "gtk-application", application);
+    g_object_set_data(G_OBJECT(webkitSettings), "memfd-threshold",
+            GSIZE_TO_POINTER(memfdThreshold > 0 ? memfdThreshold : 0));
+    g_object_set_data(G_OBJECT(webkitSettings), "load-chunk-size",
+            GSIZE_TO_POINTER(loadChunkSize > 0 ? loadChunkSize : 0));
+    g_object_set_data(G_OBJECT(webkitSettings), "max-event-rate",
+            GSIZE_TO_POINTER(maxEventRate > 0 ? maxEventRate : 0));
+    g_object_set_data(G_OBJECT(webkitSettings), "webview-pool-size",
+            GSIZE_TO_POINTER(webViewPoolSize > 0 ? webViewPoolSize : 0));
+    g_object_set_data(G_OBJECT(webkitSettings), "dom-mirror",
+            GINT_TO_POINTER(domMirror));
     setDefaultWebsiteDataManager(webkitSettings);
 #if WEBKIT_CHECK_VERSION(2, 30, 0)
     setDefaultWebsitePolicies(webkitSettings);
@@ -785,6 +845,7 @@ static void startup(GApplication *application, WebKitSettings *webkitSettings)
         .revoke_crtn = gtk_revoke_crtn,
 
         .update_dom = gtk_update_dom,
+        .update_dom_batch = gtk_update_dom_batch,
 
         .call_method_in_dom = gtk_call_method_in_dom,
         .get_property_in_dom = gtk_get_property_in_dom,
@@ -803,19 +864,12 @@ static void startup(GApplication *application, WebKitSettings *webkitSettings)
         exit(EXIT_FAILURE);
     }
 
-    GMainContext *context = g_main_context_default();
-
-    GSource *source;
-    source = g_timeout_source_new(10);
-    g_source_set_callback(source,
-            G_SOURCE_FUNC(purcmc_rdrsrv_check), pcmc_srv, NULL);
-    g_source_attach(source, context);
-    g_source_unref(source);
+    attachPurcmcServer(pcmc_srv, g_main_context_default());
 }
 
 static void shutdown(GApplication *application, WebKitSettings *webkitSettings)
 {
-    g_source_remove_by_user_data(pcmc_srv);
+    while (g_source_remove_by_user_data(pcmc_srv));
     purcmc_rdrsrv_deinit(pcmc_srv);
 
     WebKitWebsiteDataManager *manager;
@@ -0,0 +1,501 @@
+/*
+** dom-mirror.c -- The module implementation for the DOM mirror of a page.
+**
+** Copyright (C) 2023 FMSoft (http://www.fmsoft.cn)
+**
+** This file is part of xGUI Pro, an advanced HVML renderer.
+**
+** xGUI Pro is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** xGUI Pro is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/.
+*/
+
+#include "dom-mirror.h"
+#include "dom-ops.h"
+
+#include <purc/purc.h>
+#include <glib.h>
+
+#include <string.h>
+
+#define HVML_HANDLE         "hvml-handle"
+
+struct dom_mirror {
+    pchtml_html_document_t *html_doc;
+
+    /* hvml-handle -> element; the keys are the attribute values */
+    GHashTable *handle_index;
+
+    /* all elements having hvml-handle are in the index */
+    bool        index_complete;
+    bool        parsing;
+};
+
+static inline pcdom_document_t *mirror_doc(struct dom_mirror *mirror)
+{
+    return pcdom_interface_document(mirror->html_doc);
+}
+
+struct dom_mirror *dom_mirror_new(void)
+{
+    struct dom_mirror *mirror = calloc(1, sizeof(*mirror));
+    if (mirror == NULL)
+        return NULL;
+
+    mirror->html_doc = pchtml_html_document_create();
+    if (mirror->html_doc == NULL)
+        goto failed;
+
+    if (pchtml_html_document_parse_chunk_begin(mirror->html_doc))
+        goto failed;
+
+    mirror->handle_index = g_hash_table_new(g_str_hash, g_str_equal);
+    mirror->parsing = true;
+    return mirror;
+
+failed:
+    if (mirror->html_doc)
+        pchtml_html_document_destroy(mirror->html_doc);
+    free(mirror);
+    return NULL;
+}
+
+void dom_mirror_delete(struct dom_mirror *mirror)
+{
+    if (mirror->parsing)
+        pchtml_html_document_parse_chunk_end(mirror->html_doc);
+
+    g_hash_table_destroy(mirror->handle_index);
+    dom_cleanup_id_map(mirror_doc(mirror));
+    pchtml_html_document_destroy(mirror->html_doc);
+    free(mirror);
+}
+
+bool dom_mirror_write(struct dom_mirror *mirror,
+        const char *content, size_t length)
+{
+    if (!mirror->parsing)
+        return false;
+
+    if (length == 0)
+        return true;
+
+    return pchtml_html_document_parse_chunk(mirror->html_doc,
+            (const unsigned char *)content, length) == 0;
+}
+
+bool dom_mirror_close(struct dom_mirror *mirror)
+{
+    if (!mirror->parsing)
+        return false;
+
+    mirror->parsing = false;
+    if (pchtml_html_document_parse_chunk_end(mirror->html_doc))
+        return false;
+
+    return dom_prepare_id_map(mirror_doc(mirror));
+}
+
+static pchtml_action_t
+index_walker(pcdom_node_t *node, void *ctxt)
+{
+    GHashTable *index = ctxt;
+    const unsigned char *handle;
+    size_t len;
+
+    if (node->type != PCDOM_NODE_TYPE_ELEMENT)
+        return PCHTML_ACTION_NEXT;
+
+    handle = pcdom_element_get_attribute(pcdom_interface_element(node),
+            (const unsigned char *)HVML_HANDLE, sizeof(HVML_HANDLE) - 1,
+            &len);
+    if (handle)
+        g_hash_table_insert(index, (gpointer)handle, node);
+
+    if (node->first_child != NULL)
+        return PCHTML_ACTION_OK;
+
+    return PCHTML_ACTION_NEXT;
+}
+
+/* Called after removing any element or changing any hvml-handle. */
+static inline void reset_handle_index(struct dom_mirror *mirror)
+{
+    g_hash_table_remove_all(mirror->handle_index);
+    mirror->index_complete = false;
+}
+
+static pcdom_element_t *
+find_element_by_handle(struct dom_mirror *mirror, const char *handle)
+{
+    pcdom_element_t *element;
+
+    element = g_hash_table_lookup(mirror->handle_index, handle);
+    if (element == NULL && !mirror->index_complete) {
+        /* the elements inserted after the last build are not indexed */
+        g_hash_table_remove_all(mirror->handle_index);
+        pcdom_node_simple_walk(&mirror_doc(mirror)->node, index_walker,
+                mirror->handle_index);
+        mirror->index_complete = true;
+
+        element = g_hash_table_lookup(mirror->handle_index, handle);
+    }
+
+    return element;
+}
+
+static pcdom_element_t *
+find_element(struct dom_mirror *mirror,
+        const char *element_type, const char *element_value)
+{
+    if (element_value == NULL)
+        return NULL;
+
+    if (strcmp(element_type, "id") == 0) {
+        if (mirror_doc(mirror)->user == NULL)
+            return NULL;
+        return dom_get_element_by_id(mirror_doc(mirror), element_value);
+    }
+    else if (strcmp(element_type, "handle") == 0) {
+        return find_element_by_handle(mirror, element_value);
+    }
+
+    return NULL;
+}
+
+/* Set an attribute as updateProperty() in hvml.js does. */
+static bool
+set_attribute(struct dom_mirror *mirror, pcdom_element_t *element,
+        const char *property, const char *content, size_t length)
+{
+    pcdom_document_t *dom_doc = mirror_doc(mirror);
+    bool is_id = strcmp(property + 5, "id") == 0;
+    bool retv;
+
+    /* the id map refers to the values of id attributes */
+    if (is_id)
+        dom_cleanup_id_map(dom_doc);
+
+    retv = dom_update_element(dom_doc, element, property, content, length);
+
+    if (is_id && !dom_prepare_id_map(dom_doc))
+        retv = false;
+    else if (strcmp(property + 5, HVML_HANDLE) == 0)
+        reset_handle_index(mirror);
+
+    return retv;
+}
+
+static bool
+remove_attribute(struct dom_mirror *mirror, pcdom_element_t *element,
+        const char *property)
+{
+    pcdom_document_t *dom_doc = mirror_doc(mirror);
+    bool is_id = strcmp(property + 5, "id") == 0;
+
+    if (is_id)
+        dom_cleanup_id_map(dom_doc);
+
+    /* removing an attribute not existing is fine with the page */
+    dom_remove_element_property(dom_doc, element, property);
+
+    if (is_id)
+        return dom_prepare_id_map(dom_doc);
+    else if (strcmp(property + 5, HVML_HANDLE) == 0)
+        reset_handle_index(mirror);
+
+    return true;
+}
+
+static bool
+set_text_content(struct dom_mirror *mirror, pcdom_element_t *element,
+        const char *content, size_t length)
+{
+    reset_handle_index(mirror);
+    return dom_update_element(mirror_doc(mirror), element, "textContent",
+            content, length);
+}
+
+static void
+clear_children(struct dom_mirror *mirror, pcdom_element_t *element)
+{
+    reset_handle_index(mirror);
+    dom_clear_element(mirror_doc(mirror), element);
+}
+
+/* The same as updateProperty() in hvml.js. */
+static bool
+update_property(struct dom_mirror *mirror, pcdom_element_t *element,
+        const char *property, const char *content, size_t length)
+{
+    if (strcmp(property, "textContent") == 0 ||
+            strcmp(property, "content") == 0) {
+        return set_text_content(mirror, element, content, length);
+    }
+    else if (strncmp(property, "attr.", 5) == 0) {
+        return set_attribute(mirror, element, property, content, length);
+    }
+
+    /* prop.* may change anything */
+    return false;
+}
+
+/* Insert the content as a text node, as the plain data in hvml.js. */
+static bool
+insert_text(struct dom_mirror *mirror, pcdom_element_t *element,
+        const char *op_name, const char *property,
+        const char *content, size_t length)
+{
+    pcdom_node_t *node = pcdom_interface_node(element);
+    pcdom_text_t *text_node;
+
+    if (strcmp(op_name, PCRDR_OPERATION_DISPLACE) == 0) {
+        if (property)
+            return update_property(mirror, element, property, content, length);
+
+        return set_text_content(mirror, element, content, length);
+    }
+
+    text_node = pcdom_document_create_text_node(mirror_doc(mirror),
+            (const unsigned char *)content, length);
+    if (text_node == NULL)
+        return false;
+
+    if (strcmp(op_name, PCRDR_OPERATION_APPEND) == 0)
+        pcdom_node_append_child(node, pcdom_interface_node(text_node));
+    else if (strcmp(op_name, PCRDR_OPERATION_PREPEND) == 0)
+        pcdom_node_prepend_child(node, pcdom_interface_node(text_node));
+    else if (strcmp(op_name, PCRDR_OPERATION_INSERTBEFORE) == 0)
+        pcdom_node_insert_before(node, pcdom_interface_node(text_node));
+    else
+        pcdom_node_insert_after(node, pcdom_interface_node(text_node));
+
+    return true;
+}
+
+/* Insert the HTML fragment, as updateDocumentWithHTML() in hvml.js. */
+static bool
+insert_html(struct dom_mirror *mirror, pcdom_element_t *element,
+        const char *op_name, const char *property,
+        const char *content, size_t length)
+{
+    pcdom_document_t *dom_doc = mirror_doc(mirror);
+    pcdom_node_t *subtree, *div, *child;
+    bool has_elements = false;
+
+    subtree = dom_parse_fragment(dom_doc, element, content, length);
+    if (subtree == NULL || subtree->first_child == NULL) {
+        if (subtree)
+            dom_destroy_subtree(subtree);
+        return false;
+    }
+
+    div = subtree->first_child;
+    for (child = div->first_child; child; child = child->next) {
+        if (child->type == PCDOM_NODE_TYPE_ELEMENT) {
+            has_elements = true;
+            break;
+        }
+    }
+
+    if (!has_elements) {
+        /* no child elements, the page treats the data as a text node */
+        dom_destroy_subtree(subtree);
+        return insert_text(mirror, element, op_name, property,
+                content, length);
+    }
+
+    /* the page discards the text nodes out of the child elements */
+    child = div->first_child;
+    while (child) {
+        pcdom_node_t *next = child->next;
+        if (child->type != PCDOM_NODE_TYPE_ELEMENT)
+            pcdom_node_destroy_deep(child);
+        child = next;
+    }
+
+    if (strcmp(op_name, PCRDR_OPERATION_APPEND) == 0) {
+        dom_append_subtree_to_element(dom_doc, element, subtree);
+    }
+    else if (strcmp(op_name, PCRDR_OPERATION_PREPEND) == 0) {
+        dom_prepend_subtree_to_element(dom_doc, element, subtree);
+    }
+    else if (strcmp(op_name, PCRDR_OPERATION_INSERTBEFORE) == 0) {
+        dom_insert_subtree_before_element(dom_doc, element, subtree);
+    }
+    else if (strcmp(op_name, PCRDR_OPERATION_INSERTAFTER) == 0) {
+        dom_insert_subtree_after_element(dom_doc, element, subtree);
+    }
+    else {
+        reset_handle_index(mirror);
+        dom_displace_subtree_of_element(dom_doc, element, subtree);
+    }
+
+    mirror->index_complete = false;
+    return true;
+}
+
+static bool
+update_element(struct dom_mirror *mirror, pcdom_element_t *element,
+        const char *op_name, const char *property, const char *data_type,
+        const char *content, size_t length)
+{
+    if (strcmp(op_name, PCRDR_OPERATION_UPDATE) == 0) {
+        if (property == NULL)
+            return false;
+        return update_property(mirror, element, property, content, length);
+    }
+    else if (strcmp(op_name, PCRDR_OPERATION_CLEAR) == 0) {
+        if (property && strncmp(property, "attr.", 5) == 0)
+            return set_attribute(mirror, element, property, "", 0);
+
+        clear_children(mirror, element);
+        return true;
+    }
+    else if (strcmp(op_name, PCRDR_OPERATION_ERASE) == 0) {
+        if (property && strcmp(property, "textContent") == 0) {
+            clear_children(mirror, element);
+        }
+        else if (property && strncmp(property, "attr.", 5) == 0) {
+            return remove_attribute(mirror, element, property);
+        }
+        else {
+            reset_handle_index(mirror);
+            dom_erase_element(mirror_doc(mirror), element);
+        }
+        return true;
+    }
+    else if (strcmp(op_name, PCRDR_OPERATION_APPEND) == 0 ||
+            strcmp(op_name, PCRDR_OPERATION_PREPEND) == 0 ||
+            strcmp(op_name, PCRDR_OPERATION_INSERTBEFORE) == 0 ||
+            strcmp(op_name, PCRDR_OPERATION_INSERTAFTER) == 0 ||
+            strcmp(op_name, PCRDR_OPERATION_DISPLACE) == 0) {
+        if (data_type == NULL)
+            return false;
+
+        if (strcmp(data_type, "plain") == 0)
+            return insert_text(mirror, element, op_name, property,
+                    content, length);
+        else if (strcmp(data_type, "html") == 0)
+            return insert_html(mirror, element, op_name, property,
+                    content, length);
+
+        /* SVG, MathML, and XML are parsed by the page in other ways */
+        return false;
+    }
+
+    return false;
+}
+
+bool dom_mirror_update(struct dom_mirror *mirror, const char *op_name,
+        const char *element_type, const char *element_value,
+        const char *property, const char *data_type,
+        const char *content, size_t length)
+{
+    if (mirror->parsing || op_name == NULL || element_type == NULL)
+        return false;
+
+    if (content == NULL) {
+        content = "";
+        length = 0;
+    }
+
+    if (strcmp(element_type, "handles") == 0) {
+        if (element_value == NULL)
+            return true;
+
+        gchar **handles = g_strsplit(element_value, ",", -1);
+        bool retv = true;
+        for (int i = 0; retv && handles[i]; i++) {
+            pcdom_element_t *element;
+            element = find_element_by_handle(mirror, handles[i]);
+            if (element)
+                retv = update_element(mirror, element, op_name, property,
+                        data_type, content, length);
+        }
+        g_strfreev(handles);
+        return retv;
+    }
+    else if (strcmp(element_type, "id") == 0 ||
+            strcmp(element_type, "handle") == 0) {
+        pcdom_element_t *element;
+        element = find_element(mirror, element_type, element_value);
+
+        /* the page does not find the element either */
+        if (element == NULL)
+            return true;
+
+        return update_element(mirror, element, op_name, property,
+                data_type, content, length);
+    }
+
+    return false;
+}
+
+static purc_variant_t
+make_attribute_value(pcdom_element_t *element, const char *name)
+{
+    const unsigned char *value;
+    size_t len = 0;
+
+    value = pcdom_element_get_attribute(element,
+            (const unsigned char *)name, strlen(name), &len);
+    if (value == NULL)
+        return purc_variant_make_string_static("", false);
+
+    return purc_variant_make_string_ex((const char *)value, len, false);
+}
+
+purc_variant_t dom_mirror_get_property(struct dom_mirror *mirror,
+        const char *element_type, const char *element_value,
+        const char *property)
+{
+    pcdom_element_t *element;
+
+    if (mirror->parsing || element_type == NULL)
+        return PURC_VARIANT_INVALID;
+
+    /* let the page report the elements not found */
+    element = find_element(mirror, element_type, element_value);
+    if (element == NULL)
+        return PURC_VARIANT_INVALID;
+
+    if (strcmp(property, "textContent") == 0) {
+        pcdom_node_t *node = pcdom_interface_node(element);
+        purc_variant_t v;
+        unsigned char *text;
+        size_t len = 0;
+
+        text = pcdom_node_text_content(node, &len);
+        if (text == NULL)
+            return purc_variant_make_string_static("", false);
+
+        v = purc_variant_make_string_ex((const char *)text, len, false);
+        pcdom_document_destroy_text(node->owner_document, text);
+        return v;
+    }
+    else if (strcmp(property, "id") == 0) {
+        return make_attribute_value(element, "id");
+    }
+    else if (strcmp(property, "className") == 0) {
+        return make_attribute_value(element, "class");
+    }
+    else if (strcmp(property, "localName") == 0) {
+        const unsigned char *name;
+        size_t len = 0;
+
+        name = pcdom_element_local_name(element, &len);
+        if (name)
+            return purc_variant_make_string_ex((const char *)name, len, false);
+    }
+
+    return PURC_VARIANT_INVALID;
+}
@@ -0,0 +1,78 @@
+/*
+** dom-mirror.h -- The module interface for the DOM mirror of a page.
+**
+** Copyright (C) 2023 FMSoft (http://www.fmsoft.cn)
+**
+** This file is part of xGUI Pro, an advanced HVML renderer.
+**
+** xGUI Pro is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** xGUI Pro is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef XGUIPRO_LAYOUTER_DOM_MIRROR_H
+#define XGUIPRO_LAYOUTER_DOM_MIRROR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <purc/purc-variant.h>
+
+/*
+ * A DOM mirror is a copy of the document of a page kept in the renderer.
+ * It is parsed from the content loaded or written to the page, and follows
+ * the DOM updates sent to the page, so the properties which can be computed
+ * from the markup (e.g., `textContent`) are answered without a round trip
+ * to the web process. The live properties (e.g., `value` of an input) are
+ * never answered by the mirror.
+ *
+ * The mirror only follows the operations it can apply exactly as `hvml.js`
+ * does; once an operation fails to apply, the caller must drop the mirror.
+ */
+struct dom_mirror;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Create an empty mirror and begin to parse the document. */
+struct dom_mirror *dom_mirror_new(void);
+
+/* Delete the mirror. */
+void dom_mirror_delete(struct dom_mirror *mirror);
+
+/* Parse a chunk of the document; returns false on failure. */
+bool dom_mirror_write(struct dom_mirror *mirror,
+        const char *content, size_t length);
+
+/* End the parsing of the document; returns false on failure. */
+bool dom_mirror_close(struct dom_mirror *mirror);
+
+/* Apply a DOM update operation (append, prepend, insertBefore, insertAfter,
+   displace, update, clear, or erase) to the mirror; the property and
+   the data type are nullable. Returns false if the mirror can not follow
+   the operation. */
+bool dom_mirror_update(struct dom_mirror *mirror, const char *op_name,
+        const char *element_type, const char *element_value,
+        const char *property, const char *data_type,
+        const char *content, size_t length);
+
+/* Get a computable property of an element; returns PURC_VARIANT_INVALID
+   if the mirror can not answer, e.g., the property is a live one. */
+purc_variant_t dom_mirror_get_property(struct dom_mirror *mirror,
+        const char *element_type, const char *element_value,
+        const char *property);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* XGUIPRO_LAYOUTER_DOM_MIRROR_H */
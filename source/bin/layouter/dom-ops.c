@@ -368,14 +368,17 @@ dom_erase_element(pcdom_document_t *dom_doc, pcdom_element_t *element)
     const char *id;
 
     dom_subtract_id_element_map(dom_doc, node);
-    pcdom_node_destroy_deep(node);
 
+    /* the walker skips the element itself; the id belongs to the element,
+       so remove the pair before destroying the element */
     id = get_element_id(element, NULL);
     if (id) {
         if (!sorted_array_remove(dom_doc->user, PTR2U64(id))) {
-            purc_log_warn("Failed to store id/element pair\n");
+            purc_log_warn("Failed to remove id/element pair\n");
         }
     }
+
+    pcdom_node_destroy_deep(node);
 }
 
 void
@@ -441,3 +444,20 @@ dom_remove_element_property(pcdom_document_t *dom_doc, pcdom_element_t *element,
     return retv;
 }
 
+/* The perfect hash table (generated by gperf from layout-tags.gperf)
+   mapping the tag names to the layout tags */
+#include "layouter/layout-tags.inc"
+
+layout_tag_t dom_get_layout_tag(pcdom_element_t *element)
+{
+    const struct layout_tag_entry *entry;
+    const char *name;
+    size_t len;
+
+    name = (const char *)pcdom_element_local_name(element, &len);
+    if (name == NULL)
+        return LAYOUT_TAG_UNKNOWN;
+
+    entry = dom_lookup_layout_tag(name, len);
+    return entry ? entry->tag : LAYOUT_TAG_UNKNOWN;
+}
@@ -31,6 +31,29 @@
 #define NF_UNFOLDED         0x0001
 #define NF_DIRTY            0x0002
 
+/* The tags significant to the layouter; the tags of containers
+   are contiguous */
+typedef enum {
+    LAYOUT_TAG_UNKNOWN = 0,
+    LAYOUT_TAG_ARTICLE,
+    LAYOUT_TAG_BODY,
+    LAYOUT_TAG_FIGURE,
+    LAYOUT_TAG_LI,
+    LAYOUT_TAG_OL,
+    LAYOUT_TAG_SECTION,
+    LAYOUT_TAG_UL,
+    LAYOUT_TAG_ASIDE,
+    LAYOUT_TAG_DIV,
+    LAYOUT_TAG_FOOTER,
+    LAYOUT_TAG_HEADER,
+    LAYOUT_TAG_MAIN,
+    LAYOUT_TAG_MENU,
+    LAYOUT_TAG_NAV,
+
+    LAYOUT_TAG_FIRST_CONTAINER = LAYOUT_TAG_ASIDE,
+    LAYOUT_TAG_LAST_CONTAINER = LAYOUT_TAG_NAV,
+} layout_tag_t;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -72,6 +95,8 @@ bool dom_update_element(pcdom_document_t *dom_doc, pcdom_element_t *element,
 bool dom_remove_element_property(pcdom_document_t *dom_doc,
         pcdom_element_t *element, const char* property);
 
+layout_tag_t dom_get_layout_tag(pcdom_element_t *element);
+
 #ifdef __cplusplus
 }
 #endif
@@ -91,17 +116,13 @@ void *get_element_user_data(pcdom_element_t *element)
 }
 
 static inline bool
-has_tag(pcdom_element_t *element, const char *tag)
+has_tag(pcdom_element_t *element, layout_tag_t tag)
 {
-    size_t len;
-    const char *tag_name;
-
-    tag_name = (const char *)pcdom_element_local_name(element, &len);
-    return strncasecmp(tag, tag_name, strlen(tag)) == 0;
+    return dom_get_layout_tag(element) == tag;
 }
 
 static inline bool
-is_an_element_with_tag(pcdom_node_t *node, const char *tag)
+is_an_element_with_tag(pcdom_node_t *node, layout_tag_t tag)
 {
     if (node && node->type == PCDOM_NODE_TYPE_ELEMENT) {
         return has_tag(pcdom_interface_element(node), tag);
@@ -110,5 +131,12 @@ is_an_element_with_tag(pcdom_node_t *node, const char *tag)
     return false;
 }
 
+static inline bool
+is_layout_tag(layout_tag_t tag)
+{
+    return tag >= LAYOUT_TAG_FIRST_CONTAINER &&
+        tag <= LAYOUT_TAG_LAST_CONTAINER;
+}
+
 #endif /* XGUIPRO_LAYOUTER_DOM_OPS_H */
 
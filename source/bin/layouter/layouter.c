@@ -55,7 +55,7 @@ find_section_ancestor(pcdom_element_t *element)
 
     node = node->parent;
     while (node) {
-        if (is_an_element_with_tag(node, "SECTION"))
+        if (is_an_element_with_tag(node, LAYOUT_TAG_SECTION))
             return pcdom_interface_element(node);
 
         node = node->parent;
@@ -71,7 +71,7 @@ find_section_child(pcdom_element_t *element)
 
     node = node->first_child;
     while (node) {
-        if (is_an_element_with_tag(node, "SECTION"))
+        if (is_an_element_with_tag(node, LAYOUT_TAG_SECTION))
             return pcdom_interface_element(node);
 
         node = node->next;
@@ -87,7 +87,7 @@ find_article_ancestor(pcdom_element_t *element)
 
     node = node->parent;
     while (node) {
-        if (is_an_element_with_tag(node, "ARTICLE"))
+        if (is_an_element_with_tag(node, LAYOUT_TAG_ARTICLE))
             return pcdom_interface_element(node);
 
         node = node->parent;
@@ -181,7 +181,7 @@ static void get_element_name_title(pcdom_element_t *element,
 static void calc_offsets(struct ws_layouter *layouter, pcdom_node_t *node,
         float *off_x, float *off_y)
 {
-    if (is_an_element_with_tag(node, "FIGURE")) {
+    if (is_an_element_with_tag(node, LAYOUT_TAG_FIGURE)) {
         *off_x = *off_y = 0;
         return;
     }
@@ -199,7 +199,7 @@ static void calc_offsets(struct ws_layouter *layouter, pcdom_node_t *node,
             *off_y += box->y;
         }
 
-        if (is_an_element_with_tag(node, "ARTICLE"))
+        if (is_an_element_with_tag(node, LAYOUT_TAG_ARTICLE))
             break;
 
         node = node->parent;
@@ -264,85 +264,51 @@ static void *create_widget_for_element(struct ws_layouter *layouter,
     return widget;
 }
 
-static const char *layout_tags[] = {
-    "ASIDE",
-    "DIV",
-    "FOOTER",
-    "HEADER",
-    "MAIN",
-    "MENU",
-    "NAV",
-};
-
-static bool is_layout_tag(const char *tag)
-{
-    static ssize_t max = sizeof(layout_tags)/sizeof(layout_tags[0]) - 1;
-
-    ssize_t low = 0, high = max, mid;
-    while (low <= high) {
-        int cmp;
-
-        mid = (low + high) / 2;
-        cmp = strcasecmp(tag, layout_tags[mid]);
-        if (cmp == 0) {
-            goto found;
-        }
-        else {
-            if (cmp < 0) {
-                high = mid - 1;
-            }
-            else {
-                low = mid + 1;
-            }
-        }
-    }
-
-    return false;
-
-found:
-    return true;
-}
-
 static ws_widget_type_t get_widget_type_from_element(pcdom_element_t *element)
 {
     ws_widget_type_t type = WS_WIDGET_TYPE_NONE;
+    layout_tag_t tag = dom_get_layout_tag(element);
 
-    size_t len;
-    const char *tag;
-    tag = (const char *)pcdom_element_local_name(element, &len);
-    if (strcasecmp(tag, "FIGURE") == 0) {
+    switch (tag) {
+    case LAYOUT_TAG_FIGURE:
         type = WS_WIDGET_TYPE_PLAINWINDOW;
-    }
-    else if (strcasecmp(tag, "ARTICLE") == 0) {
+        break;
+
+    case LAYOUT_TAG_ARTICLE:
         type = WS_WIDGET_TYPE_TABBEDWINDOW;
-    }
-    else if (is_layout_tag(tag)) {
-        type = WS_WIDGET_TYPE_CONTAINER;
-    }
-    else if (strcasecmp(tag, "OL") == 0) {
+        break;
+
+    case LAYOUT_TAG_OL:
         type = WS_WIDGET_TYPE_PANEDPAGE;
-    }
-    else if (strcasecmp(tag, "UL") == 0) {
+        break;
+
+    case LAYOUT_TAG_UL:
         type = WS_WIDGET_TYPE_TABHOST;
-    }
-    else if (strcasecmp(tag, "LI") == 0) {
+        break;
+
+    case LAYOUT_TAG_LI: {
         pcdom_element_t *parent = pcdom_interface_element(
                 pcdom_interface_node(element)->parent);
 
-        tag = (const char *)pcdom_element_local_name(parent, &len);
-        if (strcasecmp(tag, "OL") == 0) {
+        tag = dom_get_layout_tag(parent);
+        if (tag == LAYOUT_TAG_OL) {
             type = WS_WIDGET_TYPE_PANEDPAGE;
         }
-        else if (strcasecmp(tag, "UL") == 0) {
+        else if (tag == LAYOUT_TAG_UL) {
             type = WS_WIDGET_TYPE_TABBEDPAGE;
         }
         else {
             type = WS_WIDGET_TYPE_NONE;
             purc_log_error("Parent of a LI is not a OL or UL (%s)\n",
-                    tag);
+                    (const char *)pcdom_element_local_name(parent, NULL));
         }
+        break;
     }
-    else {
+
+    default:
+        if (is_layout_tag(tag))
+            type = WS_WIDGET_TYPE_CONTAINER;
+        break;
     }
 
     return type;
@@ -354,7 +320,7 @@ static void *find_container_of_widget(pcdom_element_t *element)
 
     node = node->parent;
     while (node) {
-        if (is_an_element_with_tag(node, "BODY"))
+        if (is_an_element_with_tag(node, LAYOUT_TAG_BODY))
             break;
 
         if (node->user)
@@ -371,11 +337,11 @@ static void *find_window_of_widget(pcdom_element_t *element)
     pcdom_node_t *node = pcdom_interface_node(element);
 
     while (node) {
-        if (is_an_element_with_tag(node, "FIGURE"))
+        if (is_an_element_with_tag(node, LAYOUT_TAG_FIGURE))
             return node->user;
-        else if (is_an_element_with_tag(node, "ARTICLE"))
+        else if (is_an_element_with_tag(node, LAYOUT_TAG_ARTICLE))
             return node->user;
-        else if (is_an_element_with_tag(node, "BODY"))
+        else if (is_an_element_with_tag(node, LAYOUT_TAG_BODY))
             break;
 
         node = node->parent;
@@ -600,7 +566,7 @@ int ws_layouter_add_widget_groups(struct ws_layouter *layouter,
         pcdom_node_t *section;
         section = subtree->first_child->first_child;
 
-        if (is_an_element_with_tag(section, "SECTION")) {
+        if (is_an_element_with_tag(section, LAYOUT_TAG_SECTION)) {
             dom_append_subtree_to_element(doc, body, subtree);
             return PCRDR_SC_OK;
         }
@@ -807,7 +773,7 @@ void *ws_layouter_add_plain_window(struct ws_layouter *layouter,
            a descendant of a `section` element */
         pcdom_element_t *section;
 
-        if (has_tag(element, "SECTION")) {
+        if (has_tag(element, LAYOUT_TAG_SECTION)) {
             section = element;
         }
         else {
@@ -836,7 +802,7 @@ void *ws_layouter_add_plain_window(struct ws_layouter *layouter,
             pcdom_element_t *figure = find_page_element(dom_doc,
                     group_id, window_name);
             assert(figure);
-            assert(has_tag(figure, "FIGURE"));
+            assert(has_tag(figure, LAYOUT_TAG_FIGURE));
 
             /* re-layout the exsiting widgets */
             relayout(layouter, session, section);
@@ -871,7 +837,7 @@ int ws_layouter_remove_plain_window_by_id(struct ws_layouter *layouter,
         find_page_element(dom_doc, group_id, window_name);
 
     /* the element must be a `figure` element */
-    if (element && has_tag(element, "FIGURE")) {
+    if (element && has_tag(element, LAYOUT_TAG_FIGURE)) {
         pcdom_element_t *section = find_section_ancestor(element);
 
         destroy_widget_for_element(layouter, session, element);
@@ -895,7 +861,7 @@ int ws_layouter_remove_plain_window_by_handle(struct ws_layouter *layouter,
         assert(element);
 
         /* the element must be a `figure` element */
-        if (has_tag(element, "FIGURE")) {
+        if (has_tag(element, LAYOUT_TAG_FIGURE)) {
             pcdom_element_t *section = find_section_ancestor(element);
 
             destroy_widget_for_element(layouter, session, element);
@@ -927,22 +893,21 @@ create_widget_walker(pcdom_node_t *node, void *ctxt)
 
     case PCDOM_NODE_TYPE_ELEMENT:
         if (node->user == NULL) {
-            const char *name;
-            size_t len;
+            layout_tag_t tag;
 
             pcdom_element_t *element;
             element = pcdom_interface_element(node);
-            name = (const char *)pcdom_element_local_name(element, &len);
+            tag = dom_get_layout_tag(element);
 
             ws_widget_type_t type = WS_WIDGET_TYPE_NONE;
             struct create_widget_ctxt *my_ctxt = ctxt;
-            if (is_layout_tag(name)) {
+            if (is_layout_tag(tag)) {
                 type = WS_WIDGET_TYPE_CONTAINER;
             }
-            else if (strcasecmp(name, "OL") == 0) {
+            else if (tag == LAYOUT_TAG_OL) {
                 type = WS_WIDGET_TYPE_PANEHOST;
             }
-            else if (strcasecmp(name, "UL") == 0) {
+            else if (tag == LAYOUT_TAG_UL) {
                 type = WS_WIDGET_TYPE_TABHOST;
             }
 
@@ -1007,10 +972,10 @@ void *ws_layouter_add_widget(struct ws_layouter *layouter, void *session,
         ws_widget_type_t widget_type = WS_WIDGET_TYPE_NONE;
 
         /* the element must be a `ol` or `ul` element */
-        if (has_tag(element, "OL")) {
+        if (has_tag(element, LAYOUT_TAG_OL)) {
             widget_type = WS_WIDGET_TYPE_PANEDPAGE;
         }
-        else if (has_tag(element, "UL")) {
+        else if (has_tag(element, LAYOUT_TAG_UL)) {
             widget_type = WS_WIDGET_TYPE_TABBEDPAGE;
         }
 
@@ -1098,7 +1063,7 @@ int ws_layouter_remove_widget_by_id(struct ws_layouter *layouter,
     pcdom_element_t *element = find_page_element(dom_doc, group_id, page_name);
 
     /* the element must be a `li` element */
-    if (element && has_tag(element, "LI")) {
+    if (element && has_tag(element, LAYOUT_TAG_LI)) {
         pcdom_element_t *article = find_article_ancestor(element);
 
         destroy_widget_for_element(layouter, session, element);
@@ -1125,7 +1090,7 @@ int ws_layouter_remove_widget_by_handle(struct ws_layouter *layouter,
         assert(element);
 
         /* the element must be a `LI` element */
-        if (has_tag(element, "LI")) {
+        if (has_tag(element, LAYOUT_TAG_LI)) {
             pcdom_element_t *article = find_article_ancestor(element);
 
             destroy_widget_for_element(layouter, session, element);
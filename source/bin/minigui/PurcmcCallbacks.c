@@ -151,12 +151,35 @@ static inline WebKitWebView *validate_handle(purcmc_session *sess,
 }
 
 
+/* the time (seconds) to wait for the response from the web page */
+#define PENDING_RESPONSE_TIMEOUT    10
+
 struct packed_result {
+    /* the timer for the deadline of the response */
+    struct tw_timer timer;
+    purcmc_session *sess;
+    /* the key in pending_responses */
+    const char *request_id;
+
     void *result_value;
     size_t plain_len;
     char plain[0];
 };
 
+static void finish_response(purcmc_session* sess, const char *request_id,
+        unsigned int ret_code, purc_variant_t ret_data);
+
+static void on_response_timeout(struct tw_timer *timer)
+{
+    struct packed_result *packed;
+    packed = container_of(timer, struct packed_result, timer);
+
+    LOG_WARN("Timeout to wait for the response of request: %s\n",
+            packed->request_id);
+    finish_response(packed->sess, packed->request_id,
+            PCRDR_SC_GATEWAY_TIMEOUT, PURC_VARIANT_INVALID);
+}
+
 bool mg_pend_response(purcmc_session* sess, purcmc_page *page,
         const char *operation, const char *request_id, void *result_value,
         const char *plain)
@@ -175,13 +198,23 @@ bool mg_pend_response(purcmc_session* sess, purcmc_page *page,
         size_t plain_len = plain ? strlen(plain) + 1 : 0;
         size_t sz = sizeof(*packed) + plain_len;
         packed = malloc(sz);
+        packed->sess = sess;
         packed->result_value = result_value;
         packed->plain_len = plain_len;
         if (plain_len > 0) {
             memcpy(packed->plain, plain, plain_len);
         }
 
-        kvlist_set(&sess->pending_responses, request_id, &packed);
+        packed->request_id = kvlist_set_ex(&sess->pending_responses,
+                request_id, &packed);
+        if (packed->request_id == NULL) {
+            free(packed);
+            return false;
+        }
+
+        tw_timer_init(&packed->timer, on_response_timeout);
+        purcmc_rdrsrv_arm_timer(sess->srv, &packed->timer,
+                PENDING_RESPONSE_TIMEOUT);
     }
 
     return true;
@@ -222,28 +255,24 @@ static void finish_response(purcmc_session* sess, const char *request_id,
             purcmc_endpoint_send_response(sess->srv, endpoint, &response);
         }
 
+        tw_timer_del(&packed->timer);
         free(packed);
         kvlist_delete(&sess->pending_responses, request_id);
     }
 }
 
+/* The perfect hash table (generated by gperf from page-states.gperf)
+   mapping the states to the return codes */
+#include "purcmc/page-states.inc"
+
 static int state_string_to_value(const char *state)
 {
     if (state) {
-        if (strcasecmp(state, "Ok") == 0) {
-            return PCRDR_SC_OK;
-        }
-        else if (strcasecmp(state, "NotFound") == 0) {
-            return PCRDR_SC_NOT_FOUND;
-        }
-        else if (strcasecmp(state, "NotImplemented") == 0) {
-            return PCRDR_SC_NOT_IMPLEMENTED;
-        }
-        else if (strcasecmp(state, "PartialContent") == 0) {
-            return PCRDR_SC_PARTIAL_CONTENT;
-        }
-        else if (strcasecmp(state, "BadRequest") == 0) {
-            return PCRDR_SC_BAD_REQUEST;
+        const struct page_state_entry *entry;
+
+        entry = purcmc_lookup_page_state(state, strlen(state));
+        if (entry) {
+            return entry->ret_code;
         }
         else {
             LOG_WARN("Unknown state: %s", state);
@@ -300,6 +329,16 @@ user_message_received_callback(WebKitWebView *webview,
             const char *str = g_variant_get_string(param, &len);
             handle_response_from_webpage(sess, str, len);
         }
+        else if (strcmp(type, "a{sv}") == 0) {
+            /* the web extension sends a dictionary since the GTK port
+               switched to the structured messages */
+            const char *request_id = NULL, *state = NULL;
+            g_variant_lookup(param, "requestId", "&s", &request_id);
+            g_variant_lookup(param, "state", "&s", &state);
+            if (request_id && strcmp(request_id, PCRDR_REQUESTID_NORETURN))
+                finish_response(sess, request_id,
+                        state_string_to_value(state), PURC_VARIANT_INVALID);
+        }
         else {
             LOG_ERROR("the parameter of the message is not a string (%s)\n",
                     type);
@@ -482,6 +521,7 @@ int mg_remove_session(purcmc_session *sess)
     kvlist_for_each(&sess->pending_responses, name, data) {
         struct packed_result *packed;
         packed = *(struct packed_result **)data;
+        tw_timer_del(&packed->timer);
         free(packed);
     }
     kvlist_free(&sess->pending_responses);
@@ -119,6 +119,14 @@ static const GOptionEntry commandLineOptions[] =
 #endif
     { "pcmc-maxfrmsize", 0, 0, G_OPTION_ARG_INT, &pcmc_srvcfg.max_frm_size, "The maximum size of a socket frame", "BYTES" },
     { "pcmc-backlog", 0, 0, G_OPTION_ARG_INT, &pcmc_srvcfg.backlog, "The maximum length to which the queue of pending connections.", "NUMBER" },
+    { "pcmc-polling", 0, 0, G_OPTION_ARG_NONE, &pcmc_srvcfg.polling, "Poll the sockets every 10ms instead of dispatching on the socket events", NULL },
+    { "pcmc-maxevents", 0, 0, G_OPTION_ARG_INT, &pcmc_srvcfg.max_events, "The maximum number of socket events got by each wait (default: 64)", "NUMBER" },
+    { "pcmc-timebudget", 0, 0, G_OPTION_ARG_INT, &pcmc_srvcfg.time_budget, "The time budget to drain the sockets in each main loop iteration (default: 2000)", "USECS" },
+    { "pcmc-iothread", 0, 0, G_OPTION_ARG_NONE, &pcmc_srvcfg.iothread, "Handle the I/O of Unix socket clients in a dedicated thread", NULL },
+    { "pcmc-quantum", 0, 0, G_OPTION_ARG_INT, &pcmc_srvcfg.quantum, "The bytes of messages served for an endpoint in each scheduling round (default: 16384)", "BYTES" },
+    { "pcmc-maxops", 0, 0, G_OPTION_ARG_INT, &pcmc_srvcfg.max_ops, "The number of messages served for an endpoint in each scheduling round (default: 4)", "NUMBER" },
+    { "pcmc-appweights", 0, 0, G_OPTION_ARG_STRING, &pcmc_srvcfg.app_weights, "The scheduling weights of apps, e.g. cn.fmsoft.hvml.foo:4,cn.fmsoft.hvml.bar:2 (default weight: 1)", "APP:WEIGHT[,...]" },
+    { "pcmc-bufpool", 0, 0, G_OPTION_ARG_INT, &pcmc_srvcfg.buf_pool_cap, "The max bytes of free packet buffers kept for reuse; a negative value disables it (default: 4194304)", "BYTES" },
 
 #if WEBKIT_CHECK_VERSION(2, 30, 0)
     { "autoplay-policy", 0, 0, G_OPTION_ARG_CALLBACK, parseAutoplayPolicy, "Autoplay policy. Valid options are: allow, allow-without-sound, and deny", NULL },
@@ -629,6 +637,37 @@ static void setDefaultWebsitePolicies(WebKitSettings *webkitSettings)
 }
 #endif
 
+static gboolean purcmcFdCallback(gint fd, GIOCondition condition, gpointer userData)
+{
+    return purcmc_rdrsrv_check((purcmc_server *)userData);
+}
+
+static void attachPurcmcServer(purcmc_server *srv, GMainContext *context)
+{
+    GSource *source;
+    int fd = purcmc_rdrsrv_get_fd(srv);
+
+    if (!pcmc_srvcfg.polling && fd >= 0) {
+        /* dispatch the packets as soon as the sockets get ready */
+        source = g_unix_fd_source_new(fd, G_IO_IN);
+        g_source_set_callback(source,
+                G_SOURCE_FUNC(purcmcFdCallback), srv, NULL);
+        g_source_attach(source, context);
+        g_source_unref(source);
+
+        /* the pings and timeouts are checked when there is no event */
+        source = g_timeout_source_new_seconds(1);
+    }
+    else {
+        source = g_timeout_source_new(10);
+    }
+
+    g_source_set_callback(source,
+            G_SOURCE_FUNC(purcmc_rdrsrv_check), srv, NULL);
+    g_source_attach(source, context);
+    g_source_unref(source);
+}
+
 static void startup(GApplication *application, WebKitSettings *webkitSettings)
 {
     g_object_set_data(G_OBJECT(webkitSettings), KEY_XGUI_APPLICATION, application);
@@ -686,21 +725,14 @@ static void startup(GApplication *application, WebKitSettings *webkitSettings)
 
     xgui_load_window_bg();
 
-    GMainContext *context = g_main_context_default();
-
-    GSource *source;
-    source = g_timeout_source_new(10);
-    g_source_set_callback(source,
-            G_SOURCE_FUNC(purcmc_rdrsrv_check), pcmc_srv, NULL);
-    g_source_attach(source, context);
-    g_source_unref(source);
+    attachPurcmcServer(pcmc_srv, g_main_context_default());
 }
 
 static void shutdown(GApplication *application, WebKitSettings *webkitSettings)
 {
     xgui_unload_window_bg();
 
-    g_source_remove_by_user_data(pcmc_srv);
+    while (g_source_remove_by_user_data(pcmc_srv));
     purcmc_rdrsrv_deinit(pcmc_srv);
 
     WebKitWebsiteDataManager *manager;
@@ -0,0 +1,314 @@
+/*
+** bufpool.c -- The pool of the buffers for the incoming packets.
+**
+** Copyright (C) 2023 FMSoft <http://www.fmsoft.cn>
+**
+** This file is part of xGUI Pro, and advanced HVML renderer.
+**
+** xGUI Pro is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** xGUI Pro is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdalign.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include <purc/purc.h>
+
+#include "bufpool.h"
+
+/* the smallest size class: 64 bytes */
+#define BP_MIN_SHIFT        6
+
+/* the max number of size classes */
+#define BP_MAX_CLASSES      32
+
+/* the class of the buffers larger than the largest class */
+#define BP_CLASS_HUGE       0xFFFF
+
+#define BP_MAGIC            0x42504F4C  /* BPOL */
+
+/* the header of a buffer */
+struct bp_chunk {
+    union {
+        /* the next free buffer in the same class */
+        struct bp_chunk *next;
+        /* the usable size of a huge buffer */
+        size_t size;
+    };
+    unsigned int cls;
+    unsigned int magic;
+} __attribute__((aligned(alignof(max_align_t))));
+
+struct bp_class {
+    struct bp_chunk *free_list;
+    unsigned int nr_free;
+    /* the minimal number of free buffers since the last trimming */
+    unsigned int low_water;
+};
+
+struct BufPool_ {
+    pthread_mutex_t lock;
+
+    size_t cap;
+    unsigned int nr_classes;
+    struct bp_class classes[BP_MAX_CLASSES];
+
+    struct bufpool_stats stats;
+};
+
+static inline size_t class_size(unsigned int cls)
+{
+    return (size_t)1 << (cls + BP_MIN_SHIFT);
+}
+
+static inline size_t usable_size(const struct bp_chunk *chunk)
+{
+    if (chunk->cls == BP_CLASS_HUGE)
+        return chunk->size;
+    return class_size(chunk->cls) - sizeof(struct bp_chunk);
+}
+
+/* Get the class of the buffers holding `size` bytes; BP_CLASS_HUGE
+   if no class fits. */
+static unsigned int size_to_class(const BufPool *pool, size_t size)
+{
+    size_t total = size + sizeof(struct bp_chunk);
+    unsigned int cls = 0;
+
+    while (cls < pool->nr_classes && class_size(cls) < total)
+        cls++;
+
+    return (cls < pool->nr_classes) ? cls : BP_CLASS_HUGE;
+}
+
+static inline struct bp_chunk *buf_to_chunk(void *buf)
+{
+    struct bp_chunk *chunk = (struct bp_chunk *)buf - 1;
+    assert(chunk->magic == BP_MAGIC);
+    return chunk;
+}
+
+BufPool *bufpool_new(size_t cap)
+{
+    BufPool *pool;
+    size_t largest = (size_t)PCRDR_MAX_INMEM_PAYLOAD_SIZE + 1 +
+        sizeof(struct bp_chunk);
+
+    pool = calloc(1, sizeof(*pool));
+    if (pool == NULL)
+        return NULL;
+
+    if (pthread_mutex_init(&pool->lock, NULL)) {
+        free(pool);
+        return NULL;
+    }
+
+    pool->cap = cap;
+    while (pool->nr_classes < BP_MAX_CLASSES &&
+            class_size(pool->nr_classes) < largest)
+        pool->nr_classes++;
+    if (pool->nr_classes < BP_MAX_CLASSES)
+        pool->nr_classes++;
+
+    return pool;
+}
+
+static size_t release_free_buffers(BufPool *pool, struct bp_class *bpc,
+        unsigned int cls, unsigned int nr)
+{
+    size_t released = 0;
+
+    while (nr > 0 && bpc->free_list) {
+        struct bp_chunk *chunk = bpc->free_list;
+
+        bpc->free_list = chunk->next;
+        bpc->nr_free--;
+        free(chunk);
+
+        released += class_size(cls);
+        nr--;
+    }
+
+    pool->stats.sz_cached -= released;
+    if (bpc->low_water > bpc->nr_free)
+        bpc->low_water = bpc->nr_free;
+    return released;
+}
+
+void bufpool_delete(BufPool *pool)
+{
+    unsigned int cls;
+
+    if (pool->stats.sz_in_use) {
+        purc_log_warn("Buffers (%zu bytes) still in use when deleting pool\n",
+                pool->stats.sz_in_use);
+    }
+
+    for (cls = 0; cls < pool->nr_classes; cls++) {
+        struct bp_class *bpc = pool->classes + cls;
+        release_free_buffers(pool, bpc, cls, bpc->nr_free);
+    }
+
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+static inline void account_in_use(BufPool *pool, size_t size)
+{
+    pool->stats.sz_in_use += size;
+    if (pool->stats.sz_in_use > pool->stats.peak_sz_in_use)
+        pool->stats.peak_sz_in_use = pool->stats.sz_in_use;
+}
+
+void *bufpool_alloc(BufPool *pool, size_t size)
+{
+    struct bp_chunk *chunk = NULL;
+    unsigned int cls = size_to_class(pool, size);
+    size_t sz_chunk;
+
+    if (cls == BP_CLASS_HUGE) {
+        sz_chunk = size + sizeof(struct bp_chunk);
+        if (sz_chunk < size)
+            return NULL;
+    }
+    else {
+        sz_chunk = class_size(cls);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stats.nr_allocs++;
+    if (cls != BP_CLASS_HUGE && pool->classes[cls].free_list) {
+        struct bp_class *bpc = pool->classes + cls;
+
+        chunk = bpc->free_list;
+        bpc->free_list = chunk->next;
+        bpc->nr_free--;
+        if (bpc->low_water > bpc->nr_free)
+            bpc->low_water = bpc->nr_free;
+
+        pool->stats.nr_hits++;
+        pool->stats.sz_cached -= sz_chunk;
+    }
+    account_in_use(pool, sz_chunk);
+    pthread_mutex_unlock(&pool->lock);
+
+    if (chunk == NULL && (chunk = malloc(sz_chunk)) == NULL) {
+        pthread_mutex_lock(&pool->lock);
+        pool->stats.sz_in_use -= sz_chunk;
+        pthread_mutex_unlock(&pool->lock);
+        return NULL;
+    }
+
+    chunk->cls = cls;
+    chunk->magic = BP_MAGIC;
+    if (cls == BP_CLASS_HUGE)
+        chunk->size = size;
+
+    return chunk + 1;
+}
+
+void *bufpool_realloc(BufPool *pool, void *buf, size_t size)
+{
+    struct bp_chunk *chunk;
+    size_t old_size;
+    void *new_buf;
+
+    if (buf == NULL)
+        return bufpool_alloc(pool, size);
+
+    chunk = buf_to_chunk(buf);
+    old_size = usable_size(chunk);
+    if (size <= old_size)
+        return buf;
+
+    new_buf = bufpool_alloc(pool, size);
+    if (new_buf == NULL)
+        return NULL;
+
+    memcpy(new_buf, buf, (size < old_size) ? size : old_size);
+    bufpool_free(pool, buf);
+    return new_buf;
+}
+
+void bufpool_free(BufPool *pool, void *buf)
+{
+    struct bp_chunk *chunk;
+    size_t sz_chunk;
+
+    if (buf == NULL)
+        return;
+
+    chunk = buf_to_chunk(buf);
+    chunk->magic = 0;
+    if (chunk->cls == BP_CLASS_HUGE)
+        sz_chunk = chunk->size + sizeof(struct bp_chunk);
+    else
+        sz_chunk = class_size(chunk->cls);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stats.nr_frees++;
+    pool->stats.sz_in_use -= sz_chunk;
+    if (chunk->cls != BP_CLASS_HUGE &&
+            pool->stats.sz_cached + sz_chunk <= pool->cap) {
+        struct bp_class *bpc = pool->classes + chunk->cls;
+
+        chunk->next = bpc->free_list;
+        bpc->free_list = chunk;
+        bpc->nr_free++;
+
+        pool->stats.sz_cached += sz_chunk;
+        if (pool->stats.sz_cached > pool->stats.peak_sz_cached)
+            pool->stats.peak_sz_cached = pool->stats.sz_cached;
+        chunk = NULL;
+    }
+    else {
+        pool->stats.nr_drops++;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    free(chunk);
+}
+
+size_t bufpool_trim(BufPool *pool)
+{
+    size_t released = 0;
+    unsigned int cls;
+
+    pthread_mutex_lock(&pool->lock);
+    for (cls = 0; cls < pool->nr_classes; cls++) {
+        struct bp_class *bpc = pool->classes + cls;
+        unsigned int nr_idle = bpc->low_water;
+
+        /* the buffers never taken since the last trimming are idle */
+        if (nr_idle > 0) {
+            released += release_free_buffers(pool, bpc, cls, nr_idle);
+            pool->stats.nr_trimmed += nr_idle;
+        }
+
+        bpc->low_water = bpc->nr_free;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return released;
+}
+
+void bufpool_get_stats(BufPool *pool, struct bufpool_stats *stats)
+{
+    pthread_mutex_lock(&pool->lock);
+    *stats = pool->stats;
+    pthread_mutex_unlock(&pool->lock);
+}
+
@@ -0,0 +1,91 @@
+/**
+ ** bufpool.h: The pool of the buffers for the incoming packets.
+ **
+ ** Copyright (C) 2023 FMSoft <http://www.fmsoft.cn>
+ **
+ ** This file is part of xGUI Pro, and advanced HVML renderer.
+ **
+ ** xGUI Pro is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** xGUI Pro is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see http://www.gnu.org/licenses/.
+ */
+
+#ifndef XGUIPRO_PURCMC_BUFPOOL_H
+#define XGUIPRO_PURCMC_BUFPOOL_H
+
+#include <stddef.h>
+
+/*
+ * The buffer pool is shared by the Unix socket server and the WebSocket
+ * server. The buffers are grouped in size classes of power of two, from
+ * 64 bytes to the one which can hold PCRDR_MAX_INMEM_PAYLOAD_SIZE bytes.
+ *
+ * A freed buffer is kept in the free list of its class as long as the total
+ * size of the cached buffers does not exceed the cap of the pool. The
+ * buffers not used during a whole trimming interval are released by
+ * bufpool_trim(), so the pool shrinks after a burst.
+ *
+ * The pool is thread-safe: the buffers may be allocated by the I/O thread
+ * and freed by the main thread.
+ */
+
+/* the default cap of the size of the cached buffers: 4 MiB */
+#define BUFPOOL_DEF_CAP     (1024 * 1024 * 4)
+
+typedef struct BufPool_ BufPool;
+
+struct bufpool_stats {
+    /* the number of allocations */
+    unsigned long nr_allocs;
+    /* the number of allocations served by the cached buffers */
+    unsigned long nr_hits;
+    /* the number of buffers freed */
+    unsigned long nr_frees;
+    /* the number of freed buffers released due to the cap */
+    unsigned long nr_drops;
+    /* the number of idle buffers released by trimming */
+    unsigned long nr_trimmed;
+
+    /* the size of the buffers in use, and the peak */
+    size_t sz_in_use;
+    size_t peak_sz_in_use;
+    /* the size of the cached buffers, and the peak */
+    size_t sz_cached;
+    size_t peak_sz_cached;
+};
+
+/* Create a buffer pool caching at most `cap` bytes of free buffers. */
+BufPool *bufpool_new(size_t cap);
+
+/* Release all cached buffers and destroy the pool. The buffers in use
+   must have been freed. */
+void bufpool_delete(BufPool *pool);
+
+/* Allocate a buffer which can hold `size` bytes; the content is
+   not initialized. */
+void *bufpool_alloc(BufPool *pool, size_t size);
+
+/* Resize a buffer; the content (up to the smaller size) is kept.
+   The buffer is not touched on failure. */
+void *bufpool_realloc(BufPool *pool, void *buf, size_t size);
+
+/* Free a buffer allocated by bufpool_alloc() or bufpool_realloc();
+   nullable. */
+void bufpool_free(BufPool *pool, void *buf);
+
+/* Release the buffers idle since the last call; returns the bytes released. */
+size_t bufpool_trim(BufPool *pool);
+
+/* Get a snapshot of the statistics of the pool. */
+void bufpool_get_stats(BufPool *pool, struct bufpool_stats *stats);
+
+#endif /* XGUIPRO_PURCMC_BUFPOOL_H */
+
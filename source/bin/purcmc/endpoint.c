@@ -45,6 +45,30 @@ const char *purcmc_endpoint_runner_name(purcmc_endpoint *endpoint)
     return endpoint->runner_name;
 }
 
+void purcmc_endpoint_get_queue_stats(purcmc_endpoint *endpoint,
+        struct purcmc_queue_stats *stats)
+{
+    stats->depth = endpoint->qstats.depth;
+    stats->max_depth = endpoint->qstats.max_depth;
+    stats->nr_served = endpoint->qstats.nr_served;
+    stats->avg_wait = endpoint->qstats.nr_served ?
+        endpoint->qstats.total_wait / endpoint->qstats.nr_served : 0;
+    stats->max_wait = endpoint->qstats.max_wait;
+}
+
+static void log_queue_stats(purcmc_endpoint *endpoint, const char *name)
+{
+    struct purcmc_queue_stats stats;
+
+    purcmc_endpoint_get_queue_stats(endpoint, &stats);
+    purc_log_info ("Inbound queue of %s: %u queued, %lu served, "
+            "max depth %u, wait time %llu us in average, %llu us at most\n",
+            name, stats.depth, stats.nr_served, stats.max_depth,
+            (unsigned long long)stats.avg_wait,
+            (unsigned long long)stats.max_wait);
+    endpoint->qstats.nr_served_logged = stats.nr_served;
+}
+
 purcmc_endpoint *purcmc_endpoint_from_name(purcmc_server *srv,
         const char *endpoint_name)
 {
@@ -56,27 +80,72 @@ purcmc_endpoint *purcmc_endpoint_from_name(purcmc_server *srv,
     return *(purcmc_endpoint **)data;
 }
 
+/* The buffer growing as the message is serialized */
+struct msg_writer {
+    char   *buf;
+    size_t  len;
+    size_t  size;
+    bool    too_large;
+};
+
+static ssize_t write_to_msg_writer(void *ctxt, const void *buf, size_t count)
+{
+    struct msg_writer *writer = ctxt;
+
+    if (writer->len + count > writer->size) {
+        size_t size = writer->size ? writer->size : PCRDR_DEF_PACKET_BUFF_SIZE;
+        char *new_buf;
+
+        while (size < writer->len + count)
+            size *= 2;
+
+        /* the peer will refuse a packet larger than this */
+        if (size > PCRDR_MAX_INMEM_PAYLOAD_SIZE) {
+            size = PCRDR_MAX_INMEM_PAYLOAD_SIZE;
+            if (writer->len + count > size) {
+                writer->too_large = true;
+                return -1;
+            }
+        }
+
+        new_buf = realloc(writer->buf, size);
+        if (new_buf == NULL)
+            return -1;
+
+        writer->buf = new_buf;
+        writer->size = size;
+    }
+
+    memcpy(writer->buf + writer->len, buf, count);
+    writer->len += count;
+    return count;
+}
+
 static int do_send_message(purcmc_server *srv,
         purcmc_endpoint *endpoint, const pcrdr_msg *msg)
 {
-    int retv = PCRDR_SC_OK;
-    size_t n;
-    char buff[PCRDR_DEF_PACKET_BUFF_SIZE];
+    struct msg_writer writer = { };
 
     if (endpoint->status == ES_CLOSING)
         return PCRDR_SC_NOT_READY;
 
-    n = pcrdr_serialize_message_to_buffer(msg, buff, sizeof(buff));
-    if (n > sizeof(buff)) {
-        purc_log_error("The size of buffer for the message is too small.\n");
-        retv = PCRDR_SC_INTERNAL_SERVER_ERROR;
+    /* serialize the message (the JSON data incrementally) to a buffer
+       which is handed over to the transport without copying */
+    if (pcrdr_serialize_message(msg, write_to_msg_writer, &writer) ||
+            writer.len == 0) {
+        purc_log_error("Failed to serialize the message (%zu bytes).\n",
+                writer.len);
+        free(writer.buf);
+        return writer.too_large ?
+            PCRDR_SC_PACKET_TOO_LARGE : PCRDR_SC_INTERNAL_SERVER_ERROR;
     }
-    else if (send_packet_to_endpoint(srv, endpoint, buff, n)) {
+
+    if (send_owned_packet_to_endpoint(srv, endpoint, writer.buf, writer.len)) {
         endpoint->status = ES_CLOSING;
-        retv = PCRDR_SC_IOERR;
+        return PCRDR_SC_IOERR;
     }
 
-    return retv;
+    return PCRDR_SC_OK;
 }
 
 int purcmc_endpoint_send_response(purcmc_server* srv,
@@ -146,7 +215,10 @@ purcmc_endpoint* new_endpoint(purcmc_server* srv, int type, void* client)
     clock_gettime (CLOCK_MONOTONIC, &ts);
     endpoint->t_created = ts.tv_sec;
     endpoint->t_living = ts.tv_sec;
-    endpoint->avl.key = NULL;
+    list_head_init(&endpoint->living);
+    list_head_init(&endpoint->queued_msgs);
+    list_head_init(&endpoint->active);
+    tw_timer_init(&endpoint->timer, NULL);
 
     switch (type) {
         case ET_UNIX_SOCKET:
@@ -192,14 +264,19 @@ int del_endpoint(purcmc_server* srv, purcmc_endpoint* endpoint, int cause)
         endpoint->session = NULL;
     }
 
+    tw_timer_del(&endpoint->timer);
+    clear_queued_messages(endpoint);
+
     if (assemble_endpoint_name(endpoint, endpoint_name) > 0) {
-        if (endpoint->avl.key)
-            avl_delete (&srv->living_avl, &endpoint->avl);
+        list_del_init(&endpoint->living);
     }
     else {
         strcpy (endpoint_name, "@endpoint/not/authenticated");
     }
 
+    if (endpoint->qstats.nr_served > 0)
+        log_queue_stats(endpoint, endpoint_name);
+
     if (endpoint->host_name) free (endpoint->host_name);
     if (endpoint->app_name) free (endpoint->app_name);
     if (endpoint->runner_name) free (endpoint->runner_name);
@@ -243,19 +320,14 @@ bool make_endpoint_ready(purcmc_server* srv,
         const char* endpoint_name, purcmc_endpoint* endpoint)
 {
     if (remove_dangling_endpoint(srv, endpoint)) {
+        tw_timer_del(&endpoint->timer);
         if (!kvlist_set(&srv->endpoint_list, endpoint_name, &endpoint)) {
             purc_log_error ("Failed to store the endpoint: %s\n", endpoint_name);
             return false;
         }
 
         endpoint->t_living = purc_get_monotoic_time();
-        endpoint->avl.key = endpoint;
-        if (avl_insert(&srv->living_avl, &endpoint->avl)) {
-            purc_log_error("Failed to insert to the living AVL tree: %s\n",
-                    endpoint_name);
-            assert(0);
-            return false;
-        }
+        list_add_tail(&endpoint->living, &srv->living_endpoints);
         srv->nr_endpoints++;
     }
     else {
@@ -267,6 +339,92 @@ bool make_endpoint_ready(purcmc_server* srv,
     return true;
 }
 
+bool queue_endpoint_message(purcmc_server *srv, purcmc_endpoint *endpoint,
+        pcrdr_msg *msg, size_t size, char *doc, size_t len_doc)
+{
+    struct queued_msg *qm;
+
+    qm = malloc(sizeof(*qm));
+    if (qm == NULL)
+        return false;
+
+    qm->msg = msg;
+    qm->size = size;
+    qm->doc = doc;
+    qm->len_doc = len_doc;
+    clock_gettime(CLOCK_MONOTONIC, &qm->ts);
+    list_add_tail(&qm->list, &endpoint->queued_msgs);
+
+    endpoint->qstats.depth++;
+    if (endpoint->qstats.depth > endpoint->qstats.max_depth)
+        endpoint->qstats.max_depth = endpoint->qstats.depth;
+
+    if (list_empty(&endpoint->active)) {
+        void *data = NULL;
+
+        /* the app name is unknown before authenticated */
+        if (endpoint->app_name)
+            data = kvlist_get(&srv->app_weights, endpoint->app_name);
+        endpoint->weight = data ? (unsigned int)(intptr_t)*(void **)data : 1;
+        endpoint->deficit = 0;
+        list_add_tail(&endpoint->active, &srv->active_endpoints);
+    }
+
+    return true;
+}
+
+pcrdr_msg *dequeue_endpoint_message(purcmc_endpoint *endpoint,
+        size_t *size, char **doc, size_t *len_doc)
+{
+    struct queued_msg *qm;
+    struct timespec ts;
+    pcrdr_msg *msg;
+    uint64_t wait;
+
+    if (list_empty(&endpoint->queued_msgs))
+        return NULL;
+
+    qm = list_first_entry(&endpoint->queued_msgs, struct queued_msg, list);
+    if (qm->size > *size) {
+        /* tell the caller the size of the next message */
+        *size = qm->size;
+        return NULL;
+    }
+
+    list_del(&qm->list);
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    wait = (ts.tv_sec - qm->ts.tv_sec) * 1000000ULL +
+        (ts.tv_nsec - qm->ts.tv_nsec) / 1000;
+
+    endpoint->qstats.depth--;
+    endpoint->qstats.nr_served++;
+    endpoint->qstats.total_wait += wait;
+    if (wait > endpoint->qstats.max_wait)
+        endpoint->qstats.max_wait = wait;
+
+    msg = qm->msg;
+    *size = qm->size;
+    *doc = qm->doc;
+    *len_doc = qm->len_doc;
+    free(qm);
+    return msg;
+}
+
+void clear_queued_messages(purcmc_endpoint *endpoint)
+{
+    struct queued_msg *qm, *tmp;
+
+    list_for_each_entry_safe(qm, tmp, &endpoint->queued_msgs, list) {
+        list_del(&qm->list);
+        pcrdr_release_message(qm->msg);
+        us_release_document(qm->doc, qm->len_doc);
+        free(qm);
+    }
+
+    endpoint->qstats.depth = 0;
+    list_del_init(&endpoint->active);
+}
+
 static void cleanup_endpoint_client(purcmc_server *srv, purcmc_endpoint* endpoint)
 {
     if (endpoint->type == ET_UNIX_SOCKET) {
@@ -282,6 +440,22 @@ static void cleanup_endpoint_client(purcmc_server *srv, purcmc_endpoint* endpoin
             endpoint->host_name, endpoint->app_name, endpoint->runner_name);
 }
 
+void log_endpoint_queue_stats(purcmc_server *srv)
+{
+    purcmc_endpoint *endpoint;
+
+    list_for_each_entry(endpoint, &srv->living_endpoints, living) {
+        char name [PURC_LEN_ENDPOINT_NAME + 1];
+
+        /* only the endpoints served since the last time */
+        if (endpoint->qstats.nr_served == endpoint->qstats.nr_served_logged)
+            continue;
+
+        assemble_endpoint_name(endpoint, name);
+        log_queue_stats(endpoint, name);
+    }
+}
+
 int check_no_responding_endpoints(purcmc_server *srv)
 {
     int n = 0;
@@ -290,7 +464,7 @@ int check_no_responding_endpoints(purcmc_server *srv)
 
     purc_log_info("Checking no responding endpoints...\n");
 
-    avl_for_each_element_safe(&srv->living_avl, endpoint, avl, tmp) {
+    list_for_each_entry_safe(endpoint, tmp, &srv->living_endpoints, living) {
         char name [PURC_LEN_ENDPOINT_NAME + 1];
 
         assert (endpoint->type != ET_BUILTIN);
@@ -327,27 +501,16 @@ int check_no_responding_endpoints(purcmc_server *srv)
     return n;
 }
 
-int check_dangling_endpoints(purcmc_server *srv)
+bool expire_dangling_endpoint(purcmc_server *srv, purcmc_endpoint* endpoint)
 {
-    int n = 0;
-    time_t t_curr = purc_get_monotoic_time();
-    gs_list* node = srv->dangling_endpoints;
-
-    while (node) {
-        gs_list *next = node->next;
-        purcmc_endpoint* endpoint = (purcmc_endpoint *)node->data;
-
-        if (t_curr > endpoint->t_created + PCRDR_MAX_NO_RESPONDING_TIME) {
-            gslist_remove_node(&srv->dangling_endpoints, node);
-            cleanup_endpoint_client(srv, endpoint);
-            del_endpoint(srv, endpoint, CDE_NO_RESPONDING);
-            n++;
-        }
-
-        node = next;
+    if (remove_dangling_endpoint(srv, endpoint)) {
+        purc_log_info("A dangling endpoint expired: %p\n", endpoint);
+        cleanup_endpoint_client(srv, endpoint);
+        del_endpoint(srv, endpoint, CDE_NO_RESPONDING);
+        return true;
     }
 
-    return n;
+    return false;
 }
 
 int send_initial_response(purcmc_server* srv, purcmc_endpoint* endpoint)
@@ -1755,6 +1918,132 @@ static int on_update(purcmc_server* srv, purcmc_endpoint* endpoint,
             PCRDR_OPERATION_UPDATE);
 }
 
+/* The operations allowed in a batch */
+static const char *batch_operations[] = {
+    PCRDR_OPERATION_APPEND,
+    PCRDR_OPERATION_PREPEND,
+    PCRDR_OPERATION_INSERTAFTER,
+    PCRDR_OPERATION_INSERTBEFORE,
+    PCRDR_OPERATION_DISPLACE,
+    PCRDR_OPERATION_UPDATE,
+    PCRDR_OPERATION_CLEAR,
+    PCRDR_OPERATION_ERASE,
+};
+
+#define NR_BATCH_OPERATIONS \
+    (sizeof(batch_operations)/sizeof(batch_operations[0]))
+
+static bool is_valid_batch_operation(purc_variant_t op)
+{
+    purc_variant_t tmp;
+    const char *operation;
+    size_t i;
+
+    if (!purc_variant_is_object(op))
+        return false;
+
+    tmp = purc_variant_object_get_by_ckey(op, "operation");
+    if (tmp == PURC_VARIANT_INVALID ||
+            (operation = purc_variant_get_string_const(tmp)) == NULL)
+        return false;
+
+    for (i = 0; i < NR_BATCH_OPERATIONS; i++) {
+        if (strcmp(operation, batch_operations[i]) == 0)
+            break;
+    }
+    if (i == NR_BATCH_OPERATIONS)
+        return false;
+
+    tmp = purc_variant_object_get_by_ckey(op, "elementType");
+    if (tmp == PURC_VARIANT_INVALID || !purc_variant_is_string(tmp))
+        return false;
+
+    tmp = purc_variant_object_get_by_ckey(op, "element");
+    if (tmp == PURC_VARIANT_INVALID || !purc_variant_is_string(tmp))
+        return false;
+
+    tmp = purc_variant_object_get_by_ckey(op, "property");
+    if (tmp != PURC_VARIANT_INVALID && !purc_variant_is_string(tmp))
+        return false;
+
+    if (strcmp(operation, PCRDR_OPERATION_CLEAR) &&
+            strcmp(operation, PCRDR_OPERATION_ERASE)) {
+        tmp = purc_variant_object_get_by_ckey(op, "dataType");
+        if (tmp == PURC_VARIANT_INVALID || !purc_variant_is_string(tmp))
+            return false;
+
+        tmp = purc_variant_object_get_by_ckey(op, "data");
+        if (tmp == PURC_VARIANT_INVALID || !purc_variant_is_string(tmp))
+            return false;
+    }
+
+    return true;
+}
+
+static int on_batch(purcmc_server* srv, purcmc_endpoint* endpoint,
+        const pcrdr_msg *msg)
+{
+    int retv;
+    purcmc_udom *dom = NULL;
+    pcrdr_msg response = { };
+
+    if (srv->cbs.update_dom_batch == NULL) {
+        retv = PCRDR_SC_NOT_IMPLEMENTED;
+        goto done;
+    }
+
+    if (msg->target == PCRDR_MSG_TARGET_DOM) {
+        dom = (purcmc_udom *)(uintptr_t)msg->targetValue;
+    }
+    else {
+        retv = PCRDR_SC_BAD_REQUEST;
+        goto done;
+    }
+
+    if (dom == NULL) {
+        retv = PCRDR_SC_NOT_FOUND;
+        goto done;
+    }
+
+    size_t nr_ops = 0;
+    if (msg->dataType != PCRDR_MSG_DATA_TYPE_JSON ||
+            !purc_variant_is_array(msg->data) ||
+            !purc_variant_array_size(msg->data, &nr_ops) ||
+            nr_ops == 0 || nr_ops > PURCMC_MAX_BATCH_OPERATIONS) {
+        retv = PCRDR_SC_BAD_REQUEST;
+        goto done;
+    }
+
+    for (size_t i = 0; i < nr_ops; i++) {
+        if (!is_valid_batch_operation(purc_variant_array_get(msg->data, i))) {
+            retv = PCRDR_SC_BAD_REQUEST;
+            goto done;
+        }
+    }
+
+    const char *request_id = purc_variant_get_string_const(msg->requestId);
+    retv = srv->cbs.update_dom_batch(endpoint->session, dom,
+            request_id, msg->data);
+    if (retv == 0) {
+        // Check if requestId is `noreturn`
+        if (strcmp(request_id, PCRDR_REQUESTID_NORETURN)) {
+            srv->cbs.pend_response(endpoint->session, (purcmc_page *)dom,
+                    purc_variant_get_string_const(msg->operation),
+                    request_id, dom, NULL);
+        }
+        return PCRDR_SC_OK;
+    }
+
+done:
+    response.type = PCRDR_MSG_TYPE_RESPONSE;
+    response.requestId = purc_variant_ref(msg->requestId);
+    response.sourceURI = PURC_VARIANT_INVALID;
+    response.retCode = retv;
+    response.resultValue = (uint64_t)(uintptr_t)dom;
+    response.dataType = PCRDR_MSG_DATA_TYPE_VOID;
+    return purcmc_endpoint_send_response(srv, endpoint, &response);
+}
+
 static int on_call_method(purcmc_server* srv, purcmc_endpoint* endpoint,
         const pcrdr_msg *msg)
 {
@@ -2069,89 +2358,79 @@ failed:
     return purcmc_endpoint_send_response(srv, endpoint, &response);
 }
 
-static struct request_handler {
-    const char *operation;
-    request_handler handler;
-} handlers[] = {
-    { PCRDR_OPERATION_ADDPAGEGROUPS, on_add_page_groups },
-    { PCRDR_OPERATION_APPEND, on_append },
-    { PCRDR_OPERATION_CALLMETHOD, on_call_method },
-    { PCRDR_OPERATION_CLEAR, on_clear },
-    { PCRDR_OPERATION_CREATEPLAINWINDOW, on_create_plain_window },
-    { PCRDR_OPERATION_CREATEWIDGET, on_create_widget },
-    { PCRDR_OPERATION_CREATEWORKSPACE, on_create_workspace },
-    { PCRDR_OPERATION_DESTROYPLAINWINDOW, on_destroy_plain_window },
-    { PCRDR_OPERATION_DESTROYWIDGET, on_destroy_widget },
-    { PCRDR_OPERATION_DESTROYWORKSPACE, on_destroy_workspace },
-    { PCRDR_OPERATION_DISPLACE, on_displace },
-    { PCRDR_OPERATION_ENDSESSION, on_end_session },
-    { PCRDR_OPERATION_ERASE, on_erase },
-    { PCRDR_OPERATION_GETPROPERTY, on_get_property },
-    { PCRDR_OPERATION_INSERTAFTER, on_insert_after },
-    { PCRDR_OPERATION_INSERTBEFORE, on_insert_before },
-    { PCRDR_OPERATION_LOAD, on_load },
-    { PCRDR_OPERATION_PREPEND, on_prepend },
-    { PCRDR_OPERATION_REGISTER, on_register },
-    { PCRDR_OPERATION_REMOVEPAGEGROUP, on_remove_page_group },
-    { PCRDR_OPERATION_REVOKE, on_revoke },
-    { PCRDR_OPERATION_SETPAGEGROUPS, on_set_page_groups },
-    { PCRDR_OPERATION_SETPROPERTY, on_set_property },
-    { PCRDR_OPERATION_STARTSESSION, on_start_session },
-    { PCRDR_OPERATION_UPDATE, on_update },
-    { PCRDR_OPERATION_UPDATEPLAINWINDOW, on_update_plain_window },
-    { PCRDR_OPERATION_UPDATEWIDGET, on_update_widget },
-    { PCRDR_OPERATION_UPDATEWORKSPACE, on_update_workspace },
-    { PCRDR_OPERATION_WRITEBEGIN, on_write_begin },
-    { PCRDR_OPERATION_WRITEEND, on_write_end },
-    { PCRDR_OPERATION_WRITEMORE, on_write_more },
+/* The handlers indexed by the operation identifiers */
+static request_handler handlers[] = {
+    [PCRDR_K_OPERATION_ADDPAGEGROUPS] = on_add_page_groups,
+    [PCRDR_K_OPERATION_APPEND] = on_append,
+    [PCRDR_K_OPERATION_CALLMETHOD] = on_call_method,
+    [PCRDR_K_OPERATION_CLEAR] = on_clear,
+    [PCRDR_K_OPERATION_CREATEPLAINWINDOW] = on_create_plain_window,
+    [PCRDR_K_OPERATION_CREATEWIDGET] = on_create_widget,
+    [PCRDR_K_OPERATION_CREATEWORKSPACE] = on_create_workspace,
+    [PCRDR_K_OPERATION_DESTROYPLAINWINDOW] = on_destroy_plain_window,
+    [PCRDR_K_OPERATION_DESTROYWIDGET] = on_destroy_widget,
+    [PCRDR_K_OPERATION_DESTROYWORKSPACE] = on_destroy_workspace,
+    [PCRDR_K_OPERATION_DISPLACE] = on_displace,
+    [PCRDR_K_OPERATION_ENDSESSION] = on_end_session,
+    [PCRDR_K_OPERATION_ERASE] = on_erase,
+    [PCRDR_K_OPERATION_GETPROPERTY] = on_get_property,
+    [PCRDR_K_OPERATION_INSERTAFTER] = on_insert_after,
+    [PCRDR_K_OPERATION_INSERTBEFORE] = on_insert_before,
+    [PCRDR_K_OPERATION_LOAD] = on_load,
+    [PCRDR_K_OPERATION_PREPEND] = on_prepend,
+    [PCRDR_K_OPERATION_REGISTER] = on_register,
+    [PCRDR_K_OPERATION_REMOVEPAGEGROUP] = on_remove_page_group,
+    [PCRDR_K_OPERATION_REVOKE] = on_revoke,
+    [PCRDR_K_OPERATION_SETPAGEGROUPS] = on_set_page_groups,
+    [PCRDR_K_OPERATION_SETPROPERTY] = on_set_property,
+    [PCRDR_K_OPERATION_STARTSESSION] = on_start_session,
+    [PCRDR_K_OPERATION_UPDATE] = on_update,
+    [PCRDR_K_OPERATION_UPDATEPLAINWINDOW] = on_update_plain_window,
+    [PCRDR_K_OPERATION_UPDATEWIDGET] = on_update_widget,
+    [PCRDR_K_OPERATION_UPDATEWORKSPACE] = on_update_workspace,
+    [PCRDR_K_OPERATION_WRITEBEGIN] = on_write_begin,
+    [PCRDR_K_OPERATION_WRITEEND] = on_write_end,
+    [PCRDR_K_OPERATION_WRITEMORE] = on_write_more,
+    /* the extended operations */
+    [PURCMC_K_OPERATION_BATCH] = on_batch,
 };
 
+/* The perfect hash table (generated by gperf from operations.gperf)
+   mapping the operation names to the identifiers */
+#include "purcmc/operations.inc"
+
 /* Make sure the number of handlers matches the number of operations */
 #define _COMPILE_TIME_ASSERT(name, x)               \
        typedef int _dummy_ ## name[(x) * 2 - 1]
 _COMPILE_TIME_ASSERT(hdl,
-        sizeof(handlers)/sizeof(handlers[0]) == PCRDR_NR_OPERATIONS);
+        sizeof(handlers)/sizeof(handlers[0]) == PURCMC_NR_OPERATIONS);
+_COMPILE_TIME_ASSERT(ops, TOTAL_KEYWORDS == PURCMC_NR_OPERATIONS);
 #undef _COMPILE_TIME_ASSERT
 
 #define NOT_FOUND_HANDLER   ((request_handler)-1)
 
-static request_handler find_request_handler(const char* operation)
+static request_handler find_request_handler(const char* operation, size_t len)
 {
-    static ssize_t max = sizeof(handlers)/sizeof(handlers[0]) - 1;
+    const struct operation_entry *entry;
 
-    ssize_t low = 0, high = max, mid;
-    while (low <= high) {
-        int cmp;
+    entry = purcmc_lookup_operation(operation, len);
+    if (entry == NULL)
+        return NOT_FOUND_HANDLER;
 
-        mid = (low + high) / 2;
-        cmp = strcasecmp(operation, handlers[mid].operation);
-        if (cmp == 0) {
-            goto found;
-        }
-        else {
-            if (cmp < 0) {
-                high = mid - 1;
-            }
-            else {
-                low = mid + 1;
-            }
-        }
-    }
-
-    return NOT_FOUND_HANDLER;
-
-found:
-    return handlers[mid].handler;
+    return handlers[entry->id];
 }
 
 int on_got_message(purcmc_server* srv, purcmc_endpoint* endpoint, const pcrdr_msg *msg)
 {
     if (msg->type == PCRDR_MSG_TYPE_REQUEST) {
-        request_handler handler = find_request_handler(
-                purc_variant_get_string_const(msg->operation));
+        const char *operation;
+        size_t len;
+
+        operation = purc_variant_get_string_const_ex(msg->operation, &len);
+        request_handler handler = find_request_handler(operation, len);
 
         purc_log_info("Got a request message: %s (handler: %p)\n",
-                purc_variant_get_string_const(msg->operation), handler);
+                operation, handler);
 
         if (handler == NOT_FOUND_HANDLER) {
             pcrdr_msg response = { };
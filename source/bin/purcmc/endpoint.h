@@ -50,11 +50,28 @@ bool remove_dangling_endpoint (purcmc_server* srv, purcmc_endpoint* endpoint);
 bool make_endpoint_ready (purcmc_server* srv,
         const char* endpoint_name, purcmc_endpoint* endpoint);
 
+/* the inbound queue of the messages waiting to be served; the document
+   passed in memfd (nullable) is the data of the message, and handed over
+   to the queue */
+bool queue_endpoint_message (purcmc_server *srv, purcmc_endpoint *endpoint,
+        pcrdr_msg *msg, size_t size, char *doc, size_t len_doc);
+/* returns NULL if the queue is empty or the size of the first message
+   exceeds *size; *size returns the size of the first message; the document
+   must be released by us_release_document() after the message released */
+pcrdr_msg *dequeue_endpoint_message (purcmc_endpoint *endpoint, size_t *size,
+        char **doc, size_t *len_doc);
+void clear_queued_messages (purcmc_endpoint *endpoint);
+
 int check_no_responding_endpoints (purcmc_server *srv);
-int check_dangling_endpoints (purcmc_server *srv);
+/* log the statistics of the inbound queues served since the last call */
+void log_endpoint_queue_stats (purcmc_server *srv);
+bool expire_dangling_endpoint (purcmc_server *srv, purcmc_endpoint* endpoint);
 
 int send_packet_to_endpoint (purcmc_server* srv,
         purcmc_endpoint* endpoint, const char* body, int len_body);
+/* the body allocated by malloc is handed over */
+int send_owned_packet_to_endpoint (purcmc_server* srv,
+        purcmc_endpoint* endpoint, char* body, size_t len_body);
 int send_initial_response (purcmc_server* srv, purcmc_endpoint* endpoint);
 int on_got_message(purcmc_server* srv, purcmc_endpoint* endpoint, const pcrdr_msg *msg);
 
@@ -0,0 +1,578 @@
+/*
+** iothread.c -- The dedicated thread for the I/O of Unix socket clients.
+**
+** Copyright (C) 2023 FMSoft <http://www.fmsoft.cn>
+**
+** This file is part of xGUI Pro, and advanced HVML renderer.
+**
+** xGUI Pro is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** xGUI Pro is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/.
+*/
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include <purc/purc.h>
+
+#include "server.h"
+#include "unixsocket.h"
+#include "iothread.h"
+#include "bufpool.h"
+
+#if HAVE(SYS_EPOLL_H)
+
+#include <sys/eventfd.h>
+
+#define PTR_FOR_LISTENER    ((void *)1)
+#define PTR_FOR_WAKEUP      ((void *)2)
+
+/* the max events got by each call to epoll_wait in the I/O thread */
+#define IOT_MAX_EVENTS      64
+
+/* the number of slots of the request ring; must be a power of 2 */
+#define IOT_RING_SIZE       1024
+
+struct IOThread_ {
+    pthread_t   thread;
+    USServer   *us_srv;
+
+    int         epollfd;
+    int         msg_efd;    /* wakes up the main thread */
+    int         req_efd;    /* wakes up the I/O thread */
+
+    /* the callbacks of the Unix socket server replaced by the I/O thread */
+    int (*on_accepted) (void *server, struct SockClient_ *client);
+    int (*on_packet) (void *server, struct SockClient_ *client,
+            char* body, unsigned int sz_body, int type);
+    int (*on_pending) (void *server, struct SockClient_* client);
+    int (*on_close) (void *server, struct SockClient_ *client);
+    int (*watch_rings) (void *server, USRings *rings, int watch);
+
+    /* the MPSC queue for the messages (Vyukov's intrusive queue);
+       the producers push to the head, the consumer pops from the tail. */
+    _Atomic(struct io_message *) msg_head;
+    struct io_message *msg_tail;
+    struct io_message msg_stub;
+
+    /* the SPSC ring for the requests */
+    _Atomic(size_t) req_head;   /* written by the consumer (I/O thread) */
+    _Atomic(size_t) req_tail;   /* written by the producer (main thread) */
+    struct io_request reqs[IOT_RING_SIZE];
+};
+
+/* the I/O thread object of the calling thread */
+static _Thread_local IOThread *current_iothread;
+
+static void
+push_message(IOThread *iot, struct io_message *msg)
+{
+    struct io_message *prev;
+
+    atomic_store_explicit(&msg->next, NULL, memory_order_relaxed);
+    prev = atomic_exchange_explicit(&iot->msg_head, msg, memory_order_acq_rel);
+    atomic_store_explicit(&prev->next, msg, memory_order_release);
+}
+
+struct io_message *
+iothread_take_message(IOThread *iot)
+{
+    struct io_message *tail = iot->msg_tail;
+    struct io_message *next;
+
+    next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    if (tail == &iot->msg_stub) {
+        if (next == NULL)
+            return NULL;
+
+        iot->msg_tail = next;
+        tail = next;
+        next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    }
+
+    if (next) {
+        iot->msg_tail = next;
+        return tail;
+    }
+
+    /* a producer is in the middle of pushing; it will wake us up again */
+    if (tail != atomic_load_explicit(&iot->msg_head, memory_order_acquire))
+        return NULL;
+
+    push_message(iot, &iot->msg_stub);
+    next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    if (next) {
+        iot->msg_tail = next;
+        return tail;
+    }
+
+    return NULL;
+}
+
+void iothread_free_message(IOThread *iot, struct io_message *msg)
+{
+    bufpool_free(iot->us_srv->pool, msg->packet);
+    us_release_document(msg->doc, msg->len_doc);
+    free(msg);
+}
+
+/* Post a message to the main thread; the packet allocated from the buffer
+   pool is handed over. */
+static int
+post_message(IOThread *iot, int type, USClient *usc,
+        char *packet, unsigned int sz_packet, int packet_type)
+{
+    struct io_message *msg;
+    uint64_t one = 1;
+
+    msg = calloc(1, sizeof(*msg));
+    if (msg == NULL) {
+        bufpool_free(iot->us_srv->pool, packet);
+        goto failed;
+    }
+
+    msg->type = type;
+    msg->client = usc;
+    if (packet) {
+        msg->packet = packet;
+        msg->sz_packet = sz_packet;
+        msg->packet_type = packet_type;
+        /* the document passed for the packet goes along with it */
+        msg->doc = us_take_document(usc, &msg->len_doc);
+    }
+
+    push_message(iot, msg);
+    if (write(iot->msg_efd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        purc_log_error("Failed to wake up the main thread: %s\n",
+                strerror(errno));
+    }
+    return 0;
+
+failed:
+    purc_log_error("Failed to allocate memory for I/O message (%d)\n", type);
+    return -1;
+}
+
+static int push_request(IOThread *iot, int type, USClient *usc,
+        USOpcode op, void *data, unsigned int sz)
+{
+    struct io_request *req;
+    size_t tail, head;
+    uint64_t one = 1;
+
+    tail = atomic_load_explicit(&iot->req_tail, memory_order_relaxed);
+    while (1) {
+        head = atomic_load_explicit(&iot->req_head, memory_order_acquire);
+        if (tail - head < IOT_RING_SIZE)
+            break;
+
+        /* the ring is full; let the I/O thread consume some requests */
+        if (write(iot->req_efd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            free(data);
+            return -1;
+        }
+        sched_yield();
+    }
+
+    req = iot->reqs + (tail & (IOT_RING_SIZE - 1));
+    req->type = type;
+    req->op = op;
+    req->client = usc;
+    req->data = data;
+    req->sz_data = data ? sz : 0;
+
+    atomic_store_explicit(&iot->req_tail, tail + 1, memory_order_release);
+    if (write(iot->req_efd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        purc_log_error("Failed to wake up the I/O thread: %s\n",
+                strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+int iothread_post_request(IOThread *iot, int type, USClient *usc,
+        USOpcode op, const void *data, unsigned int sz)
+{
+    void *copied = NULL;
+
+    if (data && sz > 0) {
+        copied = malloc(sz);
+        if (copied == NULL) {
+            purc_log_error("Failed to allocate memory for I/O request\n");
+            return -1;
+        }
+
+        memcpy(copied, data, sz);
+    }
+
+    return push_request(iot, type, usc, op, copied, sz);
+}
+
+int iothread_post_data(IOThread *iot, USClient *usc,
+        USOpcode op, void *data, unsigned int sz)
+{
+    return push_request(iot, IOR_SEND, usc, op, data, sz);
+}
+
+static int
+iot_on_accepted(void *sock_srv, SockClient *client)
+{
+    USServer *us_srv = sock_srv;
+
+    if (post_message(us_srv->iothread, IOM_ACCEPTED, (USClient *)client,
+                NULL, 0, 0))
+        return PCRDR_SC_INSUFFICIENT_STORAGE;
+    return PCRDR_SC_OK;
+}
+
+static int
+iot_on_packet(void *sock_srv, SockClient *client,
+        char *body, unsigned int sz_body, int type)
+{
+    USServer *us_srv = sock_srv;
+    USClient *usc = (USClient *)client;
+
+    /* the packet is parsed in the main thread, because the variants
+       belong to the PurC instance of the main thread; take over the
+       packet buffer instead of copying it */
+    assert(body == usc->packet);
+    usc->packet = NULL;
+    if (post_message(us_srv->iothread, IOM_PACKET, usc, body, sz_body, type))
+        return PCRDR_SC_INSUFFICIENT_STORAGE;
+    return PCRDR_SC_OK;
+}
+
+static int
+iot_on_pending(void *sock_srv, SockClient *client)
+{
+    USServer *us_srv = sock_srv;
+    struct epoll_event ev;
+
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+    ev.data.ptr = client;
+    if (epoll_ctl(us_srv->iothread->epollfd, EPOLL_CTL_MOD,
+                client->fd, &ev) == -1) {
+        purc_log_error("Failed epoll_ctl to the client fd (%d): %s\n",
+                client->fd, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+static int
+iot_on_close(void *sock_srv, SockClient *client)
+{
+    USServer *us_srv = sock_srv;
+
+    /* the fd may be not in the interest list if the client was refused */
+    epoll_ctl(us_srv->iothread->epollfd, EPOLL_CTL_DEL, client->fd, NULL);
+    post_message(us_srv->iothread, IOM_CLOSED, (USClient *)client, NULL, 0, 0);
+
+    /* the client will be freed after the main thread handled IOM_CLOSED */
+    return 1;
+}
+
+static void
+handle_accept(IOThread *iot)
+{
+    struct epoll_event ev;
+    USClient *usc;
+
+    usc = us_handle_accept(iot->us_srv);
+    if (usc == NULL) {
+        purc_log_info("Refused a client\n");
+        return;
+    }
+
+    /* us_handle_reads() reads until EAGAIN */
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = usc;
+    if (epoll_ctl(iot->epollfd, EPOLL_CTL_ADD, usc->fd, &ev) == -1) {
+        purc_log_error("Failed epoll_ctl for connected unix socket (%d): %s\n",
+                usc->fd, strerror(errno));
+        us_cleanup_client(iot->us_srv, usc);
+    }
+}
+
+static void
+handle_client(IOThread *iot, USClient *usc, uint32_t events)
+{
+    /* closed by a previous event or request; waiting for IOR_RELEASE */
+    if (usc->fd < 0)
+        return;
+
+    if (events & EPOLLIN) {
+        time_t t_curr = purc_get_monotoic_time();
+
+        if (usc->t_active != t_curr) {
+            usc->t_active = t_curr;
+            post_message(iot, IOM_ACTIVE, usc, NULL, 0, 0);
+        }
+
+        us_handle_reads(iot->us_srv, usc);
+        if (usc->fd < 0)
+            return;
+
+        /* re-arm the edge-triggered fd for the data left */
+        if (usc->status & US_MORE_DATA)
+            us_rearm_client(iot->epollfd, usc);
+    }
+
+    if (events & EPOLLOUT) {
+        if (us_handle_writes(iot->us_srv, usc) < 0)
+            return;
+
+        if (!(usc->status & US_SENDING) && !(usc->status & US_CLOSE))
+            us_rearm_client(iot->epollfd, usc);
+    }
+}
+
+/* returns true if got the request IOR_QUIT */
+static bool
+handle_requests(IOThread *iot)
+{
+    size_t head, tail;
+    uint64_t counter;
+    bool quit = false;
+
+    if (read(iot->req_efd, &counter, sizeof(counter)) < 0 && errno != EAGAIN) {
+        purc_log_warn("Failed to read the eventfd: %s\n", strerror(errno));
+    }
+
+    head = atomic_load_explicit(&iot->req_head, memory_order_relaxed);
+    tail = atomic_load_explicit(&iot->req_tail, memory_order_acquire);
+    for (; head != tail; head++) {
+        struct io_request *req = iot->reqs + (head & (IOT_RING_SIZE - 1));
+        USClient *usc = req->client;
+
+        switch (req->type) {
+        case IOR_SEND:
+            if (usc->fd >= 0) {
+                if (req->op == US_OPCODE_TEXT || req->op == US_OPCODE_BIN) {
+                    /* the data is handed over to avoid copying it again */
+                    us_send_packet_owned(iot->us_srv, usc, req->op,
+                            req->data, req->sz_data);
+                    req->data = NULL;
+                }
+                else {
+                    us_send_packet(iot->us_srv, usc, req->op,
+                            req->data, req->sz_data);
+                }
+
+                if (usc->status & US_ERR)
+                    us_cleanup_client(iot->us_srv, usc);
+            }
+            break;
+
+        case IOR_PING:
+            if (usc->fd >= 0)
+                us_ping_client(iot->us_srv, usc);
+            break;
+
+        case IOR_CLOSE:
+            if (usc->fd >= 0)
+                us_close_client(iot->us_srv, usc);
+            break;
+
+        case IOR_CLEANUP:
+            /* IOM_CLOSED was posted already if the fd is closed */
+            if (usc->fd >= 0)
+                us_cleanup_client(iot->us_srv, usc);
+            break;
+
+        case IOR_RELEASE:
+            assert(usc->fd < 0);
+            us_remove_dangling_client(iot->us_srv, usc);
+            break;
+
+        case IOR_QUIT:
+            quit = true;
+            break;
+        }
+
+        free(req->data);
+        req->data = NULL;
+    }
+
+    atomic_store_explicit(&iot->req_head, head, memory_order_release);
+    return quit;
+}
+
+static void *
+iothread_main(void *arg)
+{
+    IOThread *iot = arg;
+    struct epoll_event events[IOT_MAX_EVENTS];
+
+    current_iothread = iot;
+    while (1) {
+        int n, nfds;
+
+        nfds = epoll_wait(iot->epollfd, events, IOT_MAX_EVENTS, -1);
+        if (nfds < 0) {
+            if (errno == EINTR)
+                continue;
+
+            purc_log_error("Failed to call epoll_wait in I/O thread: %s\n",
+                    strerror(errno));
+            break;
+        }
+
+        for (n = 0; n < nfds; n++) {
+            if (events[n].data.ptr == PTR_FOR_LISTENER) {
+                handle_accept(iot);
+            }
+            else if (events[n].data.ptr == PTR_FOR_WAKEUP) {
+                if (handle_requests(iot))
+                    goto done;
+            }
+            else {
+                handle_client(iot, events[n].data.ptr, events[n].events);
+            }
+        }
+    }
+
+done:
+    return NULL;
+}
+
+IOThread *iothread_start(USServer *us_srv)
+{
+    IOThread *iot;
+    struct epoll_event ev;
+
+    iot = calloc(1, sizeof(*iot));
+    if (iot == NULL)
+        return NULL;
+
+    iot->us_srv = us_srv;
+    iot->msg_efd = iot->req_efd = -1;
+    atomic_init(&iot->msg_stub.next, NULL);
+    atomic_init(&iot->msg_head, &iot->msg_stub);
+    iot->msg_tail = &iot->msg_stub;
+    atomic_init(&iot->req_head, 0);
+    atomic_init(&iot->req_tail, 0);
+
+    iot->epollfd = epoll_create1(EPOLL_CLOEXEC);
+    if (iot->epollfd == -1) {
+        purc_log_error("Failed to call epoll_create1: %s\n", strerror(errno));
+        goto failed;
+    }
+
+    iot->msg_efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    iot->req_efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (iot->msg_efd < 0 || iot->req_efd < 0) {
+        purc_log_error("Failed to create eventfd: %s\n", strerror(errno));
+        goto failed;
+    }
+
+    ev.events = EPOLLIN;
+    ev.data.ptr = PTR_FOR_LISTENER;
+    if (epoll_ctl(iot->epollfd, EPOLL_CTL_ADD, us_srv->listener, &ev) == -1)
+        goto failed_ctl;
+
+    ev.events = EPOLLIN;
+    ev.data.ptr = PTR_FOR_WAKEUP;
+    if (epoll_ctl(iot->epollfd, EPOLL_CTL_ADD, iot->req_efd, &ev) == -1)
+        goto failed_ctl;
+
+    iot->on_accepted = us_srv->on_accepted;
+    iot->on_packet = us_srv->on_packet;
+    iot->on_pending = us_srv->on_pending;
+    iot->on_close = us_srv->on_close;
+    iot->watch_rings = us_srv->watch_rings;
+
+    us_srv->on_accepted = iot_on_accepted;
+    us_srv->on_packet = iot_on_packet;
+    us_srv->on_pending = iot_on_pending;
+    us_srv->on_close = iot_on_close;
+    /* the rings in shared memory are not supported by the I/O thread */
+    us_srv->watch_rings = NULL;
+    us_srv->iothread = iot;
+
+    if (pthread_create(&iot->thread, NULL, iothread_main, iot)) {
+        purc_log_error("Failed to create the I/O thread\n");
+        goto failed_thread;
+    }
+
+    return iot;
+
+failed_thread:
+    us_srv->on_accepted = iot->on_accepted;
+    us_srv->on_packet = iot->on_packet;
+    us_srv->on_pending = iot->on_pending;
+    us_srv->on_close = iot->on_close;
+    us_srv->watch_rings = iot->watch_rings;
+    us_srv->iothread = NULL;
+    goto failed;
+
+failed_ctl:
+    purc_log_error("Failed to call epoll_ctl in I/O thread: %s\n",
+            strerror(errno));
+
+failed:
+    if (iot->msg_efd >= 0)
+        close(iot->msg_efd);
+    if (iot->req_efd >= 0)
+        close(iot->req_efd);
+    if (iot->epollfd >= 0)
+        close(iot->epollfd);
+    free(iot);
+    return NULL;
+}
+
+void iothread_stop(IOThread *iot)
+{
+    USServer *us_srv = iot->us_srv;
+
+    if (iothread_post_request(iot, IOR_QUIT, NULL, 0, NULL, 0) == 0) {
+        pthread_join(iot->thread, NULL);
+    }
+    else {
+        pthread_cancel(iot->thread);
+        pthread_join(iot->thread, NULL);
+    }
+
+    us_srv->on_accepted = iot->on_accepted;
+    us_srv->on_packet = iot->on_packet;
+    us_srv->on_pending = iot->on_pending;
+    us_srv->on_close = iot->on_close;
+    us_srv->watch_rings = iot->watch_rings;
+    us_srv->iothread = NULL;
+}
+
+void iothread_destroy(IOThread *iot)
+{
+    close(iot->msg_efd);
+    close(iot->req_efd);
+    close(iot->epollfd);
+    free(iot);
+}
+
+bool iothread_is_current(IOThread *iot)
+{
+    return current_iothread == iot;
+}
+
+int iothread_get_fd(IOThread *iot)
+{
+    return iot->msg_efd;
+}
+
+#endif /* HAVE(SYS_EPOLL_H) */
+
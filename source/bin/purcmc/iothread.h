@@ -0,0 +1,128 @@
+/**
+ ** iothread.h: The dedicated thread for the I/O of Unix socket clients.
+ **
+ ** Copyright (C) 2023 FMSoft <http://www.fmsoft.cn>
+ **
+ ** This file is part of xGUI Pro, and advanced HVML renderer.
+ **
+ ** xGUI Pro is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** xGUI Pro is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see http://www.gnu.org/licenses/.
+ */
+
+#ifndef XGUIPRO_PURCMC_IOTHREAD_H
+#define XGUIPRO_PURCMC_IOTHREAD_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#include "unixsocket.h"
+
+/*
+ * When the I/O thread is enabled, it owns the Unix socket listener and
+ * all Unix socket clients: it accepts the connections, reads and reassembles
+ * the frames, and writes the outgoing data. The main thread only handles
+ * the complete packets:
+ *
+ *  - the I/O thread posts the messages to the main thread via a lock-free
+ *    MPSC queue, and wakes up the main thread by an eventfd;
+ *  - the main thread posts the requests to the I/O thread via a lock-free
+ *    SPSC ring, and wakes up the I/O thread by another eventfd.
+ *
+ * Both queues are FIFO, so the order of the messages from or to
+ * an endpoint keeps unchanged.
+ *
+ * A client is never freed by the I/O thread before the main thread
+ * has handled the message IOM_CLOSED of the client and posted
+ * the request IOR_RELEASE for it.
+ */
+
+/* The messages from the I/O thread to the main thread */
+enum {
+    IOM_ACCEPTED = 0,   /* a new client accepted */
+    IOM_ACTIVE,         /* the client got active (at most once per second) */
+    IOM_PACKET,         /* got a packet from the client */
+    IOM_CLOSED,         /* the client closed; waiting for IOR_RELEASE */
+};
+
+struct io_message {
+    _Atomic(struct io_message *) next;
+
+    int         type;
+    int         packet_type;    /* PT_TEXT or PT_BINARY */
+    USClient   *client;
+
+    /* the packet (IOM_PACKET only) */
+    unsigned int sz_packet;
+    char        *packet;
+
+    /* the document passed in memfd for the packet; nullable */
+    size_t      len_doc;
+    char        *doc;
+};
+
+/* The requests from the main thread to the I/O thread */
+enum {
+    IOR_SEND = 0,       /* send a packet to the client */
+    IOR_PING,           /* ping the client */
+    IOR_CLOSE,          /* send a close frame to the client */
+    IOR_CLEANUP,        /* close the connection of the client */
+    IOR_RELEASE,        /* free the closed client */
+    IOR_QUIT,           /* quit the I/O thread */
+};
+
+struct io_request {
+    int         type;
+    USOpcode    op;
+    USClient   *client;
+
+    /* the data to send (IOR_SEND only) */
+    unsigned int sz_data;
+    char        *data;
+};
+
+typedef struct IOThread_ IOThread;
+
+/* Start the I/O thread for the Unix socket server. */
+IOThread *iothread_start(USServer *us_srv);
+
+/* Stop the I/O thread, and restore the callbacks of the Unix socket server.
+   The messages not taken yet keep in the queue. */
+void iothread_stop(IOThread *iot);
+
+/* Free the I/O thread object after all messages were taken. */
+void iothread_destroy(IOThread *iot);
+
+/* Check whether the calling thread is the I/O thread. */
+bool iothread_is_current(IOThread *iot);
+
+/* Get the eventfd which is readable when there are messages for
+   the main thread. */
+int iothread_get_fd(IOThread *iot);
+
+/* Take a message posted by the I/O thread; called in the main thread only. */
+struct io_message *iothread_take_message(IOThread *iot);
+
+/* Free a message taken by iothread_take_message(). */
+void iothread_free_message(IOThread *iot, struct io_message *msg);
+
+/* Post a request to the I/O thread; called in the main thread only.
+   The data (for IOR_SEND) will be copied. */
+int iothread_post_request(IOThread *iot, int type, USClient *usc,
+        USOpcode op, const void *data, unsigned int sz);
+
+/* Post a request IOR_SEND to the I/O thread; called in the main thread only.
+   The data allocated by malloc is handed over to the I/O thread. */
+int iothread_post_data(IOThread *iot, USClient *usc,
+        USOpcode op, void *data, unsigned int sz);
+
+#endif /* XGUIPRO_PURCMC_IOTHREAD_H */
+
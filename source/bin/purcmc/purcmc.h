@@ -25,6 +25,8 @@
 
 #include <purc/purc-pcrdr.h>
 
+#include "utils/timer-wheel.h"
+
 /* The PurcMC Server */
 struct purcmc_server;
 typedef struct purcmc_server purcmc_server;
@@ -49,6 +51,18 @@ typedef struct purcmc_page purcmc_page;
 struct purcmc_udom;
 typedef struct purcmc_udom purcmc_udom;
 
+/* The operations extended by xGUI Pro, following the standard ones */
+enum {
+    /* apply an array of DOM mutations on a page in one round trip */
+    PURCMC_K_OPERATION_BATCH = PCRDR_NR_OPERATIONS,
+};
+
+#define PURCMC_OPERATION_BATCH          "batch"
+#define PURCMC_NR_OPERATIONS            (PURCMC_K_OPERATION_BATCH + 1)
+
+/* the max number of DOM operations in a batch */
+#define PURCMC_MAX_BATCH_OPERATIONS     1024
+
 /* Config Options */
 typedef struct purcmc_server_config {
     const char* app_name;
@@ -65,6 +79,14 @@ typedef struct purcmc_server_config {
     char *sslkey;
     int max_frm_size;
     int backlog;
+    int polling;
+    int max_events;     /* max events got by each call to epoll_wait */
+    int time_budget;    /* the time budget (us) to drain the sockets */
+    int iothread;       /* handle Unix socket I/O in a dedicated thread */
+    int quantum;        /* the bytes served for an endpoint in each round */
+    int max_ops;        /* the messages served for an endpoint in each round */
+    char *app_weights;  /* the scheduling weights: APP:WEIGHT[,APP:WEIGHT] */
+    int buf_pool_cap;   /* the max bytes of free packet buffers cached */
 } purcmc_server_config;
 
 typedef struct purcmc_server_callbacks {
@@ -157,6 +179,12 @@ typedef struct purcmc_server_callbacks {
             const char* property, pcrdr_msg_data_type text_type,
             const char *content, size_t length);
 
+    /* nullable; `ops` is an array of objects having the keys `operation`,
+       `elementType`, `element`, `property`, `dataType`, and `data`,
+       which has been validated by the server */
+    int (*update_dom_batch)(purcmc_session *, purcmc_udom *,
+            const char *request_id, purc_variant_t ops);
+
     /* nullable */
     purc_variant_t (*call_method_in_session)(purcmc_session *,
             pcrdr_msg_target target, uint64_t target_value,
@@ -206,6 +234,16 @@ purcmc_server *purcmc_rdrsrv_init(purcmc_server_config* srvcfg,
 /* Check and dispatch messages from clients */
 bool purcmc_rdrsrv_check(purcmc_server *srv);
 
+/* Return the file descriptor which gets readable when any socket of
+   the server is ready; -1 if the server can only be polled */
+int purcmc_rdrsrv_get_fd(purcmc_server *srv);
+
+/* Arm (or re-arm) a timer expiring after the specified seconds; the timer
+   is fired by purcmc_rdrsrv_check() whatever the I/O load is.
+   Call tw_timer_del() to disarm it. */
+void purcmc_rdrsrv_arm_timer(purcmc_server *srv, struct tw_timer *timer,
+        unsigned int seconds);
+
 /* Deinitialize the PurCMC renderer server */
 int purcmc_rdrsrv_deinit(purcmc_server *srv);
 
@@ -233,6 +271,22 @@ const char *purcmc_endpoint_app_name(purcmc_endpoint *endpoint);
 /* Return the runner name of the specified endpoint */
 const char *purcmc_endpoint_runner_name(purcmc_endpoint *endpoint);
 
+/* The statistics of the inbound queue of an endpoint */
+struct purcmc_queue_stats {
+    /* the current and the maximal number of queued messages */
+    unsigned int    depth;
+    unsigned int    max_depth;
+    /* the number of messages served */
+    unsigned long   nr_served;
+    /* the average and the maximal time (us) the messages waited */
+    uint64_t        avg_wait;
+    uint64_t        max_wait;
+};
+
+/* Get the statistics of the inbound queue of the specified endpoint */
+void purcmc_endpoint_get_queue_stats(purcmc_endpoint *endpoint,
+        struct purcmc_queue_stats *stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -35,13 +35,48 @@
 #include "server.h"
 #include "websocket.h"
 #include "unixsocket.h"
+#include "iothread.h"
+#include "bufpool.h"
 #include "endpoint.h"
 
+#if HAVE(SYS_EPOLL_H)
+#include <sys/eventfd.h>
+#endif
+
 static purcmc_server the_server;
 static purcmc_server_config* the_srvcfg;
 
 #define PTR_FOR_US_LISTENER ((void *)1)
 #define PTR_FOR_WS_LISTENER ((void *)2)
+#define PTR_FOR_IOTHREAD    ((void *)3)
+#define PTR_FOR_SCHEDULER   ((void *)4)
+
+/* the interval to check the no responding endpoints */
+#define HOUSEKEEPING_INTERVAL   10
+
+static void
+on_housekeeping(struct tw_timer *timer)
+{
+    check_no_responding_endpoints(&the_server);
+    log_endpoint_queue_stats(&the_server);
+    bufpool_trim(the_server.buf_pool);
+    timer_wheel_add(&the_server.wheel, timer,
+            timer->expires + HOUSEKEEPING_INTERVAL);
+}
+
+static void
+on_auth_deadline(struct tw_timer *timer)
+{
+    purcmc_endpoint* endpoint = container_of(timer, purcmc_endpoint, timer);
+    expire_dangling_endpoint(&the_server, endpoint);
+}
+
+void purcmc_rdrsrv_arm_timer(purcmc_server *srv, struct tw_timer *timer,
+        unsigned int seconds)
+{
+    timer_wheel_add(&srv->wheel, timer,
+            (uint64_t)purc_get_monotoic_time() + seconds);
+}
 
 /* callbacks for socket servers */
 // Allocate a purcmc_endpoint structure for a new client and send `auth` packet.
@@ -58,48 +93,103 @@ on_accepted(void* sock_srv, SockClient* client)
     if (endpoint == NULL)
         return PCRDR_SC_INSUFFICIENT_STORAGE;
 
+    /* the endpoint will be removed if not authenticated in time */
+    endpoint->timer.cb = on_auth_deadline;
+    timer_wheel_add(&the_server.wheel, &endpoint->timer,
+            endpoint->t_created + PCRDR_MAX_NO_RESPONDING_TIME + 1);
+
     // send initial response
     return send_initial_response(&the_server, endpoint);
 }
 
+/* Use the document passed in memfd as the data of a request without data */
+static bool
+attach_document(pcrdr_msg *msg, const char *doc)
+{
+    if (msg->type != PCRDR_MSG_TYPE_REQUEST ||
+            (msg->dataType != PCRDR_MSG_DATA_TYPE_HTML &&
+             msg->dataType != PCRDR_MSG_DATA_TYPE_PLAIN))
+        return false;
+
+    if (msg->data != PURC_VARIANT_INVALID) {
+        size_t len;
+
+        if (purc_variant_get_string_const_ex(msg->data, &len) == NULL ||
+                len > 0)
+            return false;
+        purc_variant_unref(msg->data);
+    }
+
+    /* the mapping lives until the message is released */
+    msg->data = purc_variant_make_string_static(doc, false);
+    return msg->data != PURC_VARIANT_INVALID;
+}
+
+/* Parse a packet and queue the message; the document passed in memfd
+   (nullable) is handed over. */
 static int
-on_packet(void* sock_srv, SockClient* client,
-            char* body, unsigned int sz_body, int type)
+handle_packet(SockClient* client, char* body, unsigned int sz_body, int type,
+        char *doc, size_t len_doc)
 {
-    assert(client->entity);
+    int ret;
+    pcrdr_msg *msg;
+    purcmc_endpoint *endpoint;
 
-    (void)sock_srv;
-    (void)client;
+    if (type != PT_TEXT) {
+        /* discard all packet in binary */
+        us_release_document(doc, len_doc);
+        return PCRDR_SC_NOT_ACCEPTABLE;
+    }
 
-    if (type == PT_TEXT) {
-        int ret;
-        pcrdr_msg *msg;
-        purcmc_endpoint *endpoint = container_of(client->entity, purcmc_endpoint, entity);
+    endpoint = container_of(client->entity, purcmc_endpoint, entity);
+    if (the_srvcfg->accesslog) {
+        purc_log_info("Got a packet from @%s/%s/%s:\n%s\n",
+                endpoint->host_name, endpoint->app_name,
+                endpoint->runner_name, body);
+    }
 
-        if (the_srvcfg->accesslog) {
-            purc_log_info("Got a packet from @%s/%s/%s:\n%s\n",
-                    endpoint->host_name, endpoint->app_name,
-                    endpoint->runner_name, body);
-        }
+    if ((ret = pcrdr_parse_packet(body, sz_body, &msg))) {
+        purc_log_error("Failed pcrdr_parse_packet: %s\n",
+                purc_get_error_message(ret));
+        us_release_document(doc, len_doc);
+        return PCRDR_SC_UNPROCESSABLE_PACKET;
+    }
 
-        if ((ret = pcrdr_parse_packet(body, sz_body, &msg))) {
-            purc_log_error("Failed pcrdr_parse_packet: %s\n",
-                    purc_get_error_message(ret));
-            return PCRDR_SC_UNPROCESSABLE_PACKET;
-        }
+    if (doc && !attach_document(msg, doc)) {
+        purc_log_warn("Ignored the document (%zu bytes) for a message "
+                "with data\n", len_doc);
+        us_release_document(doc, len_doc);
+        doc = NULL;
+        len_doc = 0;
+    }
 
-        ret = on_got_message(&the_server, endpoint, msg);
+    /* the message will be served by the scheduler */
+    if (!queue_endpoint_message(&the_server, endpoint, msg,
+                sz_body + len_doc, doc, len_doc)) {
         pcrdr_release_message(msg);
-        return ret;
-    }
-    else {
-        /* discard all packet in binary */
-        return PCRDR_SC_NOT_ACCEPTABLE;
+        us_release_document(doc, len_doc);
+        return PCRDR_SC_INSUFFICIENT_STORAGE;
     }
 
     return PCRDR_SC_OK;
 }
 
+static int
+on_packet(void* sock_srv, SockClient* client,
+            char* body, unsigned int sz_body, int type)
+{
+    char *doc = NULL;
+    size_t len_doc = 0;
+
+    assert(client->entity);
+
+    (void)sock_srv;
+    if (client->ct == CT_UNIX_SOCKET)
+        doc = us_take_document((USClient *)client, &len_doc);
+
+    return handle_packet(client, body, sz_body, type, doc, len_doc);
+}
+
 #if !HAVE(SYS_EPOLL_H) && HAVE(SYS_SELECT_H)
 static int
 listen_new_client(int fd, void *ptr, bool rw)
@@ -138,7 +228,13 @@ on_pending(void* sock_srv, SockClient* client)
     struct epoll_event ev;
 
     (void)sock_srv;
+    /* not in our interest list; the I/O thread has been stopped */
+    if (client->ct == CT_UNIX_SOCKET && ((USClient *)client)->detached)
+        return 0;
+
     ev.events = EPOLLIN | EPOLLOUT;
+    if (client->ct == CT_UNIX_SOCKET)
+        ev.events |= EPOLLET;
     ev.data.ptr = client;
     if (epoll_ctl(the_server.epollfd, EPOLL_CTL_MOD, client->fd, &ev) == -1) {
         purc_log_error("Failed epoll_ctl to the client fd (%d): %s\n",
@@ -157,13 +253,62 @@ on_pending(void* sock_srv, SockClient* client)
     return 0;
 }
 
+#if HAVE(SYS_EPOLL_H)
+/* Forget the events of a client (or its rings) being freed, which are
+   in the buffer being dispatched. */
+static void
+forget_ready_events(void *ptr)
+{
+    int n;
+
+    for (n = 0; n < the_server.nr_ready_events; n++) {
+        if (the_server.events[n].data.ptr == ptr)
+            the_server.events[n].data.ptr = NULL;
+    }
+}
+#endif
+
+static int
+watch_rings(void* sock_srv, USRings* rings, int watch)
+{
+#if HAVE(SYS_EPOLL_H)
+    struct epoll_event ev;
+
+    (void)sock_srv;
+    ev.events = EPOLLIN;
+    ev.data.ptr = rings;
+    if (epoll_ctl(the_server.epollfd, watch ? EPOLL_CTL_ADD : EPOLL_CTL_DEL,
+                rings->fd, &ev) == -1) {
+        purc_log_error("Failed epoll_ctl for the eventfd of rings (%d): %s\n",
+                rings->fd, strerror(errno));
+        return -1;
+    }
+
+    if (!watch)
+        forget_ready_events(rings);
+#elif HAVE(SYS_SELECT_H)
+    (void)sock_srv;
+
+    if (watch)
+        return listen_new_client(rings->fd, rings, FALSE);
+    return remove_listening_client(rings->fd);
+#endif
+
+    return 0;
+}
+
 static int
 on_close(void* sock_srv, SockClient* client)
 {
 #if HAVE(SYS_EPOLL_H)
     (void)sock_srv;
 
-    if (epoll_ctl(the_server.epollfd, EPOLL_CTL_DEL, client->fd, NULL) == -1) {
+    forget_ready_events(client);
+
+    if (client->ct == CT_UNIX_SOCKET && ((USClient *)client)->detached) {
+        /* the client was handled by the I/O thread */
+    }
+    else if (epoll_ctl(the_server.epollfd, EPOLL_CTL_DEL, client->fd, NULL) == -1) {
         purc_log_warn("Failed to call epoll_ctl to delete the client fd (%d): %s\n",
                 client->fd, strerror(errno));
     }
@@ -257,16 +402,132 @@ int send_packet_to_endpoint(purcmc_server* srv,
     return -1;
 }
 
+int send_owned_packet_to_endpoint(purcmc_server* srv,
+        purcmc_endpoint* endpoint, char* body, size_t len_body)
+{
+    int ret = -1;
+
+    if (the_srvcfg->accesslog) {
+        purc_log_info("Sending a packet to @%s/%s/%s:\n%.*s\n",
+                endpoint->host_name, endpoint->app_name,
+                endpoint->runner_name, (int)len_body, body);
+    }
+
+    if (endpoint->type == ET_UNIX_SOCKET) {
+        return us_send_packet_owned(srv->us_srv,
+                (USClient *)endpoint->entity.client,
+                US_OPCODE_TEXT, body, len_body);
+    }
+    else if (endpoint->type == ET_WEB_SOCKET) {
+        ret = ws_send_packet(srv->ws_srv, (WSClient *)endpoint->entity.client,
+                WS_OPCODE_TEXT, body, len_body);
+    }
+
+    free(body);
+    return ret;
+}
+
+/* Handle the failure when serving a message like a bad packet. */
+static void
+abort_endpoint(purcmc_endpoint *endpoint, int ret_code)
+{
+    SockClient *client = endpoint->entity.client;
+
+    purc_log_warn("Internal error after served a message: %d\n", ret_code);
+
+    /* the client may be cleaned up asynchronously */
+    clear_queued_messages(endpoint);
+    if (endpoint->type == ET_UNIX_SOCKET) {
+        on_error(the_server.us_srv, client, ret_code);
+        us_cleanup_client(the_server.us_srv, (USClient *)client);
+    }
+    else if (endpoint->type == ET_WEB_SOCKET) {
+        on_error(the_server.ws_srv, client, ret_code);
+        ws_cleanup_client(the_server.ws_srv, (WSClient *)client);
+    }
+}
+
+/* Serve the queued messages of an endpoint within its quantum;
+   returns the number of messages served. */
+static int
+serve_endpoint(purcmc_endpoint *endpoint)
+{
+    size_t quantum = (size_t)the_srvcfg->quantum * endpoint->weight;
+    int max_ops = the_srvcfg->max_ops * endpoint->weight;
+    int n = 0;
+
+    endpoint->deficit += quantum;
+    while (n < max_ops && !list_empty(&endpoint->queued_msgs)) {
+        size_t size = endpoint->deficit;
+        size_t len_doc;
+        pcrdr_msg *msg;
+        char *doc;
+        int ret;
+
+        msg = dequeue_endpoint_message(endpoint, &size, &doc, &len_doc);
+        if (msg == NULL) {
+            /* not enough deficit; wait for the next rounds */
+            break;
+        }
+
+        endpoint->deficit -= size;
+        n++;
+
+        ret = on_got_message(&the_server, endpoint, msg);
+        pcrdr_release_message(msg);
+        us_release_document(doc, len_doc);
+        if (ret != PCRDR_SC_OK) {
+            /* the endpoint may have been deleted */
+            abort_endpoint(endpoint, ret);
+            return n;
+        }
+    }
+
+    if (list_empty(&endpoint->queued_msgs)) {
+        endpoint->deficit = 0;
+        list_del_init(&endpoint->active);
+    }
+    else if (n == max_ops && endpoint->deficit > quantum) {
+        /* do not accumulate the deficit when limited by operations */
+        endpoint->deficit = quantum;
+    }
+
+    return n;
+}
+
+/* Serve the active endpoints in one round of deficit round-robin. */
+static int
+serve_one_round(void)
+{
+    struct list_head *last = the_server.active_endpoints.prev;
+    int n = 0;
+
+    while (!list_empty(&the_server.active_endpoints)) {
+        purcmc_endpoint *endpoint = list_first_entry(
+                &the_server.active_endpoints, purcmc_endpoint, active);
+        bool is_last = (&endpoint->active == last);
+
+        list_move_tail(&endpoint->active, &the_server.active_endpoints);
+        n += serve_endpoint(endpoint);
+        if (is_last)
+            break;
+    }
+
+    the_server.stats.nr_rounds++;
+    return n;
+}
+
 static inline void
 update_endpoint_living_time(purcmc_server *srv, purcmc_endpoint* endpoint)
 {
-    if (endpoint && endpoint->avl.key) {
+    if (endpoint && !list_empty(&endpoint->living)) {
         time_t t_curr = purc_get_monotoic_time();
 
+        /* the time is monotonic, so moving the endpoint to the tail
+           keeps the list sorted by living time. */
         if (endpoint->t_living != t_curr) {
             endpoint->t_living = t_curr;
-            avl_delete(&srv->living_avl, &endpoint->avl);
-            avl_insert(&srv->living_avl, &endpoint->avl);
+            list_move_tail(&endpoint->living, &srv->living_endpoints);
         }
     }
 }
@@ -305,8 +566,50 @@ setup_signal_pipe(void)
     return 0;
 }
 
-/* max events for epoll */
-#define MAX_EVENTS          10
+/* default max events for each call to epoll_wait */
+#define DEF_MAX_EVENTS      64
+
+/* default time budget (in microseconds) for each call to purcmc_rdrsrv_check */
+#define DEF_TIME_BUDGET     2000
+
+/* default bytes served for an endpoint in each scheduling round */
+#define DEF_QUANTUM         16384
+
+/* default messages served for an endpoint in each scheduling round */
+#define DEF_MAX_OPS         4
+
+/* the maximal scheduling weight of an app */
+#define MAX_APP_WEIGHT      64
+
+static void
+parse_app_weights(const char *weights)
+{
+    char *dup = strdup(weights);
+    char *item, *saveptr;
+
+    for (item = strtok_r(dup, ",", &saveptr); item;
+            item = strtok_r(NULL, ",", &saveptr)) {
+        char *colon = strrchr(item, ':');
+        long weight = 0;
+        void *data;
+
+        if (colon) {
+            *colon = '\0';
+            weight = strtol(colon + 1, NULL, 10);
+        }
+
+        if (item[0] == '\0' || weight <= 0 || weight > MAX_APP_WEIGHT) {
+            purc_log_warn("Ignored bad weight of app: %s\n", item);
+            continue;
+        }
+
+        data = (void *)(intptr_t)weight;
+        kvlist_set(&the_server.app_weights, item, &data);
+        purc_log_info("Scheduling weight of app %s: %ld\n", item, weight);
+    }
+
+    free(dup);
+}
 
 static int
 prepare_server(void)
@@ -316,7 +619,6 @@ prepare_server(void)
 #endif
     the_server.us_listener = the_server.ws_listener = -1;
     the_server.t_start = purc_get_monotoic_time();
-    the_server.t_elapsed = the_server.t_elapsed_last = 0;
 
     // create unix socket
     if ((the_server.us_listener = us_listen(the_server.us_srv)) < 0) {
@@ -331,6 +633,7 @@ prepare_server(void)
     the_server.us_srv->on_pending = on_pending;
     the_server.us_srv->on_close = on_close;
     the_server.us_srv->on_error = on_error;
+    the_server.us_srv->watch_rings = watch_rings;
 
     // create web socket listener if enabled
     if (the_server.ws_srv) {
@@ -371,14 +674,57 @@ prepare_server(void)
         goto error;
     }
 
+    the_server.events = calloc(the_srvcfg->max_events,
+            sizeof(struct epoll_event));
+    if (the_server.events == NULL) {
+        purc_log_error("Failed to allocate the buffer for epoll events\n");
+        goto error;
+    }
+
+    the_server.sched_efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (the_server.sched_efd < 0) {
+        purc_log_error("Failed to create eventfd for scheduler: %s\n",
+                strerror(errno));
+        goto error;
+    }
+
     ev.events = EPOLLIN;
-    ev.data.ptr = PTR_FOR_US_LISTENER;
-    if (epoll_ctl(the_server.epollfd, EPOLL_CTL_ADD, the_server.us_listener, &ev) == -1) {
-        purc_log_error("Failed to call epoll_ctl with us_listener (%d): %s\n",
-                the_server.us_listener, strerror(errno));
+    ev.data.ptr = PTR_FOR_SCHEDULER;
+    if (epoll_ctl(the_server.epollfd, EPOLL_CTL_ADD,
+                the_server.sched_efd, &ev) == -1) {
+        purc_log_error("Failed to call epoll_ctl with the eventfd of scheduler: %s\n",
+                strerror(errno));
         goto error;
     }
 
+    if (the_srvcfg->iothread) {
+        /* the I/O thread listens on the Unix socket instead */
+        the_server.iothread = iothread_start(the_server.us_srv);
+        if (the_server.iothread == NULL) {
+            purc_log_error("Failed to start the I/O thread\n");
+            goto error;
+        }
+
+        ev.events = EPOLLIN;
+        ev.data.ptr = PTR_FOR_IOTHREAD;
+        if (epoll_ctl(the_server.epollfd, EPOLL_CTL_ADD,
+                    iothread_get_fd(the_server.iothread), &ev) == -1) {
+            purc_log_error("Failed to call epoll_ctl with the eventfd of I/O thread: %s\n",
+                    strerror(errno));
+            goto error;
+        }
+        purc_log_info("Handling Unix socket clients in the I/O thread\n");
+    }
+    else {
+        ev.events = EPOLLIN;
+        ev.data.ptr = PTR_FOR_US_LISTENER;
+        if (epoll_ctl(the_server.epollfd, EPOLL_CTL_ADD, the_server.us_listener, &ev) == -1) {
+            purc_log_error("Failed to call epoll_ctl with us_listener (%d): %s\n",
+                    the_server.us_listener, strerror(errno));
+            goto error;
+        }
+    }
+
     if (the_server.ws_listener >= 0) {
         ev.events = EPOLLIN;
         ev.data.ptr = PTR_FOR_WS_LISTENER;
@@ -402,45 +748,130 @@ error:
 }
 
 #if HAVE(SYS_EPOLL_H)
-bool purcmc_rdrsrv_check(purcmc_server *srv)
+static inline long
+elapsed_usec(const struct timespec *ts_from)
 {
-    int nfds, n;
-    struct epoll_event ev, events[MAX_EVENTS];
+    struct timespec ts_curr;
 
-    (void)srv;
+    clock_gettime(CLOCK_MONOTONIC, &ts_curr);
+    return (ts_curr.tv_sec - ts_from->tv_sec) * 1000000L +
+        (ts_curr.tv_nsec - ts_from->tv_nsec) / 1000L;
+}
 
-again:
-    nfds = epoll_wait(the_server.epollfd, events, MAX_EVENTS, 0);
-    if (nfds < 0) {
-        if (errno == EINTR) {
-            goto again;
+static void
+handle_io_message(struct io_message *msg)
+{
+    USServer *us_srv = the_server.us_srv;
+    SockClient *client = (SockClient *)msg->client;
+    int ret;
+
+    switch (msg->type) {
+    case IOM_ACCEPTED:
+        ret = on_accepted(us_srv, client);
+        if (ret != PCRDR_SC_OK) {
+            purc_log_warn("Internal error after accepted a client: %d\n", ret);
+            on_error(us_srv, client, ret);
+            us_cleanup_client(us_srv, msg->client);
         }
+        break;
 
-        purc_log_error("Failed to call epoll_wait: %s\n", strerror(errno));
-        goto error;
+    case IOM_ACTIVE:
+        if (client->entity) {
+            purcmc_endpoint *endpoint = container_of(client->entity,
+                    purcmc_endpoint, entity);
+            update_endpoint_living_time(&the_server, endpoint);
+        }
+        break;
+
+    case IOM_PACKET:
+        /* the endpoint may have been removed by the main thread */
+        if (client->entity == NULL)
+            break;
+
+        ret = handle_packet(client, msg->packet, msg->sz_packet,
+                msg->packet_type, msg->doc, msg->len_doc);
+        msg->doc = NULL;
+        if (ret != PCRDR_SC_OK) {
+            purc_log_warn("Internal error after got a packet: %d\n", ret);
+            on_error(us_srv, client, ret);
+            us_cleanup_client(us_srv, msg->client);
+        }
+        break;
+
+    case IOM_CLOSED:
+        on_close(us_srv, client);
+        if (us_srv->iothread) {
+            iothread_post_request(the_server.iothread, IOR_RELEASE,
+                    msg->client, US_OPCODE_CLOSE, NULL, 0);
+        }
+        else {
+            /* the I/O thread has been stopped */
+            us_remove_dangling_client(us_srv, msg->client);
+        }
+        break;
     }
-    else if (nfds == 0) {
-        the_server.t_elapsed = purc_get_monotoic_time() - the_server.t_start;
-        if (the_server.t_elapsed != the_server.t_elapsed_last) {
-            if (the_server.t_elapsed % 10 == 0) {
-                check_no_responding_endpoints(&the_server);
-            }
-            else if (the_server.t_elapsed % 5 == 0) {
-                check_dangling_endpoints(&the_server);
-            }
+}
+
+static void
+dispatch_io_messages(const struct timespec *ts_start)
+{
+    int efd = iothread_get_fd(the_server.iothread);
+    struct io_message *msg;
+    uint64_t counter;
+
+    if (read(efd, &counter, sizeof(counter)) < 0 && errno != EAGAIN) {
+        purc_log_warn("Failed to read the eventfd of I/O thread: %s\n",
+                strerror(errno));
+    }
+
+    while ((msg = iothread_take_message(the_server.iothread))) {
+        handle_io_message(msg);
+        iothread_free_message(the_server.iothread, msg);
 
-            the_server.t_elapsed_last = the_server.t_elapsed;
+        if (elapsed_usec(ts_start) >= the_srvcfg->time_budget) {
+            /* make the eventfd readable again for the messages left */
+            counter = 1;
+            if (write(efd, &counter, sizeof(counter)) < 0 && errno != EAGAIN) {
+                purc_log_warn("Failed to write the eventfd of I/O thread: %s\n",
+                        strerror(errno));
+            }
+            break;
         }
     }
+}
+
+static int
+dispatch_events(struct epoll_event *events, int nfds,
+        const struct timespec *ts_start)
+{
+    int n;
+    struct epoll_event ev;
 
     for (n = 0; n < nfds; ++n) {
-        if (events[n].data.ptr == PTR_FOR_US_LISTENER) {
+        if (events[n].data.ptr == NULL) {
+            /* the client was freed when handling the previous events */
+        }
+        else if (events[n].data.ptr == PTR_FOR_IOTHREAD) {
+            dispatch_io_messages(ts_start);
+        }
+        else if (events[n].data.ptr == PTR_FOR_SCHEDULER) {
+            uint64_t counter;
+
+            /* reset it; will be set again if messages are still left */
+            if (read(the_server.sched_efd, &counter, sizeof(counter)) < 0 &&
+                    errno != EAGAIN) {
+                purc_log_warn("Failed to read the eventfd of scheduler: %s\n",
+                        strerror(errno));
+            }
+        }
+        else if (events[n].data.ptr == PTR_FOR_US_LISTENER) {
             USClient * client = us_handle_accept(the_server.us_srv);
             if (client == NULL) {
                 purc_log_info("Refused a client\n");
             }
             else {
-                ev.events = EPOLLIN; /* do not use EPOLLET */
+                /* us_handle_reads() reads until EAGAIN */
+                ev.events = EPOLLIN | EPOLLET;
                 ev.data.ptr = client;
                 if (epoll_ctl(the_server.epollfd,
                             EPOLL_CTL_ADD, client->fd, &ev) == -1) {
@@ -479,24 +910,39 @@ again:
                         update_endpoint_living_time(&the_server, endpoint);
                     }
 
-                    us_handle_reads(the_server.us_srv, usc);
+                    /* the client has been cleaned up on error */
+                    if (us_handle_reads(the_server.us_srv, usc))
+                        continue;
+
+                    /* re-arm the edge-triggered fd for the data left */
+                    if ((usc->status & US_MORE_DATA) &&
+                            us_rearm_client(the_server.epollfd, usc))
+                        goto error;
                 }
 
                 if (events[n].events & EPOLLOUT) {
-                    us_handle_writes(the_server.us_srv, usc);
+                    if (us_handle_writes(the_server.us_srv, usc) < 0)
+                        continue;
 
                     if (!(usc->status & US_SENDING) && !(usc->status & US_CLOSE)) {
-                        ev.events = EPOLLIN;
-                        ev.data.ptr = usc;
-                        if (epoll_ctl(the_server.epollfd,
-                                    EPOLL_CTL_MOD, usc->fd, &ev) == -1) {
-                            purc_log_error("Failed epoll_ctl for unix socket (%d): %s\n",
-                                    usc->fd, strerror(errno));
+                        if (us_rearm_client(the_server.epollfd, usc))
                             goto error;
-                        }
                     }
                 }
             }
+            else if (usc->ct == CT_SHM_RING) {
+                USRings *rings = (USRings *)events[n].data.ptr;
+
+                if (rings->client->entity) {
+                    purcmc_endpoint *endpoint = container_of(
+                            rings->client->entity, purcmc_endpoint, entity);
+                    update_endpoint_living_time(&the_server, endpoint);
+                }
+
+                /* the client has been cleaned up on error */
+                if (us_handle_ring_reads(the_server.us_srv, rings))
+                    continue;
+            }
             else if (usc->ct == CT_WEB_SOCKET) {
                 WSClient *wsc = (WSClient *)events[n].data.ptr;
 
@@ -533,6 +979,75 @@ again:
         }
     }
 
+    return 0;
+
+error:
+    return -1;
+}
+
+bool purcmc_rdrsrv_check(purcmc_server *srv)
+{
+    int nfds;
+    struct timespec ts_start;
+
+    (void)srv;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts_start);
+    the_server.stats.nr_checks++;
+
+    /* keep draining the ready sockets until the time budget runs out */
+    do {
+again:
+        nfds = epoll_wait(the_server.epollfd, the_server.events,
+                the_srvcfg->max_events, 0);
+        if (nfds < 0) {
+            if (errno == EINTR) {
+                goto again;
+            }
+
+            purc_log_error("Failed to call epoll_wait: %s\n", strerror(errno));
+            goto error;
+        }
+
+        the_server.stats.nr_waits++;
+        if (nfds == 0)
+            break;
+
+        the_server.stats.nr_events += nfds;
+        the_server.nr_ready_events = nfds;
+        if (dispatch_events(the_server.events, nfds, &ts_start)) {
+            the_server.nr_ready_events = 0;
+            goto error;
+        }
+        the_server.nr_ready_events = 0;
+
+        /* serve the queued messages between the batches of events */
+        serve_one_round();
+
+        if (elapsed_usec(&ts_start) >= the_srvcfg->time_budget) {
+            /* yield to the main loop; left events will be handled later */
+            the_server.stats.nr_budget_hits++;
+            break;
+        }
+    } while (1);
+
+    while (!list_empty(&the_server.active_endpoints) &&
+            elapsed_usec(&ts_start) < the_srvcfg->time_budget) {
+        serve_one_round();
+    }
+
+    if (!list_empty(&the_server.active_endpoints)) {
+        /* make the epoll fd readable to get called again */
+        uint64_t one = 1;
+        if (write(the_server.sched_efd, &one, sizeof(one)) < 0 &&
+                errno != EAGAIN) {
+            purc_log_warn("Failed to write the eventfd of scheduler: %s\n",
+                    strerror(errno));
+        }
+    }
+
+    /* fire the expired timers even if the sockets keep us busy */
+    timer_wheel_advance(&the_server.wheel, purc_get_monotoic_time());
     return true;
 
 error:
@@ -557,6 +1072,8 @@ bool purcmc_rdrsrv_check(purcmc_server *srv)
     FD_COPY(&the_server.wfdset, &wset);
     wsetptr = &wset;
 
+    the_server.stats.nr_checks++;
+
 again:
     if ((retval = select(the_server.maxfd + 1,
             rsetptr, wsetptr, esetptr, &sel_timeout)) < 0) {
@@ -568,23 +1085,13 @@ again:
         purc_log_error("unexpected error of select(): %m\n");
         goto error;
     }
-    else if (retval == 0) {
-        the_server.t_elapsed = purc_get_monotoic_time() - the_server.t_start;
-        if (the_server.t_elapsed != the_server.t_elapsed_last) {
-            if (the_server.t_elapsed % 10 == 0) {
-                check_no_responding_endpoints(&the_server);
-            }
-            else if (the_server.t_elapsed % 5 == 0) {
-                check_dangling_endpoints(&the_server);
-            }
 
-            the_server.t_elapsed_last = the_server.t_elapsed;
-        }
-    }
-    else {
+    the_server.stats.nr_waits++;
+    if (retval > 0) {
         size_t i, nr_fds = sorted_array_count(the_server.fd2clients);
         int *fds = alloca(sizeof(int) * nr_fds);
 
+        the_server.stats.nr_events += retval;
         for (i = 0; i < nr_fds; i++) {
             fds[i] = (int)sorted_array_get(the_server.fd2clients, i, NULL);
         }
@@ -628,6 +1135,17 @@ again:
 
                         us_handle_reads(the_server.us_srv, usc);
                     }
+                    else if (usc->ct == CT_SHM_RING) {
+                        USRings *rings = (USRings *)cli_node;
+                        if (rings->client->entity) {
+                            purcmc_endpoint *endpoint = container_of(
+                                    rings->client->entity, purcmc_endpoint,
+                                    entity);
+                            update_endpoint_living_time(&the_server, endpoint);
+                        }
+
+                        us_handle_ring_reads(the_server.us_srv, rings);
+                    }
                     else if (usc->ct == CT_WEB_SOCKET) {
                         WSClient *wsc = (WSClient *)cli_node;
                         if (wsc->entity) {
@@ -675,6 +1193,11 @@ again:
         }
     }
 
+    while (!list_empty(&the_server.active_endpoints)) {
+        serve_one_round();
+    }
+
+    timer_wheel_advance(&the_server.wheel, purc_get_monotoic_time());
     return true;
 
 error:
@@ -683,14 +1206,15 @@ error:
 
 #endif /* HAVE(SYS_SELECT_H) */
 
-static int
-comp_living_time(const void *k1, const void *k2, void *ptr)
+int purcmc_rdrsrv_get_fd(purcmc_server *srv)
 {
-    const purcmc_endpoint *e1 = k1;
-    const purcmc_endpoint *e2 = k2;
-
-    (void)ptr;
-    return e1->t_living - e2->t_living;
+#if HAVE(SYS_EPOLL_H)
+    /* the epoll instance is readable when any fd in its interest list is. */
+    return srv->epollfd;
+#else
+    (void)srv;
+    return -1;
+#endif
 }
 
 #if !HAVE(SYS_EPOLL_H) && HAVE(SYS_SELECT_H)
@@ -738,6 +1262,11 @@ init_server(void)
 
     FD_ZERO(&the_server.rfdset);
     FD_ZERO(&the_server.wfdset);
+
+    if (the_srvcfg->iothread) {
+        purc_log_warn("The I/O thread is only supported with epoll\n");
+        the_srvcfg->iothread = 0;
+    }
 #endif
 
     if (the_srvcfg->unixsocket == NULL) {
@@ -760,13 +1289,57 @@ init_server(void)
         the_srvcfg->backlog = SOMAXCONN;
     }
 
+    if (the_srvcfg->max_events <= 0) {
+        the_srvcfg->max_events = DEF_MAX_EVENTS;
+    }
+
+    if (the_srvcfg->time_budget <= 0) {
+        the_srvcfg->time_budget = DEF_TIME_BUDGET;
+    }
+
+    if (the_srvcfg->quantum <= 0) {
+        the_srvcfg->quantum = DEF_QUANTUM;
+    }
+
+    if (the_srvcfg->max_ops <= 0) {
+        the_srvcfg->max_ops = DEF_MAX_OPS;
+    }
+
+    /* a negative value disables caching the free buffers */
+    if (the_srvcfg->buf_pool_cap == 0) {
+        the_srvcfg->buf_pool_cap = BUFPOOL_DEF_CAP;
+    }
+    else if (the_srvcfg->buf_pool_cap < 0) {
+        the_srvcfg->buf_pool_cap = 0;
+    }
+
+    the_server.buf_pool = bufpool_new((size_t)the_srvcfg->buf_pool_cap);
+    if (the_server.buf_pool == NULL) {
+        return PCRDR_ERROR_NOMEM;
+    }
+
+#if HAVE(SYS_EPOLL_H)
+    the_server.sched_efd = -1;
+#endif
+
     the_server.nr_endpoints = 0;
     the_server.running = true;
 
     /* TODO for host name */
     the_server.server_name = strdup(PCRDR_LOCALHOST);
     kvlist_init(&the_server.endpoint_list, NULL);
-    avl_init(&the_server.living_avl, comp_living_time, true, NULL);
+    list_head_init(&the_server.living_endpoints);
+    list_head_init(&the_server.active_endpoints);
+
+    kvlist_init(&the_server.app_weights, NULL);
+    if (the_srvcfg->app_weights) {
+        parse_app_weights(the_srvcfg->app_weights);
+    }
+
+    timer_wheel_init(&the_server.wheel, purc_get_monotoic_time());
+    tw_timer_init(&the_server.housekeeper, on_housekeeping);
+    purcmc_rdrsrv_arm_timer(&the_server, &the_server.housekeeper,
+            HOUSEKEEPING_INTERVAL);
 
     return 0;
 }
@@ -778,11 +1351,33 @@ deinit_server(void)
     void *next, *data;
     purcmc_endpoint *endpoint, *tmp;
 
-#if !HAVE(SYS_EPOLL_H) && HAVE(SYS_SELECT_H)
+#if HAVE(SYS_EPOLL_H)
+    if (the_server.iothread) {
+        struct io_message *msg;
+
+        /* after stopped, the clients are operated in this thread directly */
+        iothread_stop(the_server.iothread);
+        while ((msg = iothread_take_message(the_server.iothread))) {
+            if (msg->type != IOM_PACKET)
+                handle_io_message(msg);
+            iothread_free_message(the_server.iothread, msg);
+        }
+
+        iothread_destroy(the_server.iothread);
+        the_server.iothread = NULL;
+    }
+
+    free(the_server.events);
+    the_server.events = NULL;
+    if (the_server.sched_efd >= 0)
+        close(the_server.sched_efd);
+#elif HAVE(SYS_SELECT_H)
     sorted_array_destroy(the_server.fd2clients);
 #endif
 
-    avl_remove_all_elements(&the_server.living_avl, endpoint, avl, tmp) {
+    list_for_each_entry_safe(endpoint, tmp, &the_server.living_endpoints,
+            living) {
+        list_del_init(&endpoint->living);
         if (endpoint->type == ET_UNIX_SOCKET) {
             us_close_client(the_server.us_srv, (USClient *)endpoint->entity.client);
         }
@@ -819,6 +1414,7 @@ deinit_server(void)
     }
 
     kvlist_free(&the_server.endpoint_list);
+    kvlist_free(&the_server.app_weights);
 
     if (the_server.dangling_endpoints) {
         gs_list* node = the_server.dangling_endpoints;
@@ -848,10 +1444,26 @@ deinit_server(void)
         gslist_remove_nodes(the_server.dangling_endpoints);
     }
 
+    tw_timer_del(&the_server.housekeeper);
+
     us_stop(the_server.us_srv);
     if (the_server.ws_srv)
         ws_stop(the_server.ws_srv);
 
+    if (the_server.buf_pool) {
+        struct bufpool_stats stats;
+
+        bufpool_get_stats(the_server.buf_pool, &stats);
+        purc_log_info("Buffer pool statistics: %lu allocs, %lu hits, "
+                "%lu frees, %lu drops, %lu trimmed, "
+                "peak in use %zu bytes, peak cached %zu bytes\n",
+                stats.nr_allocs, stats.nr_hits, stats.nr_frees,
+                stats.nr_drops, stats.nr_trimmed,
+                stats.peak_sz_in_use, stats.peak_sz_cached);
+        bufpool_delete(the_server.buf_pool);
+        the_server.buf_pool = NULL;
+    }
+
     free(the_server.server_name);
 
     if (the_server.features) {
@@ -859,6 +1471,12 @@ deinit_server(void)
         the_server.features = NULL;
     }
 
+    purc_log_info("Dispatching statistics: %lu checks, %lu waits, "
+            "%lu events, time budget (%dus) hit %lu times, %lu rounds\n",
+            the_server.stats.nr_checks, the_server.stats.nr_waits,
+            the_server.stats.nr_events, the_srvcfg->time_budget,
+            the_server.stats.nr_budget_hits, the_server.stats.nr_rounds);
+
     purc_log_info("the_server.nr_endpoints: %d\n", the_server.nr_endpoints);
     assert(the_server.nr_endpoints == 0);
 
@@ -895,7 +1513,8 @@ purcmc_rdrsrv_init(purcmc_server_config* srvcfg,
     the_srvcfg = srvcfg;
     if (asprintf(&the_server.features, SERVER_FEATURES_FORMAT,
                 markup_langs, nr_workspaces,
-                nr_tabbedwindows, nr_tabbedpages, nr_plainwindows) < 0) {
+                nr_tabbedwindows, nr_tabbedpages, nr_plainwindows,
+                cbs->update_dom_batch ? "/" SERVER_EXT_BATCH : "") < 0) {
         purc_log_error("Error during asprintf: %s\n",
                 strerror(errno));
         goto error;
@@ -916,12 +1535,14 @@ purcmc_rdrsrv_init(purcmc_server_config* srvcfg,
         purc_log_error("Error during us_init\n");
         goto error;
     }
+    the_server.us_srv->pool = the_server.buf_pool;
 
     if (!the_srvcfg->nowebsocket) {
         if ((the_server.ws_srv = ws_init((purcmc_server_config *)the_srvcfg)) == NULL) {
             purc_log_error("Error during ws_init\n");
             goto error;
         }
+        the_server.ws_srv->pool = the_server.buf_pool;
     }
     else {
         the_server.ws_srv = NULL;
@@ -25,6 +25,7 @@
 
 #include <config.h>
 #include <time.h>
+#include <stdint.h>
 
 #include <unistd.h>
 #if HAVE(SYS_EPOLL_H)
@@ -41,16 +42,24 @@
 #include "utils/kvlist.h"
 #include "utils/gslist.h"
 #include "utils/sorted-array.h"
+#include "utils/timer-wheel.h"
 
 #include "purcmc.h"
 
 #define SERVER_APP_NAME     "cn.fmsoft.hvml.renderer"
 #define SERVER_RUNNER_NAME  "purcmc"
 
+/* the extensions to the protocol supported, separated by slash */
+#define SERVER_EXTENSIONS   "unixSocketRing/unixSocketDocument"
+
+/* the extension supported only if the renderer implements update_dom_batch */
+#define SERVER_EXT_BATCH    "batchOperation"
+
 #define SERVER_FEATURES_FORMAT \
     PCRDR_PURCMC_PROTOCOL_NAME ":" PCRDR_PURCMC_PROTOCOL_VERSION_STRING "\n" \
     "%s\n" \
     "workspace:%d/tabbedWindow:%d/widgetInTabbedWindow:%d/plainWindow:%d\n" \
+    "extensions:" SERVER_EXTENSIONS "%s\n" \
 
 /* max clients for each web socket and unix socket */
 #define MAX_CLIENTS_EACH    512
@@ -135,12 +144,57 @@ struct purcmc_endpoint
 
     purcmc_session *session;
 
-    /* AVL node for the AVL tree sorted by living time */
-    struct avl_node avl;
+    /* the timer for the deadline of authentication */
+    struct tw_timer timer;
+
+    /* the list node in the living list, which is sorted by living time */
+    struct list_head living;
+
+    /* the parsed messages waiting to be served */
+    struct list_head queued_msgs;
+
+    /* the list node in the active list of the scheduler */
+    struct list_head active;
+
+    /* the weight of the endpoint (determined by the app name) */
+    unsigned int    weight;
+
+    /* the deficit (in bytes) of deficit round-robin */
+    size_t          deficit;
+
+    /* the statistics of the inbound queue */
+    struct {
+        /* the current and the maximal number of queued messages */
+        unsigned int  depth;
+        unsigned int  max_depth;
+        /* the number of messages served */
+        unsigned long nr_served;
+        /* the total and the maximal time (us) the messages waited */
+        uint64_t      total_wait;
+        uint64_t      max_wait;
+        /* the number of messages served when the stats were logged */
+        unsigned long nr_served_logged;
+    } qstats;
+};
+
+/* A parsed message waiting in the inbound queue of an endpoint */
+struct queued_msg {
+    struct list_head list;
+
+    pcrdr_msg      *msg;
+    /* the size of the packet, charged to the deficit of the endpoint */
+    size_t          size;
+    /* the document passed in memfd as the data of the message; nullable */
+    char           *doc;
+    size_t          len_doc;
+    /* the time queued */
+    struct timespec ts;
 };
 
 struct WSServer_;
 struct USServer_;
+struct IOThread_;
+struct BufPool_;
 
 /* The PurcMC purcmc_server */
 struct purcmc_server
@@ -150,6 +204,12 @@ struct purcmc_server
     int ws_listener;
 #if HAVE(SYS_EPOLL_H)
     int epollfd;
+    /* the buffer for the events returned by epoll_wait */
+    struct epoll_event *events;
+    /* the number of events in the buffer being dispatched */
+    int nr_ready_events;
+    /* the eventfd which is readable when there are messages left to serve */
+    int sched_efd;
 #elif HAVE(SYS_SELECT_H)
     int maxfd;
     fd_set rfdset, wfdset;
@@ -160,22 +220,53 @@ struct purcmc_server
     bool running;
 
     time_t t_start;
-    time_t t_elapsed;
-    time_t t_elapsed_last;
+
+    /* the timer wheel for housekeeping, ticking in seconds */
+    struct timer_wheel wheel;
+
+    /* the timer to check the no responding endpoints periodically */
+    struct tw_timer housekeeper;
+
+    /* the statistics of dispatching */
+    struct {
+        /* the number of calls to purcmc_rdrsrv_check */
+        unsigned long nr_checks;
+        /* the number of calls to epoll_wait or select */
+        unsigned long nr_waits;
+        /* the number of socket events handled */
+        unsigned long nr_events;
+        /* the number of times the time budget ran out */
+        unsigned long nr_budget_hits;
+        /* the number of scheduling rounds */
+        unsigned long nr_rounds;
+    } stats;
 
     char* server_name;
 
     struct WSServer_ *ws_srv;
     struct USServer_ *us_srv;
 
+    /* the dedicated I/O thread for Unix socket clients; nullable */
+    struct IOThread_ *iothread;
+
+    /* the pool of the buffers for the incoming packets */
+    struct BufPool_ *buf_pool;
+
     /* The KV list using endpoint name as the key, and purcmc_endpoint* as the value */
     struct kvlist endpoint_list;
 
     /* The accepted endpoints but waiting for authentification */
     gs_list *dangling_endpoints;
 
-    /* the AVL tree of endpoints sorted by living time */
-    struct avl_tree living_avl;
+    /* the endpoints having queued messages, served in round-robin */
+    struct list_head active_endpoints;
+
+    /* the scheduling weights of apps: app name -> weight (as a pointer) */
+    struct kvlist app_weights;
+
+    /* the authenticated endpoints in the order of living time;
+       the least recently living endpoint is the first one. */
+    struct list_head living_endpoints;
 
     /* the user data */
     void *user_data;
@@ -0,0 +1,106 @@
+/*
+** shmring.c -- The rings in shared memory for the local clients.
+**
+** Copyright (C) 2023 FMSoft <http://www.fmsoft.cn>
+**
+** This file is part of xGUI Pro, and advanced HVML renderer.
+**
+** xGUI Pro is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** xGUI Pro is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/.
+*/
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <purc/purc.h>
+
+#include "utils/misc.h"
+#include "shmring.h"
+
+int shm_ring_map(struct shm_ring *ring, int memfd)
+{
+    struct stat st;
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    unsigned int order;
+    void *hdr;
+
+    if (fstat(memfd, &st) || st.st_size <= (off_t)page_size) {
+        purc_log_warn("Bad memfd for shared-memory ring\n");
+        return -1;
+    }
+
+    /* the size must be one page plus a power of two */
+    order = cbuf_order((unsigned int)(st.st_size - page_size));
+    if (order < SHM_RING_MIN_ORDER || order > SHM_RING_MAX_ORDER ||
+            (off_t)(page_size + ((size_t)1 << order)) != st.st_size) {
+        purc_log_warn("Bad size of shared-memory ring: %lld\n",
+                (long long)st.st_size);
+        return -1;
+    }
+
+#ifdef F_GET_SEALS
+    /* a peer shrinking the memfd would crash us with SIGBUS */
+    int seals = fcntl(memfd, F_GET_SEALS);
+    if (seals < 0 || !(seals & F_SEAL_SHRINK)) {
+        purc_log_warn("The memfd of shared-memory ring is not sealed\n");
+        return -1;
+    }
+#endif
+
+    hdr = mmap(NULL, page_size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    if (hdr == MAP_FAILED) {
+        purc_log_warn("Failed to map shared-memory ring: %s\n",
+                strerror(errno));
+        return -1;
+    }
+
+    ring->hdr = hdr;
+    if (ring->hdr->magic != SHM_RING_MAGIC || ring->hdr->order != order) {
+        purc_log_warn("Bad header of shared-memory ring\n");
+        goto failed;
+    }
+
+    ring->data = cbuf_map(memfd, page_size, order);
+    if (ring->data == NULL) {
+        purc_log_warn("Failed to map data of shared-memory ring: %s\n",
+                strerror(errno));
+        goto failed;
+    }
+
+    ring->order = order;
+    ring->size = (size_t)1 << order;
+    return 0;
+
+failed:
+    munmap(hdr, page_size);
+    ring->hdr = NULL;
+    return -1;
+}
+
+void shm_ring_unmap(struct shm_ring *ring)
+{
+    if (ring->data) {
+        cbuf_free(ring->data, ring->order);
+        ring->data = NULL;
+    }
+
+    if (ring->hdr) {
+        munmap(ring->hdr, sysconf(_SC_PAGESIZE));
+        ring->hdr = NULL;
+    }
+}
+
@@ -0,0 +1,120 @@
+/**
+ ** shmring.h: The rings in shared memory for the local clients.
+ **
+ ** Copyright (C) 2023 FMSoft <http://www.fmsoft.cn>
+ **
+ ** This file is part of xGUI Pro, and advanced HVML renderer.
+ **
+ ** xGUI Pro is free software: you can redistribute it and/or modify
+ ** it under the terms of the GNU General Public License as published by
+ ** the Free Software Foundation, either version 3 of the License, or
+ ** (at your option) any later version.
+ **
+ ** xGUI Pro is distributed in the hope that it will be useful,
+ ** but WITHOUT ANY WARRANTY; without even the implied warranty of
+ ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ ** GNU General Public License for more details.
+ ** You should have received a copy of the GNU General Public License
+ ** along with this program.  If not, see http://www.gnu.org/licenses/.
+ */
+
+#ifndef XGUIPRO_PURCMC_SHMRING_H
+#define XGUIPRO_PURCMC_SHMRING_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A ring is a memfd created and sealed (F_SEAL_SHRINK at least) by the
+ * peer. The first page holds the header, and the following 2^order bytes
+ * hold the data, which are mapped twice contiguously (see cbuf_map()),
+ * so a record in the ring never wraps around.
+ *
+ * There is a single producer and a single consumer for each ring:
+ * `head` and `tail` are the total bytes produced and consumed.
+ * A producer short of space sets `need_space`; the consumer clears it
+ * and notifies the producer after it consumed some data.
+ */
+
+#define SHM_RING_MAGIC          0x52524350  /* "PCRR" in little endian */
+#define SHM_RING_MIN_ORDER      16          /* 64 KiB */
+#define SHM_RING_MAX_ORDER      30          /* 1 GiB */
+
+struct shm_ring_header {
+    uint32_t            magic;
+    uint32_t            order;
+    uint8_t             reserved0[56];
+
+    /* written by the producer only */
+    _Atomic uint64_t    head;
+    uint8_t             reserved1[56];
+
+    /* written by the consumer only */
+    _Atomic uint64_t    tail;
+    _Atomic uint32_t    need_space;
+};
+
+struct shm_ring {
+    struct shm_ring_header *hdr;
+    char               *data;
+    size_t              size;
+    unsigned int        order;
+};
+
+/* Map the ring in the memfd; the memfd can be closed after mapped.
+   Returns 0 on success, -1 if the memfd is not a valid ring. */
+int shm_ring_map(struct shm_ring *ring, int memfd);
+
+/* Unmap the ring mapped by shm_ring_map(). */
+void shm_ring_unmap(struct shm_ring *ring);
+
+/* Get the data to consume. The returned size is larger than the size of
+   the ring only if the peer corrupted the header. */
+static inline size_t
+shm_ring_readable(struct shm_ring *ring, char **data)
+{
+    uint64_t head, tail;
+
+    tail = atomic_load_explicit(&ring->hdr->tail, memory_order_relaxed);
+    head = atomic_load_explicit(&ring->hdr->head, memory_order_acquire);
+    *data = ring->data + (tail & (ring->size - 1));
+    return (size_t)(head - tail);
+}
+
+static inline void
+shm_ring_consume(struct shm_ring *ring, size_t n)
+{
+    uint64_t tail;
+
+    tail = atomic_load_explicit(&ring->hdr->tail, memory_order_relaxed);
+    atomic_store_explicit(&ring->hdr->tail, tail + n, memory_order_release);
+}
+
+/* Get the free space to produce; returns 0 if the peer corrupted
+   the header. */
+static inline size_t
+shm_ring_writable(struct shm_ring *ring, char **data)
+{
+    uint64_t head, tail;
+
+    head = atomic_load_explicit(&ring->hdr->head, memory_order_relaxed);
+    tail = atomic_load_explicit(&ring->hdr->tail, memory_order_acquire);
+    if (head - tail > ring->size)
+        return 0;
+
+    *data = ring->data + (head & (ring->size - 1));
+    return ring->size - (size_t)(head - tail);
+}
+
+static inline void
+shm_ring_produce(struct shm_ring *ring, size_t n)
+{
+    uint64_t head;
+
+    head = atomic_load_explicit(&ring->hdr->head, memory_order_relaxed);
+    atomic_store_explicit(&ring->hdr->head, head + n, memory_order_release);
+}
+
+#endif /* XGUIPRO_PURCMC_SHMRING_H */
+
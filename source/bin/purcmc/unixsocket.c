@@ -20,6 +20,7 @@
 ** along with this program.  If not, see http://www.gnu.org/licenses/.
 */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -34,9 +35,22 @@
 #include <sys/fcntl.h>
 #include <sys/un.h>
 #include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
 
 #include "server.h"
 #include "unixsocket.h"
+#include "iothread.h"
+#include "bufpool.h"
+
+/* the size of the receive buffer of a client */
+#define US_RBUF_SIZE        (64 * 1024)
+
+/* the maximal bytes read for a client in each call to us_handle_reads() */
+#define US_MAX_READ_EACH    (1024 * 1024)
+
+/* the maximal number of iovecs passed to each call to writev */
+#define US_MAX_IOVS         64
 
 USServer *us_init (const purcmc_server_config* config)
 {
@@ -49,6 +63,9 @@ USServer *us_init (const purcmc_server_config* config)
 
 void us_stop (USServer * server)
 {
+    purc_log_info ("Sent %lu packets via Unix socket with %lu write calls\n",
+            server->nr_packets_sent, server->nr_write_calls);
+
     /* remove the socket file */
     unlink (server->config->unixsocket);
 
@@ -176,6 +193,33 @@ error:
     return -1;
 }
 
+/*
+ * Check whether the call should be forwarded to the I/O thread:
+ * the clients are only operated in the I/O thread if it is enabled.
+ */
+static inline bool us_forward_to_iothread (USServer *server)
+{
+#if HAVE(SYS_EPOLL_H)
+    return server->iothread && !iothread_is_current (server->iothread);
+#else
+    (void)server;
+    return false;
+#endif
+}
+
+/* The upper entity belongs to the main thread, so do not update it
+ * if the client is handled by the I/O thread. */
+static inline void us_update_entity_stats (USClient *usc)
+{
+    size_t sz_pending = usc->sz_pending;
+
+    if (usc->rings)
+        sz_pending += usc->rings->sz_pending;
+
+    if (!usc->detached)
+        update_upper_entity_stats (usc->entity, sz_pending, usc->sz_packet);
+}
+
 /* Set the given file descriptor as NON BLOCKING. */
 inline static int
 set_nonblocking (int sock)
@@ -221,6 +265,7 @@ us_handle_accept (USServer* server)
     usc->fd = newfd;
     usc->pid = pid;
     usc->uid = uid;
+    usc->detached = (server->iothread != NULL);
     server->nr_clients++;
 
     if (server->nr_clients > MAX_CLIENTS_EACH) {
@@ -254,6 +299,16 @@ failed:
     return NULL;
 }
 
+/*
+ * Free a pending data and the buffer owned by it.
+ */
+static inline void us_free_pending_data (USPendingData *pending)
+{
+    if (pending->owned)
+        free (pending->owned);
+    free (pending);
+}
+
 /*
  * Clear pending data.
  */
@@ -263,37 +318,49 @@ static void us_clear_pending_data (USClient *client)
 
     list_for_each_safe (p, n, &client->pending) {
         list_del (p);
-        free (p);
+        us_free_pending_data ((USPendingData *)p);
     }
 
     client->sz_pending = 0;
 
-    update_upper_entity_stats (client->entity, client->sz_pending, client->sz_packet);
+    us_update_entity_stats (client);
 }
 
 /*
- * Queue new data.
+ * Queue new data. If the data is in the buffer `owned`, the data will be
+ * referenced instead of copied; the buffer will be freed with the pending
+ * data if `last_ref` is true.
  *
  * On success, true is returned.
  * On error, false is returned and the connection status is set.
  */
-static bool us_queue_data (USClient *client, const char *buf, size_t len)
+static bool us_queue_data (USClient *client, const char *buf, size_t len,
+        void *owned, bool last_ref)
 {
     USPendingData *pending_data;
 
-    if ((pending_data = malloc (sizeof (USPendingData) + len)) == NULL) {
+    if ((pending_data = malloc (sizeof (USPendingData) +
+                    (owned ? 0 : len))) == NULL) {
         us_clear_pending_data (client);
         client->status = US_ERR | US_CLOSE;
         return false;
     }
 
-    memcpy (pending_data->data, buf, len);
+    if (owned) {
+        pending_data->ptr = (unsigned char *)buf;
+        pending_data->owned = last_ref ? owned : NULL;
+    }
+    else {
+        memcpy (pending_data->data, buf, len);
+        pending_data->ptr = pending_data->data;
+        pending_data->owned = NULL;
+    }
     pending_data->szdata = len;
     pending_data->szsent = 0;
 
     list_add_tail (&pending_data->list, &client->pending);
     client->sz_pending += len;
-    update_upper_entity_stats (client->entity, client->sz_pending, client->sz_packet);
+    us_update_entity_stats (client);
     client->status |= US_SENDING;
 
     /* client probably is too slow, so stop queueing until everything is
@@ -305,83 +372,179 @@ static bool us_queue_data (USClient *client, const char *buf, size_t len)
 }
 
 /*
- * Send the given buffer to the given socket.
+ * Send the queued up client's data to the given socket; the pending
+ * data are gathered by writev.
  *
  * On error, -1 is returned and the connection status is set.
  * On success, the number of bytes sent is returned.
  */
-static ssize_t us_write_data (USServer *server, USClient *client,
-        const char *buffer, size_t len)
+static ssize_t us_write_pending (USServer *server, USClient *client)
 {
-    ssize_t bytes = 0;
+    ssize_t total_bytes = 0;
 
-    bytes = write (client->fd, buffer, len);
-    if (bytes == -1 && errno == EPIPE) {
-        client->status = US_ERR | US_CLOSE;
-        return -1;
-    }
+    while (!list_empty (&client->pending)) {
+        struct iovec iov[US_MAX_IOVS];
+        struct list_head *p, *n;
+        int iovcnt = 0;
+        ssize_t bytes;
+
+        list_for_each (p, &client->pending) {
+            USPendingData *pending = (USPendingData *)p;
+
+            iov[iovcnt].iov_base = pending->ptr + pending->szsent;
+            iov[iovcnt].iov_len = pending->szdata - pending->szsent;
+            if (++iovcnt == US_MAX_IOVS)
+                break;
+        }
+
+        bytes = writev (client->fd, iov, iovcnt);
+        server->nr_write_calls++;
+        if (bytes == -1) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+
+            client->status = US_ERR | US_CLOSE;
+            return -1;
+        }
+
+        total_bytes += bytes;
+        client->sz_pending -= bytes;
+
+        list_for_each_safe (p, n, &client->pending) {
+            USPendingData *pending = (USPendingData *)p;
+            size_t left = pending->szdata - pending->szsent;
+
+            if ((size_t)bytes < left) {
+                pending->szsent += bytes;
+                break;
+            }
 
-    /* did not send all of it... buffer it for a later attempt */
-    if ((bytes > 0 && (size_t)bytes < len) ||
-            (bytes == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))) {
-        us_queue_data (client, buffer + bytes, len - bytes);
+            bytes -= left;
+            list_del (p);
+            us_free_pending_data (pending);
+            if (bytes == 0)
+                break;
+        }
 
-        if (client->status & US_SENDING && server->on_pending)
-            server->on_pending (server, (SockClient *)client);
+        /* sent partially; the socket buffer is full */
+        if (!list_empty (&client->pending) && iovcnt < US_MAX_IOVS)
+            break;
     }
 
-    return bytes;
+    if (client->sz_pending < SOCK_THROTTLE_THLD)
+        client->status &= ~US_THROTTLING;
+    us_update_entity_stats (client);
+    return total_bytes;
 }
 
 /*
- * Send the queued up client's data to the given socket.
+ * Send the given iovecs to the given socket; the data not sent will be
+ * queued. If `owned` is not NULL, it is the buffer (`sz_owned` bytes)
+ * handed over by the caller, which contains some of the data; the buffer
+ * will be referenced by the pending data, and freed after sent.
  *
- * On error, -1 is returned and the connection status is set.
+ * On error, -1 is returned and the connection status is set as error.
  * On success, the number of bytes sent is returned.
  */
-static ssize_t us_write_pending (USServer *server, USClient *client)
+static ssize_t us_writev (USServer *server, USClient *client,
+        struct iovec *iov, int iovcnt, void *owned, size_t sz_owned)
 {
     ssize_t total_bytes = 0;
-    struct list_head *p, *n;
-
-    (void)server;
+    int i = 0, last_ref = -1;
+
+    /* the pending data will be flushed when the socket gets writable;
+       but try to flush them now if the client is throttled */
+    if (!list_empty (&client->pending) && (client->status & US_THROTTLING)) {
+        if (us_write_pending (server, client) < 0 &&
+                (client->status & US_ERR))
+            goto error;
+    }
 
-    list_for_each_safe (p, n, &client->pending) {
+    while (list_empty (&client->pending) && i < iovcnt) {
+        int cnt = iovcnt - i;
         ssize_t bytes;
-        USPendingData *pending = (USPendingData *)p;
 
-        bytes = write (client->fd,
-                pending->data + pending->szsent, pending->szdata - pending->szsent);
+        if (cnt > US_MAX_IOVS)
+            cnt = US_MAX_IOVS;
 
-        if (bytes > 0) {
-            pending->szsent += bytes;
-            if (pending->szsent >= pending->szdata) {
-                list_del (p);
-                free (p);
-            }
-            else {
+        bytes = writev (client->fd, iov + i, cnt);
+        server->nr_write_calls++;
+        if (bytes == -1) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
                 break;
-            }
 
-            total_bytes += bytes;
-            client->sz_pending -= bytes;
-            update_upper_entity_stats (client->entity,
-                    client->sz_pending, client->sz_packet);
-        }
-        else if (bytes == -1 && errno == EPIPE) {
             client->status = US_ERR | US_CLOSE;
-            return -1;
+            goto error;
+        }
+
+        total_bytes += bytes;
+        while (i < iovcnt && (size_t)bytes >= iov[i].iov_len) {
+            bytes -= iov[i].iov_len;
+            i++;
+        }
+
+        if (i < iovcnt && bytes > 0) {
+            /* sent partially; the socket buffer is full */
+            iov[i].iov_base = (char *)iov[i].iov_base + bytes;
+            iov[i].iov_len -= bytes;
+            break;
         }
-        else if (bytes == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+    }
+
+    if (i == iovcnt) {
+        free (owned);
+        return total_bytes;
+    }
+
+    /* find the last iovec referencing the owned buffer */
+    if (owned) {
+        int j;
+        for (j = i; j < iovcnt; j++) {
+            const char *base = iov[j].iov_base;
+            if (iov[j].iov_len > 0 && base >= (const char *)owned &&
+                    base < (const char *)owned + sz_owned)
+                last_ref = j;
+        }
+    }
+
+    for (; i < iovcnt; i++) {
+        const char *base = iov[i].iov_base;
+        bool ref;
+
+        if (iov[i].iov_len == 0)
+            continue;
+
+        ref = owned && base >= (const char *)owned &&
+            base < (const char *)owned + sz_owned;
+        if (!us_queue_data (client, base, iov[i].iov_len,
+                    ref ? owned : NULL, i == last_ref)) {
+            /* not handed over to the pending data yet */
+            if (i <= last_ref)
+                free (owned);
             return -1;
         }
     }
 
+    /* the owned buffer is not referenced by any pending data */
+    if (last_ref < 0)
+        free (owned);
+
+    if (server->on_pending)
+        server->on_pending (server, (SockClient *)client);
+
     return total_bytes;
+
+error:
+    free (owned);
+    return -1;
 }
 
 /*
- * A wrapper of the system call write or send.
+ * A wrapper of us_writev for a single buffer.
  *
  * On error, -1 is returned and the connection status is set as error.
  * On success, the number of bytes sent is returned.
@@ -389,279 +552,897 @@ static ssize_t us_write_pending (USServer *server, USClient *client)
 static ssize_t us_write (USServer *server, USClient *client,
         const void *buffer, size_t len)
 {
-    ssize_t bytes = 0;
+    struct iovec iov;
+
+    iov.iov_base = (void *)buffer;
+    iov.iov_len = len;
+    return us_writev (server, client, &iov, 1, NULL, 0);
+}
+
+/*
+ * Read data from the socket; the file descriptors passed via SCM_RIGHTS
+ * are kept in the client for the frames to come.
+ */
+static ssize_t us_recv (USClient *usc, void *buf, size_t len)
+{
+    union {
+        char buf [CMSG_SPACE (sizeof (int) * US_MAX_FDS)];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov;
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    int flags = 0;
+    ssize_t n;
+
+#ifdef MSG_CMSG_CLOEXEC
+    flags |= MSG_CMSG_CLOEXEC;
+#endif
+
+    iov.iov_base = buf;
+    iov.iov_len = len;
+    memset (&msg, 0, sizeof (msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof (control.buf);
+
+    n = recvmsg (usc->fd, &msg, flags);
+    if (n <= 0 || msg.msg_controllen == 0)
+        return n;
+
+    for (cmsg = CMSG_FIRSTHDR (&msg); cmsg; cmsg = CMSG_NXTHDR (&msg, cmsg)) {
+        size_t i, nr;
 
-    /* attempt to send the whole buffer */
-    if (list_empty (&client->pending)) {
-        bytes = us_write_data (server, client, buffer, len);
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+
+        nr = (cmsg->cmsg_len - CMSG_LEN (0)) / sizeof (int);
+        for (i = 0; i < nr; i++) {
+            int fd;
+
+            memcpy (&fd, CMSG_DATA (cmsg) + i * sizeof (int), sizeof (int));
+            if (usc->nr_fds < US_MAX_FDS) {
+                usc->fds [usc->nr_fds++] = fd;
+            }
+            else {
+                purc_log_warn ("Too many file descriptors from client: "
+                        "fd (%d), pid (%d)\n", usc->fd, usc->pid);
+                close (fd);
+            }
+        }
     }
-    /* the pending list not empty, just append new data if we're not
-     * throttling the client */
-    else if (client->sz_pending < SOCK_THROTTLE_THLD) {
-        if (us_queue_data (client, buffer, len))
-            return bytes;
+
+    if (msg.msg_flags & MSG_CTRUNC) {
+        purc_log_warn ("File descriptors from client truncated: "
+                "fd (%d), pid (%d)\n", usc->fd, usc->pid);
     }
-    /* send from cache buffer */
-    else {
-        bytes = us_write_pending (server, client);
+
+    return n;
+}
+
+/*
+ * Take the first `nr` file descriptors received.
+ *
+ * Returns 0 on success, -1 if there are not enough file descriptors.
+ */
+static int us_take_fds (USClient *usc, int *fds, int nr)
+{
+    if (usc->nr_fds < nr)
+        return -1;
+
+    memcpy (fds, usc->fds, sizeof (int) * nr);
+    usc->nr_fds -= nr;
+    memmove (usc->fds, usc->fds + nr, sizeof (int) * usc->nr_fds);
+    return 0;
+}
+
+/*
+ * Close the file descriptors received but not taken.
+ */
+static void us_close_fds (USClient *usc)
+{
+    while (usc->nr_fds > 0)
+        close (usc->fds [--usc->nr_fds]);
+}
+
+/*
+ * Notify the client that there are data in the ring, or there are
+ * free space in the ring.
+ */
+static void us_notify_peer (USRings *rings)
+{
+    uint64_t one = 1;
+
+    if (write (rings->efd_peer, &one, sizeof (one)) < 0 && errno != EAGAIN) {
+        purc_log_warn ("Failed to notify the client via eventfd: %s\n",
+                strerror (errno));
     }
+}
+
+static void us_free_rings (USRings *rings)
+{
+    struct list_head *p, *n;
 
-    return bytes;
+    list_for_each_safe (p, n, &rings->pending) {
+        list_del (p);
+        free (p);
+    }
+
+    shm_ring_unmap (&rings->in);
+    shm_ring_unmap (&rings->out);
+    if (rings->fd >= 0)
+        close (rings->fd);
+    if (rings->efd_peer >= 0)
+        close (rings->efd_peer);
+    free (rings);
+}
+
+/*
+ * Detach the rings from the client, if there are.
+ */
+static void us_detach_rings (USServer *server, USClient *usc)
+{
+    if (usc->rings) {
+        if (server->watch_rings)
+            server->watch_rings (server, usc->rings, 0);
+        us_free_rings (usc->rings);
+        usc->rings = NULL;
+    }
 }
 
-/* TODO: tune this for noblocking read */
-#if 0
-static inline ssize_t my_read (int fd, void* buff, size_t sz)
+/*
+ * Attach the rings passed by the client, and reply the status.
+ * A failure to attach the rings is not fatal: the client will keep
+ * using the socket.
+ */
+static int us_attach_rings (USServer *server, USClient *usc, int *sta_code)
 {
-    ssize_t bytes;
+    USFrameHeader header;
+    USRings *rings = NULL;
+    int fds [4] = { -1, -1, -1, -1 };
+    int i, status = PCRDR_SC_OK;
+
+    if (usc->header.sz_payload != 0) {
+        *sta_code = PCRDR_SC_EXPECTATION_FAILED;
+        return PCRDR_ERROR_PROTOCOL;
+    }
+
+    if (us_take_fds (usc, fds, 4)) {
+        status = PCRDR_SC_BAD_REQUEST;
+        goto reply;
+    }
+
+    /* the data in the rings are parsed in place; only trust the peer
+       running as the same user */
+    if (server->watch_rings == NULL || usc->rings || usc->uid != geteuid ()) {
+        status = PCRDR_SC_NOT_ACCEPTABLE;
+        goto reply;
+    }
+
+    if ((rings = calloc (1, sizeof (USRings))) == NULL) {
+        status = PCRDR_SC_INSUFFICIENT_STORAGE;
+        goto reply;
+    }
 
-again:
-    bytes = read (fd, buff, sz);
-    if (bytes == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
-        goto again;
+    rings->ct = CT_SHM_RING;
+    rings->client = usc;
+    rings->fd = -1;
+    rings->efd_peer = -1;
+    list_head_init (&rings->pending);
+    if (shm_ring_map (&rings->in, fds [0]) ||
+            shm_ring_map (&rings->out, fds [1])) {
+        status = PCRDR_SC_BAD_REQUEST;
+        goto reply;
+    }
+
+    rings->fd = fds [2];
+    rings->efd_peer = fds [3];
+    fds [2] = fds [3] = -1;
+    if (server->watch_rings (server, rings, 1)) {
+        status = PCRDR_SC_INTERNAL_SERVER_ERROR;
+        goto reply;
+    }
+
+    usc->rings = rings;
+    rings = NULL;
+    purc_log_info ("Rings attached (%u/%u) for client: fd (%d), pid (%d)\n",
+            usc->rings->in.order, usc->rings->out.order, usc->fd, usc->pid);
 
-    return bytes;
+reply:
+    /* the mapped memfds are not needed anymore */
+    for (i = 0; i < 4; i++) {
+        if (fds [i] >= 0)
+            close (fds [i]);
+    }
+
+    if (rings)
+        us_free_rings (rings);
+
+    if (status != PCRDR_SC_OK) {
+        purc_log_warn ("Refused rings (%d) for client: fd (%d), pid (%d)\n",
+                status, usc->fd, usc->pid);
+    }
+
+    header.op = US_OPCODE_RING;
+    header.fragmented = status;
+    header.sz_payload = 0;
+    if (us_write (server, usc, &header, sizeof (USFrameHeader)) < 0) {
+        purc_log_error ("Error when wirting socket: %s\n", strerror (errno));
+        *sta_code = PCRDR_SC_IOERR;
+        return PCRDR_ERROR_IO;
+    }
+
+    return 0;
 }
+
+/*
+ * Map the document passed by the client for the next packet.
+ * A bad memfd is not fatal: it is dropped, and the next packet
+ * will be handled as if it had no data.
+ */
+static int us_attach_document (USServer *server, USClient *usc, int *sta_code)
+{
+    struct stat st;
+    size_t len = usc->header.fragmented;
+    char *doc = MAP_FAILED;
+    int fd = -1;
+
+    if (usc->header.sz_payload != 0) {
+        *sta_code = PCRDR_SC_EXPECTATION_FAILED;
+        return PCRDR_ERROR_PROTOCOL;
+    }
+
+    if (us_take_fds (usc, &fd, 1)) {
+        purc_log_warn ("No memfd along with the document: fd (%d), pid (%d)\n",
+                usc->fd, usc->pid);
+        return 0;
+    }
+
+    /* the frames in the rings may overtake the document */
+    if (usc->rings || usc->doc || len == 0 ||
+            len > US_MAX_DOCUMENT_SIZE) {
+        purc_log_warn ("Refused document (%zu bytes): fd (%d), pid (%d)\n",
+                len, usc->fd, usc->pid);
+        goto done;
+    }
+
+#ifdef F_GET_SEALS
+    /* the document is used in place: it must not change its size or content */
+#define US_DOCUMENT_SEALS   (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE)
+    int seals = fcntl (fd, F_GET_SEALS);
+    if (seals < 0 || (seals & US_DOCUMENT_SEALS) != US_DOCUMENT_SEALS) {
+        purc_log_warn ("The memfd of document is not sealed: "
+                "fd (%d), pid (%d)\n", usc->fd, usc->pid);
+        goto done;
+    }
+#else
+    goto done;
 #endif
 
+    if (fstat (fd, &st) || st.st_size < 0 || (size_t)st.st_size <= len) {
+        purc_log_warn ("Bad size of the memfd of document: "
+                "fd (%d), pid (%d)\n", usc->fd, usc->pid);
+        goto done;
+    }
+
+    doc = mmap (NULL, len + 1, PROT_READ, MAP_SHARED, fd, 0);
+    if (doc == MAP_FAILED) {
+        purc_log_warn ("Failed to map the document: %s\n", strerror (errno));
+        goto done;
+    }
+
+    if (doc [len] != '\0') {
+        purc_log_warn ("The document is not null-terminated: "
+                "fd (%d), pid (%d)\n", usc->fd, usc->pid);
+        munmap (doc, len + 1);
+        goto done;
+    }
+
+    usc->doc = doc;
+    usc->len_doc = len;
+
+done:
+    close (fd);
+    return 0;
+}
+
 /*
- * return values:
- * < 0: error
- * 0: payload read
- * 1: got packet;
+ * Take the document passed for the current packet; the caller releases it
+ * by calling us_release_document().
+ *
+ * Returns NULL if no document was passed.
  */
-static int try_to_read_payload (USServer* server, USClient* usc)
+char *us_take_document (USClient *usc, size_t *len)
 {
-    ssize_t n;
+    char *doc = usc->doc;
 
-    (void)server;
+    *len = usc->len_doc;
+    usc->doc = NULL;
+    usc->len_doc = 0;
+    return doc;
+}
+
+void us_release_document (char *doc, size_t len)
+{
+    if (doc)
+        munmap (doc, len + 1);
+}
+
+/*
+ * Put the pending records into the outgoing ring as many as possible.
+ *
+ * Returns the number of records put.
+ */
+static int us_flush_ring (USRings *rings)
+{
+    int nr = 0;
+
+    while (!list_empty (&rings->pending)) {
+        USPendingData *pending = (USPendingData *)rings->pending.next;
+        char *dst;
+
+        if (shm_ring_writable (&rings->out, &dst) < pending->szdata) {
+            /* ask the client to notify us when it consumed some data,
+               then check again in case it did just now */
+            atomic_store (&rings->out.hdr->need_space, 1);
+            if (shm_ring_writable (&rings->out, &dst) < pending->szdata)
+                break;
+        }
+
+        memcpy (dst, pending->data, pending->szdata);
+        shm_ring_produce (&rings->out, pending->szdata);
+        rings->sz_pending -= pending->szdata;
+        list_del (&pending->list);
+        free (pending);
+        nr++;
+    }
+
+    if (nr > 0)
+        us_update_entity_stats (rings->client);
+    return nr;
+}
+
+/*
+ * Put a frame into the outgoing ring; the record is queued if there is
+ * no enough space.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int us_put_ring_frame (USRings *rings, const USFrameHeader *header,
+        const void *payload)
+{
+    size_t sz_record = US_RING_RECORD_SIZE (header->sz_payload);
+    size_t sz_head = sizeof (USFrameHeader) + header->sz_payload;
+    USPendingData *pending;
+    char *dst;
+
+    if (list_empty (&rings->pending) &&
+            shm_ring_writable (&rings->out, &dst) >= sz_record) {
+        memcpy (dst, header, sizeof (USFrameHeader));
+        memcpy (dst + sizeof (USFrameHeader), payload, header->sz_payload);
+        memset (dst + sz_head, 0, sz_record - sz_head);
+        shm_ring_produce (&rings->out, sz_record);
+        return 0;
+    }
+
+    pending = malloc (sizeof (USPendingData) + sz_record);
+    if (pending == NULL)
+        return -1;
+
+    dst = (char *)pending->data;
+    memcpy (dst, header, sizeof (USFrameHeader));
+    memcpy (dst + sizeof (USFrameHeader), payload, header->sz_payload);
+    memset (dst + sz_head, 0, sz_record - sz_head);
+    pending->ptr = pending->data;
+    pending->owned = NULL;
+    pending->szdata = sz_record;
+    pending->szsent = 0;
+    list_add_tail (&pending->list, &rings->pending);
+    rings->sz_pending += sz_record;
+
+    if (us_flush_ring (rings) == 0)
+        us_update_entity_stats (rings->client);
+    return 0;
+}
+
+/*
+ * Send a packet through the outgoing ring; the packet is split into
+ * frames no larger than a quarter of the ring.
+ *
+ * The client is probably too slow if the records pending reach
+ * SOCK_THROTTLE_THLD, so try to put them into the ring first; the packet
+ * is refused if US_RING_MAX_PENDING bytes are still pending.
+ *
+ * return zero on success; none-zero on error, and the connection status
+ * is set.
+ */
+static int us_send_ring_frames (USClient *usc, USOpcode op,
+        const char *data, unsigned int sz)
+{
+    USRings *rings = usc->rings;
+    unsigned int max_payload = rings->out.size / 4;
+    unsigned int left = sz;
+    USFrameHeader header;
+    int ret = 0;
+
+    if (rings->sz_pending >= SOCK_THROTTLE_THLD && us_flush_ring (rings) > 0)
+        us_notify_peer (rings);
+
+    if (rings->sz_pending >= US_RING_MAX_PENDING) {
+        purc_log_warn ("The ring is not consumed (%zu bytes pending): "
+                "fd (%d), pid (%d)\n", rings->sz_pending, usc->fd, usc->pid);
+        usc->status = US_ERR | US_CLOSE;
+        return -1;
+    }
+
+    header.op = op;
+    header.fragmented = (sz > max_payload) ? sz : 0;
+    do {
+        header.sz_payload = (left > max_payload) ? max_payload : left;
+        if (us_put_ring_frame (rings, &header, data)) {
+            purc_log_error ("Failed to allocate memory for ring record\n");
+            usc->status = US_ERR | US_CLOSE;
+            ret = -1;
+            break;
+        }
+
+        data += header.sz_payload;
+        left -= header.sz_payload;
+        header.fragmented = 0;
+        header.op = (left > max_payload) ?
+            US_OPCODE_CONTINUATION : US_OPCODE_END;
+    } while (left > 0);
+
+    us_notify_peer (rings);
+    return ret;
+}
+
+/*
+ * Start a new frame whose header is in usc->header.
+ *
+ * Returns 0 on success, otherwise the error code; *sta_code returns
+ * the status code to report to the peer (zero for none).
+ */
+static int us_start_frame (USServer* server, USClient* usc, int *sta_code)
+{
     switch (usc->header.op) {
+    case US_OPCODE_PING: {
+        USFrameHeader header;
+
+        header.op = US_OPCODE_PONG;
+        header.fragmented = 0;
+        header.sz_payload = 0;
+        if (us_write (server, usc, &header, sizeof (USFrameHeader)) < 0) {
+            purc_log_error ("Error when wirting socket: %s\n", strerror (errno));
+            *sta_code = PCRDR_SC_IOERR;
+            return PCRDR_ERROR_IO;
+        }
+        break;
+    }
+
+    case US_OPCODE_CLOSE:
+        purc_log_warn ("Peer closed\n");
+        *sta_code = 0;
+        return PCRDR_ERROR_PEER_CLOSED;
+
     case US_OPCODE_TEXT:
     case US_OPCODE_BIN:
-        if ((n = read (usc->fd, usc->packet, usc->header.sz_payload))
-                < usc->header.sz_payload) {
-            purc_log_error ("Failed to read payload from Unix socket: %s\n",
-                    strerror (errno));
-            return PCRDR_ERROR_IO;
+        if (usc->packet) {
+            /* the last packet is not finished */
+            *sta_code = PCRDR_SC_EXPECTATION_FAILED;
+            return PCRDR_ERROR_PROTOCOL;
         }
 
-        usc->sz_read = usc->header.sz_payload;
-        if (usc->header.fragmented == 0) {
-            return 1;
+        if (usc->header.fragmented > 0 &&
+                usc->header.fragmented > usc->header.sz_payload) {
+            usc->sz_packet = usc->header.fragmented;
         }
-        break;
+        else {
+            usc->sz_packet = usc->header.sz_payload;
+        }
+
+        if (usc->sz_packet > PCRDR_MAX_INMEM_PAYLOAD_SIZE ||
+                usc->sz_packet == 0 ||
+                usc->header.sz_payload == 0) {
+            *sta_code = PCRDR_SC_PACKET_TOO_LARGE;
+            return PCRDR_ERROR_PROTOCOL;
+        }
+
+        clock_gettime (CLOCK_MONOTONIC, &usc->ts);
+        if (usc->header.op == US_OPCODE_TEXT)
+            usc->t_packet = PT_TEXT;
+        else
+            usc->t_packet = PT_BINARY;
+
+        /* always reserve a space for null character */
+        usc->packet = bufpool_alloc (server->pool, usc->sz_packet + 1);
+        if (usc->packet == NULL) {
+            purc_log_error ("Failed to allocate memory for packet (size: %u)\n",
+                    usc->sz_packet);
+            *sta_code = PCRDR_SC_INSUFFICIENT_STORAGE;
+            return PCRDR_ERROR_NOMEM;
+        }
+
+        usc->sz_read = 0;
+        us_update_entity_stats (usc);
+        /* fall through */
 
     case US_OPCODE_CONTINUATION:
     case US_OPCODE_END:
+        if (usc->header.sz_payload == 0) {
+            *sta_code = PCRDR_SC_PACKET_TOO_LARGE;
+            return PCRDR_ERROR_PROTOCOL;
+        }
+
         if (usc->packet == NULL ||
                 (usc->sz_read + usc->header.sz_payload) > usc->sz_packet) {
+            *sta_code = PCRDR_SC_EXPECTATION_FAILED;
             return PCRDR_ERROR_PROTOCOL;
         }
 
-        if ((n = read (usc->fd, usc->packet + usc->sz_read,
-                usc->header.sz_payload)) < usc->header.sz_payload) {
-            purc_log_error ("Failed to read payload from Unix socket: %s\n",
-                    strerror (errno));
-            return PCRDR_ERROR_IO;
+        usc->sz_left = usc->header.sz_payload;
+        usc->status |= US_WATING_FOR_PAYLOAD;
+        break;
+
+    case US_OPCODE_RING:
+        return us_attach_rings (server, usc, sta_code);
+
+    case US_OPCODE_DOCUMENT:
+        return us_attach_document (server, usc, sta_code);
+
+    case US_OPCODE_PONG:
+        if (usc->detached) {
+            purc_log_info ("Got a PONG frame from client: fd (%d), pid (%d)\n",
+                    usc->fd, usc->pid);
         }
+        else {
+            purcmc_endpoint *endpoint;
 
-        usc->sz_read += usc->header.sz_payload;
-        if (usc->header.op == US_OPCODE_END) {
-            return 1;
+            endpoint = container_of (usc->entity, purcmc_endpoint, entity);
+            assert (endpoint);
+            purc_log_info ("Got a PONG frame from endpoint @%s/%s/%s\n",
+                    endpoint->host_name, endpoint->app_name,
+                    endpoint->runner_name);
         }
         break;
 
     default:
+        purc_log_error ("Unknown frame opcode: %d\n", usc->header.op);
+        *sta_code = PCRDR_SC_EXPECTATION_FAILED;
         return PCRDR_ERROR_PROTOCOL;
     }
 
     return 0;
 }
 
-int us_handle_reads (USServer* server, USClient* usc)
+/*
+ * Finish the frame whose payload has been read completely,
+ * and deliver the packet if it is the last frame of the packet.
+ */
+static int us_end_frame (USServer* server, USClient* usc, int *sta_code)
+{
+    usc->status &= ~US_WATING_FOR_PAYLOAD;
+
+    if (usc->header.op == US_OPCODE_CONTINUATION ||
+            ((usc->header.op == US_OPCODE_TEXT ||
+              usc->header.op == US_OPCODE_BIN) &&
+             usc->sz_read < usc->sz_packet)) {
+        /* more frames to come */
+        return 0;
+    }
+
+    usc->packet [usc->sz_read] = '\0';
+    *sta_code = server->on_packet (server, (SockClient *)usc, usc->packet,
+            (usc->t_packet == PT_TEXT) ? (usc->sz_read + 1) : usc->sz_read,
+            usc->t_packet);
+    /* the packet might be taken over by the callback */
+    bufpool_free (server->pool, usc->packet);
+    usc->packet = NULL;
+    usc->sz_packet = 0;
+    usc->sz_read = 0;
+    us_update_entity_stats (usc);
+
+    if (*sta_code != PCRDR_SC_OK) {
+        purc_log_warn ("Internal error after got a packet: %d\n", *sta_code);
+        return PCRDR_ERROR_SERVER_ERROR;
+    }
+
+    return 0;
+}
+
+/*
+ * Parse all complete frames in the receive buffer; the payloads are copied
+ * to the current packet as they arrive.
+ */
+static int us_parse_frames (USServer* server, USClient* usc, int *sta_code)
 {
-    int retv, err_code = 0, sta_code = 0;
-    ssize_t n = 0;
+    size_t pos = 0;
+    int err_code = 0;
+
+    while (pos < usc->sz_rbuf_used) {
+        if (usc->status & US_WATING_FOR_PAYLOAD) {
+            size_t n = usc->sz_rbuf_used - pos;
 
-    /* if it is not waiting for payload, read a frame header */
-    if (usc->status & US_WATING_FOR_PAYLOAD) {
+            if (n > usc->sz_left)
+                n = usc->sz_left;
 
-        usc->status &= ~US_WATING_FOR_PAYLOAD;
-        retv = try_to_read_payload (server, usc);
-        if (retv > 0) {
-            goto got_packet;
+            memcpy (usc->packet + usc->sz_read, usc->rbuf + pos, n);
+            usc->sz_read += n;
+            usc->sz_left -= n;
+            pos += n;
+
+            if (usc->sz_left == 0 &&
+                    (err_code = us_end_frame (server, usc, sta_code)))
+                break;
         }
-        else if (retv == 0) {
-            goto done;
+        else if (usc->sz_rbuf_used - pos >= sizeof (USFrameHeader)) {
+            /* the frame header may be unaligned in the buffer */
+            memcpy (&usc->header, usc->rbuf + pos, sizeof (USFrameHeader));
+            pos += sizeof (USFrameHeader);
+
+            if ((err_code = us_start_frame (server, usc, sta_code)))
+                break;
         }
-        else if (retv < 0) {
-            err_code = retv;
-            sta_code = PCRDR_SC_EXPECTATION_FAILED;
-            goto done;
+        else {
+            /* a partial frame header */
+            break;
         }
     }
-    else {
-        n = read (usc->fd, &usc->header, sizeof (USFrameHeader));
-        if (n < (ssize_t)sizeof (USFrameHeader)) {
-            purc_log_error ("Failed to read frame header from Unix socket.\n");
-            err_code = PCRDR_ERROR_IO;
-            sta_code = PCRDR_SC_EXPECTATION_FAILED;
+
+    usc->sz_rbuf_used -= pos;
+    if (usc->sz_rbuf_used > 0 && pos > 0)
+        memmove (usc->rbuf, usc->rbuf + pos, usc->sz_rbuf_used);
+
+    return err_code;
+}
+
+/*
+ * Read as much data as the socket has (up to US_MAX_READ_EACH bytes),
+ * and handle all complete frames. It is safe to use with EPOLLET:
+ * if the limit is reached before EAGAIN, US_MORE_DATA will be set in
+ * the status, and the caller should re-arm the fd.
+ */
+int us_handle_reads (USServer* server, USClient* usc)
+{
+    int err_code = 0, sta_code = 0;
+    size_t total = 0;
+
+    usc->status &= ~US_MORE_DATA;
+    if (usc->rbuf == NULL) {
+        usc->rbuf = malloc (US_RBUF_SIZE);
+        if (usc->rbuf == NULL) {
+            err_code = PCRDR_ERROR_NOMEM;
+            sta_code = PCRDR_SC_INSUFFICIENT_STORAGE;
             goto done;
         }
+    }
 
-        switch (usc->header.op) {
-        case US_OPCODE_PING: {
-            USFrameHeader header;
-            header.op = US_OPCODE_PONG;
-            header.fragmented = 0;
-            header.sz_payload = 0;
-            n = us_write (server, usc, &header, sizeof (USFrameHeader));
-            if (n < 0) {
-                purc_log_error ("Error when wirting socket: %s\n", strerror (errno));
-                err_code = PCRDR_ERROR_IO;
-                sta_code = PCRDR_SC_IOERR;
+    while (1) {
+        ssize_t n;
+
+        if ((usc->status & US_WATING_FOR_PAYLOAD) && usc->sz_rbuf_used == 0 &&
+                usc->sz_left >= US_RBUF_SIZE / 2) {
+            /* read a large payload into the packet directly */
+            n = us_recv (usc, usc->packet + usc->sz_read, usc->sz_left);
+            if (n > 0) {
+                usc->sz_read += n;
+                usc->sz_left -= n;
+                if (usc->sz_left == 0 &&
+                        (err_code = us_end_frame (server, usc, &sta_code)))
+                    goto done;
+            }
+        }
+        else {
+            n = us_recv (usc, usc->rbuf + usc->sz_rbuf_used,
+                    US_RBUF_SIZE - usc->sz_rbuf_used);
+            if (n > 0) {
+                usc->sz_rbuf_used += n;
+                if ((err_code = us_parse_frames (server, usc, &sta_code)))
+                    goto done;
             }
-            break;
         }
 
-        case US_OPCODE_CLOSE:
-            purc_log_warn ("Peer closed\n");
+        if (n == 0) {
+            purc_log_warn ("Peer closed the Unix socket: fd (%d)\n", usc->fd);
             err_code = PCRDR_ERROR_PEER_CLOSED;
             sta_code = 0;
+            goto done;
+        }
+        else if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+
+            purc_log_error ("Failed to read from Unix socket: %s\n",
+                    strerror (errno));
+            err_code = PCRDR_ERROR_IO;
+            sta_code = PCRDR_SC_EXPECTATION_FAILED;
+            goto done;
+        }
+
+        total += n;
+        if (total >= US_MAX_READ_EACH) {
+            /* give other clients a chance */
+            usc->status |= US_MORE_DATA;
             break;
+        }
+    }
 
-        case US_OPCODE_TEXT:
-        case US_OPCODE_BIN: {
-            if (usc->header.fragmented > 0 &&
-                    usc->header.fragmented > usc->header.sz_payload) {
-                usc->sz_packet = usc->header.fragmented;
-            }
-            else {
-                usc->sz_packet = usc->header.sz_payload;
-            }
+done:
+    if (err_code) {
+        if (sta_code) {
+            server->on_error (server, (SockClient*)usc, sta_code);
+        }
 
-            if (usc->sz_packet > PCRDR_MAX_INMEM_PAYLOAD_SIZE ||
-                    usc->sz_packet == 0 ||
-                    usc->header.sz_payload == 0) {
-                err_code = PCRDR_ERROR_PROTOCOL;
-                sta_code = PCRDR_SC_PACKET_TOO_LARGE;
-                break;
-            }
+        us_cleanup_client (server, usc);
+    }
 
-            clock_gettime (CLOCK_MONOTONIC, &usc->ts);
-            if (usc->header.op == US_OPCODE_TEXT)
-                usc->t_packet = PT_TEXT;
-            else
-                usc->t_packet = PT_BINARY;
-
-            /* always reserve a space for null character */
-            usc->packet = malloc (usc->sz_packet + 1);
-            if (usc->packet == NULL) {
-                purc_log_error ("Failed to allocate memory for packet (size: %u)\n",
-                        usc->sz_packet);
-                err_code = PCRDR_ERROR_NOMEM;
-                sta_code = PCRDR_SC_INSUFFICIENT_STORAGE;
-                break;
-            }
+    return err_code;
+}
 
-            update_upper_entity_stats (usc->entity, usc->sz_pending, usc->sz_packet);
+/*
+ * Handle the complete records in the incoming ring. A packet in a single
+ * frame is passed to on_packet() in place; the frames of a fragmented
+ * packet are assembled as they are read from the socket.
+ */
+static int us_consume_ring (USServer* server, USClient* usc, int *sta_code)
+{
+    USRings *rings = usc->rings;
+    size_t total = 0;
+    int err_code = 0;
+
+    while (total < US_MAX_READ_EACH) {
+        size_t avail, sz_record;
+        char *rec;
+
+        avail = shm_ring_readable (&rings->in, &rec);
+        if (avail > rings->in.size) {
+            purc_log_error ("The incoming ring corrupted: fd (%d), pid (%d)\n",
+                    usc->fd, usc->pid);
+            *sta_code = PCRDR_SC_EXPECTATION_FAILED;
+            return PCRDR_ERROR_PROTOCOL;
+        }
 
-            retv = try_to_read_payload (server, usc);
-            if (retv > 0) {
-                goto got_packet;
-            }
-            else if (retv == 0) {
-                goto done;
-            }
-            else if (retv == PCRDR_ERROR_IO) {
-                usc->status |= US_WATING_FOR_PAYLOAD;
-                goto done;
-            }
-            else {
-                err_code = retv;
-                sta_code = PCRDR_SC_EXPECTATION_FAILED;
-                goto done;
-            }
+        if (avail < sizeof (USFrameHeader))
             break;
-        }
 
-        case US_OPCODE_CONTINUATION:
-        case US_OPCODE_END:
-            if (usc->header.sz_payload == 0) {
-                err_code = PCRDR_ERROR_PROTOCOL;
-                sta_code = PCRDR_SC_PACKET_TOO_LARGE;
-                break;
-            }
+        /* use a copy of the header which the peer can not change */
+        memcpy (&usc->header, rec, sizeof (USFrameHeader));
+        if (usc->header.sz_payload > rings->in.size / 4) {
+            *sta_code = PCRDR_SC_PACKET_TOO_LARGE;
+            return PCRDR_ERROR_PROTOCOL;
+        }
 
-            retv = try_to_read_payload (server, usc);
-            if (retv > 0) {
-                goto got_packet;
-            }
-            else if (retv == 0) {
-                goto done;
-            }
-            else if (retv == PCRDR_ERROR_IO) {
-                usc->status |= US_WATING_FOR_PAYLOAD;
-                goto done;
-            }
-            else {
-                err_code = retv;
-                sta_code = PCRDR_SC_EXPECTATION_FAILED;
-                goto done;
-            }
+        sz_record = US_RING_RECORD_SIZE (usc->header.sz_payload);
+        if (avail < sz_record)
             break;
 
-        case US_OPCODE_PONG: {
-            purcmc_endpoint *endpoint = container_of (usc->entity, purcmc_endpoint, entity);
+        if (usc->header.op != US_OPCODE_TEXT &&
+                usc->header.op != US_OPCODE_BIN &&
+                usc->header.op != US_OPCODE_CONTINUATION &&
+                usc->header.op != US_OPCODE_END) {
+            purc_log_error ("Bad frame opcode in ring: %d\n", usc->header.op);
+            *sta_code = PCRDR_SC_EXPECTATION_FAILED;
+            return PCRDR_ERROR_PROTOCOL;
+        }
 
-            assert (endpoint);
+        if (usc->packet == NULL && usc->header.fragmented == 0 &&
+                usc->header.op != US_OPCODE_CONTINUATION &&
+                usc->header.op != US_OPCODE_END) {
+            char *body = rec + sizeof (USFrameHeader);
+            unsigned int sz_body = usc->header.sz_payload;
 
-            purc_log_info ("Got a PONG frame from endpoint @%s/%s/%s\n",
-                    endpoint->host_name, endpoint->app_name, endpoint->runner_name);
-            break;
+            if (sz_body == 0 || body [sz_body] != '\0') {
+                *sta_code = PCRDR_SC_EXPECTATION_FAILED;
+                return PCRDR_ERROR_PROTOCOL;
+            }
+
+            clock_gettime (CLOCK_MONOTONIC, &usc->ts);
+            usc->t_packet = (usc->header.op == US_OPCODE_TEXT) ?
+                PT_TEXT : PT_BINARY;
+            *sta_code = server->on_packet (server, (SockClient *)usc, body,
+                    (usc->t_packet == PT_TEXT) ? (sz_body + 1) : sz_body,
+                    usc->t_packet);
+            if (*sta_code != PCRDR_SC_OK) {
+                purc_log_warn ("Internal error after got a packet: %d\n",
+                        *sta_code);
+                return PCRDR_ERROR_SERVER_ERROR;
+            }
+        }
+        else {
+            if ((err_code = us_start_frame (server, usc, sta_code)))
+                return err_code;
+
+            memcpy (usc->packet + usc->sz_read, rec + sizeof (USFrameHeader),
+                    usc->header.sz_payload);
+            usc->sz_read += usc->header.sz_payload;
+            usc->sz_left = 0;
+            if ((err_code = us_end_frame (server, usc, sta_code)))
+                return err_code;
         }
 
-        default:
-            purc_log_error ("Unknown frame opcode: %d\n", usc->header.op);
-            err_code = PCRDR_ERROR_PROTOCOL;
-            sta_code = PCRDR_SC_EXPECTATION_FAILED;
-            break;
+        shm_ring_consume (&rings->in, sz_record);
+        total += sz_record;
+    }
+
+    if (total >= US_MAX_READ_EACH) {
+        /* give other clients a chance; make the eventfd readable again */
+        uint64_t one = 1;
+        if (write (rings->fd, &one, sizeof (one)) < 0 && errno != EAGAIN) {
+            purc_log_warn ("Failed to write eventfd of rings: %s\n",
+                    strerror (errno));
         }
     }
 
-done:
+    if (total > 0 && atomic_exchange (&rings->in.hdr->need_space, 0))
+        us_notify_peer (rings);
+
+    return 0;
+}
+
+/*
+ * Handle the notification from the client via the eventfd of the rings:
+ * consume the incoming ring, and put the pending records into
+ * the outgoing ring.
+ */
+int us_handle_ring_reads (USServer *server, USRings *rings)
+{
+    USClient *usc = rings->client;
+    int err_code, sta_code = 0;
+    uint64_t counter;
+
+    /* the sending failed, e.g. the client did not consume the ring */
+    if (usc->status & US_ERR) {
+        us_cleanup_client (server, usc);
+        return PCRDR_ERROR_IO;
+    }
+
+    /* reset the eventfd before checking the rings */
+    if (read (rings->fd, &counter, sizeof (counter)) < 0 && errno != EAGAIN) {
+        purc_log_warn ("Failed to read eventfd of rings: %s\n",
+                strerror (errno));
+    }
+
+    err_code = us_consume_ring (server, usc, &sta_code);
     if (err_code) {
         if (sta_code) {
             server->on_error (server, (SockClient*)usc, sta_code);
         }
 
         us_cleanup_client (server, usc);
+        return err_code;
     }
 
-    return err_code;
-
-got_packet:
-    usc->packet [usc->sz_read] = '\0';
-    sta_code = server->on_packet (server, (SockClient *)usc, usc->packet,
-            (usc->t_packet == PT_TEXT) ? (usc->sz_read + 1) : usc->sz_read,
-            usc->t_packet);
-    free (usc->packet);
-    usc->packet = NULL;
-    usc->sz_packet = 0;
-    usc->sz_read = 0;
-    update_upper_entity_stats (usc->entity, usc->sz_pending, usc->sz_packet);
+    if (!list_empty (&rings->pending) && us_flush_ring (rings) > 0)
+        us_notify_peer (rings);
 
-    if (sta_code != PCRDR_SC_OK) {
-        purc_log_warn ("Internal error after got a packet: %d\n", sta_code);
-
-        server->on_error (server, (SockClient*)usc, sta_code);
-        err_code = PCRDR_ERROR_SERVER_ERROR;
+    return 0;
+}
 
-        us_cleanup_client (server, usc);
+#if HAVE(SYS_EPOLL_H)
+/*
+ * Re-arm the edge-triggered fd of the client in the epoll instance;
+ * EPOLLOUT is included if there are pending data.
+ */
+int us_rearm_client (int epollfd, USClient *usc)
+{
+    struct epoll_event ev;
+
+    ev.events = EPOLLIN | EPOLLET;
+    if (usc->status & US_SENDING)
+        ev.events |= EPOLLOUT;
+    ev.data.ptr = usc;
+    if (epoll_ctl (epollfd, EPOLL_CTL_MOD, usc->fd, &ev) == -1) {
+        purc_log_error ("Failed epoll_ctl for unix socket (%d): %s\n",
+                usc->fd, strerror (errno));
+        return -1;
     }
 
-    return err_code;
+    return 0;
 }
+#endif
 
 /*
  * Handle write.
@@ -692,6 +1473,10 @@ int us_ping_client (USServer* server, USClient* usc)
 {
     USFrameHeader header;
 
+    if (us_forward_to_iothread (server))
+        return iothread_post_request (server->iothread, IOR_PING, usc,
+                US_OPCODE_PING, NULL, 0);
+
     header.op = US_OPCODE_PING;
     header.fragmented = 0;
     header.sz_payload = 0;
@@ -711,6 +1496,10 @@ int us_close_client (USServer* server, USClient* usc)
 {
     USFrameHeader header;
 
+    if (us_forward_to_iothread (server))
+        return iothread_post_request (server->iothread, IOR_CLOSE, usc,
+                US_OPCODE_CLOSE, NULL, 0);
+
     header.op = US_OPCODE_CLOSE;
     header.fragmented = 0;
     header.sz_payload = 0;
@@ -721,6 +1510,100 @@ int us_close_client (USServer* server, USClient* usc)
     return 0;
 }
 
+/* the number of frames to send without allocating the headers and iovecs */
+#define US_NR_LOCAL_FRAMES  8
+
+/*
+ * Send a packet in frames; the headers and the payloads of all frames
+ * are sent by a single call to writev if the socket buffer is large enough.
+ * If `owned` is true, the data is handed over and will be freed.
+ *
+ * return zero on success; none-zero on error.
+ */
+static int us_send_frames (USServer* server, USClient* usc,
+        USOpcode op, const void* data, unsigned int sz, bool owned)
+{
+    USFrameHeader local_headers[US_NR_LOCAL_FRAMES], *headers = local_headers;
+    struct iovec local_iov[US_NR_LOCAL_FRAMES * 2], *iov = local_iov;
+    unsigned int nr_frames, i, left = sz;
+    const char* buff = data;
+
+    if (usc->rings) {
+        int ret = us_send_ring_frames (usc, op, data, sz);
+        if (owned)
+            free ((void *)data);
+        server->nr_packets_sent++;
+        return ret;
+    }
+
+    nr_frames = (sz + PCRDR_MAX_FRAME_PAYLOAD_SIZE - 1) /
+        PCRDR_MAX_FRAME_PAYLOAD_SIZE;
+    if (nr_frames == 0)
+        nr_frames = 1;
+
+    if (nr_frames > US_NR_LOCAL_FRAMES) {
+        headers = malloc (sizeof (USFrameHeader) * nr_frames);
+        iov = malloc (sizeof (struct iovec) * nr_frames * 2);
+        if (headers == NULL || iov == NULL) {
+            purc_log_error ("Failed to allocate memory for frames\n");
+            if (headers != local_headers)
+                free (headers);
+            if (iov != local_iov)
+                free (iov);
+            if (owned)
+                free ((void *)data);
+            return -1;
+        }
+    }
+
+    for (i = 0; i < nr_frames; i++) {
+        if (nr_frames == 1) {
+            headers[i].op = op;
+            headers[i].fragmented = 0;
+        }
+        else if (i == 0) {
+            headers[i].op = op;
+            headers[i].fragmented = sz;
+        }
+        else if (i < nr_frames - 1) {
+            headers[i].op = US_OPCODE_CONTINUATION;
+            headers[i].fragmented = 0;
+        }
+        else {
+            headers[i].op = US_OPCODE_END;
+            headers[i].fragmented = 0;
+        }
+
+        headers[i].sz_payload = (left > PCRDR_MAX_FRAME_PAYLOAD_SIZE) ?
+            PCRDR_MAX_FRAME_PAYLOAD_SIZE : left;
+
+        iov[i * 2].iov_base = headers + i;
+        iov[i * 2].iov_len = sizeof (USFrameHeader);
+        iov[i * 2 + 1].iov_base = (void *)buff;
+        iov[i * 2 + 1].iov_len = headers[i].sz_payload;
+
+        buff += headers[i].sz_payload;
+        left -= headers[i].sz_payload;
+    }
+
+    us_writev (server, usc, iov, nr_frames * 2,
+            owned ? (void *)data : NULL, sz);
+    server->nr_packets_sent++;
+
+    if (headers != local_headers)
+        free (headers);
+    if (iov != local_iov)
+        free (iov);
+
+    if (usc->status & US_ERR) {
+        purc_log_error ("Error when sending data to client: fd (%d), pid (%d)\n",
+                usc->fd, usc->pid);
+        return -1;
+    }
+
+    return 0;
+}
+
 /*
  * Send a packet
  *
@@ -729,7 +1612,9 @@ int us_close_client (USServer* server, USClient* usc)
 int us_send_packet (USServer* server, USClient* usc,
         USOpcode op, const void* data, unsigned int sz)
 {
-    USFrameHeader header;
+    if (us_forward_to_iothread (server))
+        return iothread_post_request (server->iothread, IOR_SEND, usc,
+                op, data, sz);
 
     switch (op) {
         case US_OPCODE_TEXT:
@@ -744,56 +1629,39 @@ int us_send_packet (USServer* server, USClient* usc,
             return -1;
     }
 
-    if (sz > PCRDR_MAX_FRAME_PAYLOAD_SIZE) {
-        const char* buff = data;
-        unsigned int left = sz;
-
-        do {
-            if (left == sz) {
-                header.op = op;
-                header.fragmented = sz;
-                header.sz_payload = PCRDR_MAX_FRAME_PAYLOAD_SIZE;
-                left -= PCRDR_MAX_FRAME_PAYLOAD_SIZE;
-            }
-            else if (left > PCRDR_MAX_FRAME_PAYLOAD_SIZE) {
-                header.op = US_OPCODE_CONTINUATION;
-                header.fragmented = 0;
-                header.sz_payload = PCRDR_MAX_FRAME_PAYLOAD_SIZE;
-                left -= PCRDR_MAX_FRAME_PAYLOAD_SIZE;
-            }
-            else {
-                header.op = US_OPCODE_END;
-                header.fragmented = 0;
-                header.sz_payload = left;
-                left = 0;
-            }
-
-            us_write (server, usc, &header, sizeof (USFrameHeader));
-            us_write (server, usc, buff, header.sz_payload);
-            buff += header.sz_payload;
+    return us_send_frames (server, usc, op, data, sz, false);
+}
 
-        } while (left > 0);
-    }
-    else {
-        header.op = op;
-        header.fragmented = 0;
-        header.sz_payload = sz;
-        us_write (server, usc, &header, sizeof (USFrameHeader));
-        us_write (server, usc, data, sz);
-    }
+/*
+ * Send a packet in a buffer allocated by malloc; the buffer is handed
+ * over to the callee, and will be freed after sent.
+ *
+ * return zero on success; none-zero on error.
+ */
+int us_send_packet_owned (USServer* server, USClient* usc,
+        USOpcode op, void* data, unsigned int sz)
+{
+    if (us_forward_to_iothread (server))
+        return iothread_post_data (server->iothread, usc, op, data, sz);
 
-    if (usc->status & US_ERR) {
-        purc_log_error ("Error when sending data to client: fd (%d), pid (%d)\n",
-                usc->fd, usc->pid);
+    if (op != US_OPCODE_TEXT && op != US_OPCODE_BIN) {
+        purc_log_warn ("Bad UnixSocket op code for a packet: %d\n", op);
+        free (data);
         return -1;
     }
 
-    return 0;
+    return us_send_frames (server, usc, op, data, sz, true);
 }
 
 int us_remove_dangling_client (USServer *server, USClient *usc)
 {
+    us_detach_rings (server, usc);
+    us_close_fds (usc);
+    us_release_document (usc->doc, usc->len_doc);
+    usc->doc = NULL;
     us_clear_pending_data (usc);
+    free (usc->rbuf);
+    bufpool_free (server->pool, usc->packet);
 
     if (usc->fd >= 0) {
         close (usc->fd);
@@ -809,7 +1677,25 @@ int us_remove_dangling_client (USServer *server, USClient *usc)
 
 int us_cleanup_client (USServer *server, USClient *usc)
 {
-    server->on_close (server, (SockClient *)usc);
+    if (us_forward_to_iothread (server))
+        return iothread_post_request (server->iothread, IOR_CLEANUP, usc,
+                US_OPCODE_CLOSE, NULL, 0);
+
+    us_detach_rings (server, usc);
+    us_close_fds (usc);
+    us_release_document (usc->doc, usc->len_doc);
+    usc->doc = NULL;
+
+    /* a positive return value means the client will be released later */
+    if (server->on_close (server, (SockClient *)usc) > 0) {
+        us_clear_pending_data (usc);
+        if (usc->fd >= 0) {
+            close (usc->fd);
+            usc->fd = -1;
+        }
+        usc->status |= US_CLOSE;
+        return 0;
+    }
 
     return us_remove_dangling_client (server, usc);
 }
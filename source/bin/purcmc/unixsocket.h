@@ -28,6 +28,7 @@
 #include <unistd.h>
 
 #include "utils/list.h"
+#include "shmring.h"
 
 /* The frame operation codes for UnixSocket */
 typedef enum USOpcode_ {
@@ -38,8 +39,67 @@ typedef enum USOpcode_ {
     US_OPCODE_CLOSE = 0x08,
     US_OPCODE_PING = 0x09,
     US_OPCODE_PONG = 0x0A,
+    US_OPCODE_RING = 0x10,
+    US_OPCODE_DOCUMENT = 0x11,
 } USOpcode;
 
+/*
+ * A local client can move the data frames to a pair of rings in shared
+ * memory after it got the feature `unixSocketRing` in the initial response:
+ *
+ *  - The client sends a US_OPCODE_RING frame without payload, along with
+ *    four file descriptors (SCM_RIGHTS): the memfd of the ring from the
+ *    client to the server, the memfd of the ring from the server to the
+ *    client, the eventfd to notify the server, and the eventfd to notify
+ *    the client.
+ *  - The server replies a US_OPCODE_RING frame whose `fragmented` field
+ *    is the status code: PCRDR_SC_OK if the rings are attached. On failure,
+ *    both sides keep using the socket.
+ *  - After the rings attached, the TEXT/BIN packets go through the rings;
+ *    the other frames (PING, PONG, and CLOSE) keep going through the socket.
+ *
+ * In a ring, a frame is stored as a record: the frame header, the payload,
+ * a null byte, and the padding to 8 bytes; the payload of a frame is not
+ * larger than a quarter of the ring.
+ */
+
+/*
+ * A local client can pass a huge document (of `load` or `writeXXX`) in
+ * a sealed memfd instead of the packet after it got the feature
+ * `unixSocketDocument` in the initial response:
+ *
+ *  - The client sends a US_OPCODE_DOCUMENT frame without payload, along
+ *    with the memfd (SCM_RIGHTS) sealed by F_SEAL_SHRINK, F_SEAL_GROW,
+ *    and F_SEAL_WRITE. The `fragmented` field is the length of
+ *    the document, and the memfd must contain a null byte after
+ *    the document.
+ *  - The client then sends the request packet without data; the document
+ *    is used as the data of the request.
+ *
+ * The server does not reply to the US_OPCODE_DOCUMENT frame; a bad memfd
+ * is dropped, so the request gets PCRDR_SC_BAD_REQUEST. A client using
+ * the rings must not pass documents, because the order of the frames
+ * in the rings and the frames in the socket is not kept.
+ */
+
+/* The size of a record for the payload in a ring */
+#define US_RING_RECORD_SIZE(sz_payload) \
+    ((sizeof (USFrameHeader) + (sz_payload) + 1 + 7) & ~((size_t)7))
+
+/* The connection type of the rings of a client; it does not collide
+   with the connection types of PurC */
+#define CT_SHM_RING         0x100
+
+/* The max size of the records queued for the outgoing ring: 8 MiB.
+   A client not consuming the ring is closed instead of queueing more. */
+#define US_RING_MAX_PENDING     (8 * 1024 * 1024)
+
+/* The max length of a document passed in a memfd: 1 GiB */
+#define US_MAX_DOCUMENT_SIZE    (1024 * 1024 * 1024)
+
+/* The max number of file descriptors received for the frames to come */
+#define US_MAX_FDS          8
+
 /* The frame header for UnixSocket */
 typedef struct USFrameHeader_ {
     int op;
@@ -56,6 +116,7 @@ typedef enum USSTATUS {
     US_SENDING = (1 << 3),
     US_THROTTLING = (1 << 4),
     US_WATING_FOR_PAYLOAD = (1 << 5),
+    US_MORE_DATA = (1 << 6),
 } USStatus;
 
 typedef struct USPendingData_ {
@@ -65,7 +126,11 @@ typedef struct USPendingData_ {
     size_t  szdata;
     /* the size of sent */
     size_t  szsent;
-    /* pointer to the pending data */
+    /* pointer to the pending data; points to `data` if copied */
+    unsigned char *ptr;
+    /* the buffer handed over by the caller, freed after sent; nullable */
+    void   *owned;
+    /* the copied pending data */
     unsigned char data[0];
 } USPendingData;
 
@@ -82,6 +147,11 @@ typedef struct USClient_
     pid_t           pid;        /* client PID */
     uid_t           uid;        /* client UID */
 
+    /* handled by the I/O thread; the upper entity must not be touched */
+    int             detached;
+    /* the last time (in seconds) the client got active in the I/O thread */
+    time_t          t_active;
+
     /* fields for pending data to write */
     size_t              sz_pending;
     struct list_head    pending;
@@ -91,14 +161,49 @@ typedef struct USClient_
 
     /* fields for current reading packet */
     int         t_packet;   /* type of packet */
-    int         padding_;
+    uint32_t    sz_left;    /* left size of the payload of current frame */
     uint32_t    sz_packet;  /* total size of current packet */
     uint32_t    sz_read;    /* read size of current packet */
     char*       packet;     /* packet data */
 
+    /* the receive buffer */
+    size_t      sz_rbuf_used;
+    char*       rbuf;
+
+    /* the file descriptors received for the frames to come */
+    int         nr_fds;
+    int         fds[US_MAX_FDS];
+
+    /* the document passed for the next packet; nullable */
+    char*       doc;
+    size_t      len_doc;
+
+    /* the rings in shared memory; nullable */
+    struct USRings_ *rings;
+
 } USClient;
 
+/* The rings in shared memory attached to a UnixSocket Client */
+typedef struct USRings_
+{
+    /* the following two fields are same as struct SockClient_ */
+    int             ct;         /* always be CT_SHM_RING */
+    int             fd;         /* the eventfd to notify the server */
+
+    USClient       *client;
+    int             efd_peer;   /* the eventfd to notify the client */
+
+    struct shm_ring in;         /* from the client to the server */
+    struct shm_ring out;        /* from the server to the client */
+
+    /* the records not put into the outgoing ring yet */
+    size_t              sz_pending;
+    struct list_head    pending;
+} USRings;
+
 struct SockClient_;
+struct IOThread_;
+struct BufPool_;
 
 /* The UnixSocket Server */
 typedef struct USServer_
@@ -108,13 +213,29 @@ typedef struct USServer_
 
     /* Callbacks */
     int (*on_accepted) (void *server, struct SockClient_ *client);
+    /* The body is allocated from `pool`; the callback can take it over
+       by setting the field `packet` of the client to NULL. */
     int (*on_packet) (void *server, struct SockClient_ *client,
             char* body, unsigned int sz_body, int type);
     int (*on_pending) (void *server, struct SockClient_* client);
     int (*on_close) (void *server, struct SockClient_ *client);
     void (*on_error) (void *server, struct SockClient_ *client, int err_code);
 
+    /* Watch (or stop watching) the readability of the eventfd of rings;
+       the rings are refused if it is NULL. */
+    int (*watch_rings) (void *server, USRings *rings, int watch);
+
     const purcmc_server_config* config;
+
+    /* not NULL if the clients are handled by the dedicated I/O thread */
+    struct IOThread_ *iothread;
+
+    /* the pool of the packet buffers, shared with the WebSocket server */
+    struct BufPool_ *pool;
+
+    /* the statistics of sending */
+    unsigned long nr_packets_sent;
+    unsigned long nr_write_calls;
 } USServer;
 
 USServer *us_init (const purcmc_server_config* config);
@@ -124,6 +245,10 @@ void us_stop (USServer *server);
 USClient *us_handle_accept (USServer *server);
 int us_handle_reads (USServer *server, USClient* usc);
 int us_handle_writes (USServer *server, USClient *usc);
+int us_handle_ring_reads (USServer *server, USRings *rings);
+int us_rearm_client (int epollfd, USClient *usc);
+char *us_take_document (USClient *usc, size_t *len);
+void us_release_document (char *doc, size_t len);
 int us_remove_dangling_client (USServer * server, USClient *usc);
 int us_cleanup_client (USServer* server, USClient* usc);
 
@@ -131,6 +256,8 @@ int us_ping_client (USServer* server, USClient* usc);
 int us_close_client (USServer* server, USClient* usc);
 int us_send_packet (USServer* server, USClient* usc,
         USOpcode op, const void *data, unsigned int sz);
+int us_send_packet_owned (USServer* server, USClient* usc,
+        USOpcode op, void *data, unsigned int sz);
 
 #endif /* XGUIPRO_PURCMC_UNIXSOCKET_H */
 
@@ -55,6 +55,7 @@
 
 #include "server.h"
 #include "websocket.h"
+#include "bufpool.h"
 
 /* *INDENT-OFF* */
 
@@ -309,10 +310,10 @@ ws_free_frame (WSClient * client)
 
 /* Free a message structure and its data for the given client. */
 static void
-ws_free_message (WSClient * client)
+ws_free_message (WSServer * server, WSClient * client)
 {
   if (client->message && client->message->payload)
-    free (client->message->payload);
+    bufpool_free (server->pool, client->message->payload);
   if (client->message)
     free (client->message);
   client->message = NULL;
@@ -1704,7 +1705,7 @@ ws_handle_pong (WSServer * server, WSClient * client)
     ws_handle_err (server, client, WS_CLOSE_PROTO_ERR, WS_ERR | WS_CLOSE, NULL);
     return;
   }
-  ws_free_message (client);
+  ws_free_message (server, client);
 }
 
 /* Handle a websocket ping from the client and it attempts to send
@@ -1747,9 +1748,9 @@ ws_handle_ping (WSServer * server, WSClient * client)
 
   /* Resize the current payload (keep an eye on this realloc) */
   newlen = (*msg)->payloadsz - len;
-  tmp = realloc ((*msg)->payload, newlen);
+  tmp = bufpool_realloc (server->pool, (*msg)->payload, newlen);
   if (tmp == NULL && newlen > 0) {
-    free ((*msg)->payload);
+    bufpool_free (server->pool, (*msg)->payload);
     free (buf);
 
     (*msg)->payload = NULL;
@@ -1768,7 +1769,7 @@ ws_handle_ping (WSServer * server, WSClient * client)
   (*msg)->buflen = 0;   /* done with the current frame's payload */
   /* Control frame injected in the middle of a fragmented message. */
   if (!(*msg)->fragmented) {
-    ws_free_message (client);
+    ws_free_message (server, client);
   }
   free (buf);
 }
@@ -1831,7 +1832,7 @@ ws_handle_text_bin (WSServer * server, WSClient * client)
     server->on_packet (server, (SockClient *)client, (*msg)->payload, (*msg)->payloadsz,
             (client->message->opcode == WS_OPCODE_TEXT) ? PT_TEXT : PT_BINARY);
   }
-  ws_free_message (client);
+  ws_free_message (server, client);
 }
 
 /* Depending on the frame opcode, then we take certain decisions. */
@@ -2006,7 +2007,8 @@ ws_get_frm_header (WSServer * server, WSClient *client)
  * On error, 1 is returned.
  * On success, 0 is returned. */
 static int
-ws_realloc_frm_payload (WSClient * client, WSFrame * frm, WSMessage * msg)
+ws_realloc_frm_payload (WSServer * server, WSClient * client, WSFrame * frm,
+    WSMessage * msg)
 {
   char *tmp = NULL;
   uint64_t newlen = 0;
@@ -2014,14 +2016,14 @@ ws_realloc_frm_payload (WSClient * client, WSFrame * frm, WSMessage * msg)
   newlen = msg->payloadsz + frm->payloadlen;
   /* check the maximal size of the message body here. */
   if (newlen >= PCRDR_MAX_INMEM_PAYLOAD_SIZE) {
-    free (msg->payload);
+    bufpool_free (server->pool, msg->payload);
     msg->payload = NULL;
     goto failed;
   }
 
-  tmp = realloc (msg->payload, newlen);
+  tmp = bufpool_realloc (server->pool, msg->payload, newlen);
   if (tmp == NULL && newlen > 0) {
-    free (msg->payload);
+    bufpool_free (server->pool, msg->payload);
     msg->payload = NULL;
     goto failed;
   }
@@ -2059,14 +2061,16 @@ ws_get_frm_payload (WSServer * server, WSClient * client)
   /* message within the same frame */
   if ((*msg)->payload == NULL && (*frm)->payloadlen) {
     size_t sz = (*frm)->payloadlen;
-    (*msg)->payload = calloc (sz, sizeof (char));
+    (*msg)->payload = bufpool_alloc (server->pool, sz);
+    if ((*msg)->payload == NULL)
+      return ws_set_status (client, WS_ERR | WS_CLOSE, 0);
 
     update_upper_entity_stats (client->entity,
               client->sockqueue ? client->sockqueue->qlen : 0, sz);
   }
   /* handle a new frame */
   else if ((*msg)->buflen == 0 && (*frm)->payloadlen) {
-    if (ws_realloc_frm_payload (client, (*frm), (*msg)) == 1)
+    if (ws_realloc_frm_payload (server, client, (*frm), (*msg)) == 1)
       return ws_set_status (client, WS_ERR | WS_CLOSE, 0);
   }
 
@@ -2156,7 +2160,7 @@ ws_cleanup_client (WSServer * server, WSClient * client)
   if (client->status & WS_ERR) {
     ws_clear_queue (client);
     ws_free_frame (client);
-    ws_free_message (client);
+    ws_free_message (server, client);
   }
 
   server->closing = 0;
@@ -242,6 +242,7 @@ typedef struct WSClient_
 } WSClient;
 
 struct SockClient_;
+struct BufPool_;
 
 /* A WebSocket Instance */
 typedef struct WSServer_
@@ -263,6 +264,9 @@ typedef struct WSServer_
 #endif
 
   purcmc_server_config* config;
+
+  /* the pool of the packet buffers, shared with the Unix socket server */
+  struct BufPool_ *pool;
 } WSServer;
 
 size_t pack_uint32 (void *buf, uint32_t val, int convert);
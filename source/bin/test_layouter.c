@@ -29,6 +29,7 @@
 #include "utils/sorted-array.h"
 #include "layouter/layouter.h"
 #include "layouter/dom-ops.h"
+#include "layouter/dom-mirror.h"
 
 #include <purc/purc.h>
 
@@ -234,6 +235,171 @@ static const char *new_page_groups = ""
     "<section id='theModals'>"
     "</section>";
 
+static const char *mirror_chunks[] = {
+    "<html><body>"
+    "<div id='list' hvml-handle='100'>"
+    "<p id='item1' class='item' hvml-handle='101'>one</p>",
+    "</div>"
+    "<div id='status' class='idle' hvml-handle='200'>idle</div>"
+    "</body></html>",
+};
+
+#define NR_MIRROR_CHUNKS    (sizeof(mirror_chunks)/sizeof(mirror_chunks[0]))
+
+/* Check and release the string got from the DOM mirror. */
+static bool variant_is_string(purc_variant_t v, const char *str)
+{
+    const char *s;
+    bool retv;
+
+    if (v == PURC_VARIANT_INVALID)
+        return false;
+
+    s = purc_variant_get_string_const(v);
+    retv = (s && strcmp(s, str) == 0);
+    purc_variant_unref(v);
+    return retv;
+}
+
+static void test_dom_mirror(void)
+{
+    struct dom_mirror *mirror;
+    purc_variant_t v;
+    bool ok;
+
+    int ret = purc_init_ex(PURC_MODULE_VARIANT, "cn.fmsoft.hvml.xguipro",
+            "test_layouter", NULL);
+    assert(ret == PURC_ERROR_OK);
+
+    mirror = dom_mirror_new();
+    assert(mirror);
+
+    /* load: the document is written in chunks */
+    for (size_t i = 0; i < NR_MIRROR_CHUNKS; i++) {
+        ok = dom_mirror_write(mirror, mirror_chunks[i],
+                strlen(mirror_chunks[i]));
+        assert(ok);
+    }
+
+    /* nothing is answered before the document is closed */
+    v = dom_mirror_get_property(mirror, "id", "list", "textContent");
+    assert(v == PURC_VARIANT_INVALID);
+    ok = dom_mirror_update(mirror, PCRDR_OPERATION_ERASE, "id", "list",
+            NULL, NULL, NULL, 0);
+    assert(!ok);
+
+    ok = dom_mirror_close(mirror);
+    assert(ok);
+    ok = dom_mirror_write(mirror, "<p></p>", 7);
+    assert(!ok);
+
+    assert(variant_is_string(dom_mirror_get_property(mirror,
+                    "id", "list", "textContent"), "one"));
+    assert(variant_is_string(dom_mirror_get_property(mirror,
+                    "id", "item1", "className"), "item"));
+    assert(variant_is_string(dom_mirror_get_property(mirror,
+                    "handle", "101", "id"), "item1"));
+    assert(variant_is_string(dom_mirror_get_property(mirror,
+                    "handle", "200", "localName"), "div"));
+    assert(variant_is_string(dom_mirror_get_property(mirror,
+                    "id", "status", "id"), "status"));
+
+    /* the elements not found are left to the page */
+    v = dom_mirror_get_property(mirror, "id", "nothing", "textContent");
+    assert(v == PURC_VARIANT_INVALID);
+    v = dom_mirror_get_property(mirror, "id", "list", "prop.value");
+    assert(v == PURC_VARIANT_INVALID);
+    ok = dom_mirror_update(mirror, PCRDR_OPERATION_ERASE, "id", "nothing",
+            NULL, NULL, NULL, 0);
+    assert(ok);
+
+    /* append HTML: the new element is in the id map and the handle index */
+    static const char *item2 =
+        "<p id='item2' class='item' hvml-handle='102'>two</p>";
+    ok = dom_mirror_update(mirror, PCRDR_OPERATION_APPEND, "id", "list",
+            NULL, "html", item2, strlen(item2));
+    assert(ok);
+    assert(variant_is_string(dom_mirror_get_property(mirror,
+                    "id", "list", "textContent"), "onetwo"));
+    assert(variant_is_string(dom_mirror_get_property(mirror,
+                    "id", "item2", "className"), "item"));
+    assert(variant_is_string(dom_mirror_get_property(mirror,
+                    "handle", "102", "textContent"), "two"));
+
+    /* append plain text */
+    ok = dom_mirror_update(mirror, PCRDR_OPERATION_APPEND, "handle", "102",
+            NULL, "plain", "-2", 2);
+    assert(ok);
+    assert(variant_is_string(dom_mirror_get_property(mirror,
+                    "id", "item2", "textContent"), "two-2"));
+
+    /* displace HTML: the old content is replaced */
+    static const char *busy = "<span id='busy' hvml-handle='201'>busy</span>";
+    ok = dom_mirror_update(mirror, PCRDR_OPERATION_DISPLACE, "id", "status",
+            NULL, "html", busy, strlen(busy));
+    assert(ok);
+    assert(variant_is_string(dom_mirror_get_property(mirror,
+                    "id", "status", "textContent"), "busy"));
+    assert(variant_is_string(dom_mirror_get_property(mirror,
+                    "handle", "201", "id"), "busy"));
+
+    ok = dom_mirror_update(mirror, PCRDR_OPERATION_DISPLACE, "id", "busy",
+            NULL, "html", "done", 4);
+    assert(ok);
+    assert(variant_is_string(dom_mirror_get_property(mirror,
+                    "id", "status", "textContent"), "done"));
+
+    /* update attributes */
+    ok = dom_mirror_update(mirror, PCRDR_OPERATION_UPDATE, "id", "status",
+            "attr.class", NULL, "busy", 4);
+    assert(ok);
+    assert(variant_is_string(dom_mirror_get_property(mirror,
+                    "handle", "200", "className"), "busy"));
+
+    /* erase an element: it is gone from the id map and the handle index,
+       but its siblings are still found */
+    ok = dom_mirror_update(mirror, PCRDR_OPERATION_ERASE, "handle", "101",
+            NULL, NULL, NULL, 0);
+    assert(ok);
+    v = dom_mirror_get_property(mirror, "id", "item1", "textContent");
+    assert(v == PURC_VARIANT_INVALID);
+    v = dom_mirror_get_property(mirror, "handle", "101", "textContent");
+    assert(v == PURC_VARIANT_INVALID);
+    assert(variant_is_string(dom_mirror_get_property(mirror,
+                    "handle", "102", "id"), "item2"));
+    assert(variant_is_string(dom_mirror_get_property(mirror,
+                    "id", "list", "textContent"), "two-2"));
+
+    /* attr.id moves the element in the id map */
+    ok = dom_mirror_update(mirror, PCRDR_OPERATION_UPDATE, "handle", "102",
+            "attr.id", NULL, "second", 6);
+    assert(ok);
+    v = dom_mirror_get_property(mirror, "id", "item2", "textContent");
+    assert(v == PURC_VARIANT_INVALID);
+    assert(variant_is_string(dom_mirror_get_property(mirror,
+                    "id", "second", "className"), "item"));
+    assert(variant_is_string(dom_mirror_get_property(mirror,
+                    "handle", "102", "id"), "second"));
+
+    /* erase with the handles of an element erased and a live one */
+    ok = dom_mirror_update(mirror, PCRDR_OPERATION_ERASE, "handles", "101,102",
+            NULL, NULL, NULL, 0);
+    assert(ok);
+    v = dom_mirror_get_property(mirror, "id", "second", "textContent");
+    assert(v == PURC_VARIANT_INVALID);
+    v = dom_mirror_get_property(mirror, "handle", "102", "textContent");
+    assert(v == PURC_VARIANT_INVALID);
+    assert(variant_is_string(dom_mirror_get_property(mirror,
+                    "id", "list", "textContent"), ""));
+    assert(variant_is_string(dom_mirror_get_property(mirror,
+                    "handle", "100", "id"), "list"));
+
+    dom_mirror_delete(mirror);
+    purc_cleanup();
+
+    purc_log_info("DOM mirror tested\n");
+}
+
 int main(int argc, char *argv[])
 {
     int retv;
@@ -270,16 +436,16 @@ int main(int argc, char *argv[])
     pcdom_element_t *element;
 
     element = dom_get_element_by_id(layouter->dom_doc, "mainHeader");
-    assert(element && has_tag(element, "DIV"));
+    assert(element && has_tag(element, LAYOUT_TAG_DIV));
 
     element = dom_get_element_by_id(layouter->dom_doc, "mainBody");
-    assert(element && has_tag(element, "DIV"));
+    assert(element && has_tag(element, LAYOUT_TAG_DIV));
 
     element = dom_get_element_by_id(layouter->dom_doc, "mainFooter");
-    assert(element && has_tag(element, "DIV"));
+    assert(element && has_tag(element, LAYOUT_TAG_DIV));
 
     element = dom_get_element_by_id(layouter->dom_doc, "viewerBody");
-    assert(element && has_tag(element, "ARTICLE"));
+    assert(element && has_tag(element, LAYOUT_TAG_ARTICLE));
 
     retv = ws_layouter_add_widget_groups(layouter, new_page_groups,
             strlen(new_page_groups));
@@ -287,11 +453,11 @@ int main(int argc, char *argv[])
 
     element = dom_get_element_by_id(layouter->dom_doc, "freeWindows");
     assert(element);
-    assert(has_tag(element, "SECTION"));
+    assert(has_tag(element, LAYOUT_TAG_SECTION));
 
     element = dom_get_element_by_id(layouter->dom_doc, "theModals");
     assert(element);
-    assert(has_tag(element, "SECTION"));
+    assert(has_tag(element, LAYOUT_TAG_SECTION));
 
     retv = ws_layouter_remove_widget_group(layouter, NULL, "freeWindows");
     assert(retv == PCRDR_SC_OK);
@@ -309,13 +475,13 @@ int main(int argc, char *argv[])
     assert(widget != NULL);
 
     element = dom_get_element_by_id(layouter->dom_doc, "theModals-test1");
-    assert(has_tag(element, "FIGURE"));
+    assert(has_tag(element, LAYOUT_TAG_FIGURE));
 
     ws_layouter_add_plain_window(layouter, NULL,
         "theModals", "test2", "main", "this is a test plain window", NULL,
         PURC_VARIANT_INVALID, NULL, &retv);
     element = dom_get_element_by_id(layouter->dom_doc, "theModals-test2");
-    assert(has_tag(element, "FIGURE"));
+    assert(has_tag(element, LAYOUT_TAG_FIGURE));
 
     retv = ws_layouter_remove_plain_window_by_id(layouter, NULL,
             "theModals", "test3");
@@ -384,6 +550,8 @@ int main(int argc, char *argv[])
     }
     sorted_array_destroy(ctxt.sa_widget);
 
+    test_dom_mirror();
+
     purc_log_info("TEST DONE\n");
 
     return 0;
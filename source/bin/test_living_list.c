@@ -0,0 +1,193 @@
+/*
+** test_living_list.c -- The microbenchmark of tracking endpoint liveness.
+**
+** Copyright (C) 2023 FMSoft (http://www.fmsoft.cn)
+**
+** This file is part of xGUI Pro, an advanced HVML renderer.
+**
+** xGUI Pro is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** xGUI Pro is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/.
+*/
+
+/*
+ * The server keeps the authenticated endpoints sorted by living time, and
+ * touches an endpoint whenever a packet comes from it (see
+ * update_endpoint_living_time() in purcmc/server.c). This program
+ * simulates the endpoints touched once per simulated second in a random
+ * order, and compares the cost per touch of the former AVL tree
+ * (delete + insert) with the one of the living list (move to the tail).
+ * It also checks that both keep the endpoints sorted by living time.
+ *
+ * Usage: test_living_list [<number of endpoints> [<number of seconds>]]
+ */
+
+#undef NDEBUG
+
+#include "utils/list.h"
+#include "utils/avl.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <assert.h>
+
+#define DEF_NR_ENDPOINTS    1000
+#define DEF_NR_SECONDS      1000
+
+struct sim_endpoint {
+    time_t t_living;
+
+    struct avl_node avl;
+    struct list_head living;
+};
+
+static int
+comp_living_time(const void *k1, const void *k2, void *ptr)
+{
+    const struct sim_endpoint *e1 = k1;
+    const struct sim_endpoint *e2 = k2;
+
+    (void)ptr;
+    return e1->t_living - e2->t_living;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Fisher-Yates shuffle of the order in which the endpoints are touched */
+static void shuffle(unsigned *order, unsigned n)
+{
+    for (unsigned i = n - 1; i > 0; i--) {
+        unsigned j = (unsigned)(random() % (i + 1));
+        unsigned tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+}
+
+static double bench_avl(struct sim_endpoint *endpoints, unsigned *order,
+        unsigned nr_endpoints, unsigned nr_seconds)
+{
+    struct avl_tree tree;
+    double elapsed = 0;
+
+    avl_init(&tree, comp_living_time, true, NULL);
+    for (unsigned i = 0; i < nr_endpoints; i++) {
+        endpoints[i].t_living = 0;
+        endpoints[i].avl.key = endpoints + i;
+        avl_insert(&tree, &endpoints[i].avl);
+    }
+
+    for (time_t t = 1; t <= (time_t)nr_seconds; t++) {
+        shuffle(order, nr_endpoints);
+
+        double start = now_ns();
+        for (unsigned i = 0; i < nr_endpoints; i++) {
+            struct sim_endpoint *endpoint = endpoints + order[i];
+            if (endpoint->t_living != t) {
+                endpoint->t_living = t;
+                avl_delete(&tree, &endpoint->avl);
+                avl_insert(&tree, &endpoint->avl);
+            }
+        }
+        elapsed += now_ns() - start;
+    }
+
+    struct sim_endpoint *endpoint;
+    time_t last = 0;
+    avl_for_each_element(&tree, endpoint, avl) {
+        assert(endpoint->t_living >= last);
+        last = endpoint->t_living;
+    }
+
+    return elapsed;
+}
+
+static double bench_list(struct sim_endpoint *endpoints, unsigned *order,
+        unsigned nr_endpoints, unsigned nr_seconds)
+{
+    struct list_head living;
+    double elapsed = 0;
+
+    list_head_init(&living);
+    for (unsigned i = 0; i < nr_endpoints; i++) {
+        endpoints[i].t_living = 0;
+        list_add_tail(&endpoints[i].living, &living);
+    }
+
+    for (time_t t = 1; t <= (time_t)nr_seconds; t++) {
+        shuffle(order, nr_endpoints);
+
+        double start = now_ns();
+        for (unsigned i = 0; i < nr_endpoints; i++) {
+            struct sim_endpoint *endpoint = endpoints + order[i];
+            if (endpoint->t_living != t) {
+                endpoint->t_living = t;
+                list_move_tail(&endpoint->living, &living);
+            }
+        }
+        elapsed += now_ns() - start;
+    }
+
+    struct sim_endpoint *endpoint;
+    time_t last = 0;
+    unsigned n = 0;
+    list_for_each_entry(endpoint, &living, living) {
+        assert(endpoint->t_living >= last);
+        last = endpoint->t_living;
+        n++;
+    }
+    assert(n == nr_endpoints);
+
+    return elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned nr_endpoints = DEF_NR_ENDPOINTS;
+    unsigned nr_seconds = DEF_NR_SECONDS;
+
+    if (argc > 1)
+        nr_endpoints = (unsigned)strtoul(argv[1], NULL, 10);
+    if (argc > 2)
+        nr_seconds = (unsigned)strtoul(argv[2], NULL, 10);
+    if (nr_endpoints == 0 || nr_seconds == 0) {
+        fprintf(stderr, "Usage: %s [<endpoints> [<seconds>]]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    struct sim_endpoint *endpoints = calloc(nr_endpoints, sizeof(*endpoints));
+    unsigned *order = calloc(nr_endpoints, sizeof(*order));
+    assert(endpoints && order);
+    for (unsigned i = 0; i < nr_endpoints; i++)
+        order[i] = i;
+
+    double nr_touches = (double)nr_endpoints * nr_seconds;
+
+    srandom(1);
+    double avl_ns = bench_avl(endpoints, order, nr_endpoints, nr_seconds);
+    srandom(1);
+    double list_ns = bench_list(endpoints, order, nr_endpoints, nr_seconds);
+
+    printf("%u endpoints touched once per second for %u seconds:\n",
+            nr_endpoints, nr_seconds);
+    printf("  AVL delete + insert: %8.1f ns/touch\n", avl_ns / nr_touches);
+    printf("  list_move_tail():    %8.1f ns/touch\n", list_ns / nr_touches);
+
+    free(order);
+    free(endpoints);
+    return EXIT_SUCCESS;
+}
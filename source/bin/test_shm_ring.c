@@ -0,0 +1,245 @@
+/*
+** test_shm_ring.c -- The test of sending packets through a shared-memory ring.
+**
+** Copyright (C) 2023 FMSoft (http://www.fmsoft.cn)
+**
+** This file is part of xGUI Pro, an advanced HVML renderer.
+**
+** xGUI Pro is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** xGUI Pro is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+** You should have received a copy of the GNU General Public License
+** along with this program.  If not, see http://www.gnu.org/licenses/.
+*/
+
+/*
+ * This program attaches a pair of rings to a fake UnixSocket client, and
+ * sends packets through the outgoing ring:
+ *
+ *  - with a reader consuming the ring late, the records queued are put
+ *    into the ring in order, and the memory used is reported to the upper
+ *    entity;
+ *  - with a reader never consuming the ring, the sending fails once
+ *    US_RING_MAX_PENDING bytes are queued, and the client is cleaned up.
+ */
+
+#undef NDEBUG
+#define _GNU_SOURCE
+
+#include "purcmc/server.h"
+#include "purcmc/unixsocket.h"
+
+#include <purc/purc.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <assert.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+
+#define RING_ORDER      SHM_RING_MIN_ORDER
+#define SZ_PACKET       4000
+
+static int nr_closed;
+
+static int on_close(void *server, SockClient *client)
+{
+    (void)server;
+    (void)client;
+    nr_closed++;
+    return 0;
+}
+
+static void on_error(void *server, SockClient *client, int err_code)
+{
+    (void)server;
+    (void)client;
+    (void)err_code;
+}
+
+/* Create a ring as a client does, and map it for the server. */
+static void make_ring(struct shm_ring *ring)
+{
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t size = page_size + ((size_t)1 << RING_ORDER);
+    struct shm_ring_header *hdr;
+    int fd;
+
+    fd = memfd_create("test-shm-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    assert(fd >= 0);
+    assert(ftruncate(fd, size) == 0);
+
+    hdr = mmap(NULL, page_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    assert(hdr != MAP_FAILED);
+    hdr->magic = SHM_RING_MAGIC;
+    hdr->order = RING_ORDER;
+    munmap(hdr, page_size);
+
+    assert(fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW) == 0);
+    assert(shm_ring_map(ring, fd) == 0);
+    close(fd);
+}
+
+static USClient *make_client(USServer *server, UpperEntity *entity)
+{
+    USClient *usc = calloc(1, sizeof(USClient));
+    USRings *rings = calloc(1, sizeof(USRings));
+    assert(usc && rings);
+
+    usc->ct = CT_UNIX_SOCKET;
+    usc->fd = -1;
+    usc->pid = getpid();
+    usc->entity = entity;
+    list_head_init(&usc->pending);
+
+    rings->ct = CT_SHM_RING;
+    rings->client = usc;
+    rings->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    rings->efd_peer = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    assert(rings->fd >= 0 && rings->efd_peer >= 0);
+    list_head_init(&rings->pending);
+    make_ring(&rings->in);
+    make_ring(&rings->out);
+
+    usc->rings = rings;
+    server->nr_clients++;
+    return usc;
+}
+
+static int send_packet(USServer *server, USClient *usc, unsigned seq)
+{
+    char packet[SZ_PACKET];
+
+    memset(packet, (int)(seq & 0xFF), sizeof(packet));
+    return us_send_packet(server, usc, US_OPCODE_TEXT, packet, sizeof(packet));
+}
+
+/* Consume the records in the ring; returns the number of records. */
+static unsigned consume_ring(struct shm_ring *ring, unsigned *seq)
+{
+    size_t sz_record = US_RING_RECORD_SIZE(SZ_PACKET);
+    unsigned nr = 0;
+    char *data;
+
+    while (shm_ring_readable(ring, &data) >= sz_record) {
+        USFrameHeader *header = (USFrameHeader *)data;
+
+        assert(header->op == US_OPCODE_TEXT);
+        assert(header->fragmented == 0);
+        assert(header->sz_payload == SZ_PACKET);
+        assert(header->payload[0] == (*seq & 0xFF));
+        assert(header->payload[SZ_PACKET - 1] == (*seq & 0xFF));
+        assert(header->payload[SZ_PACKET] == 0);
+
+        shm_ring_consume(ring, sz_record);
+        (*seq)++;
+        nr++;
+    }
+
+    return nr;
+}
+
+/* The reader consumes the ring after the records queued up. */
+static void test_late_reader(USServer *server)
+{
+    UpperEntity entity = { };
+    USClient *usc = make_client(server, &entity);
+    USRings *rings = usc->rings;
+    unsigned nr_sent, nr_read = 0, seq = 0;
+
+    for (nr_sent = 0; rings->sz_pending < SOCK_THROTTLE_THLD; nr_sent++) {
+        assert(send_packet(server, usc, nr_sent) == 0);
+        assert(entity.sz_sock_mem == rings->sz_pending);
+    }
+
+    assert(atomic_load(&rings->out.hdr->need_space));
+    assert(entity.peak_sz_sock_mem >= SOCK_THROTTLE_THLD);
+
+    /* the throttled client drains the ring before the next packet */
+    nr_read += consume_ring(&rings->out, &seq);
+    assert(send_packet(server, usc, nr_sent++) == 0);
+    assert(rings->sz_pending < SOCK_THROTTLE_THLD);
+    assert(entity.sz_sock_mem == rings->sz_pending);
+
+    while (nr_read < nr_sent) {
+        unsigned nr = consume_ring(&rings->out, &seq);
+        assert(nr > 0);
+        nr_read += nr;
+
+        /* the notification from the client after consumed the ring */
+        uint64_t one = 1;
+        assert(write(rings->fd, &one, sizeof(one)) == sizeof(one));
+        assert(us_handle_ring_reads(server, rings) == 0);
+        assert(entity.sz_sock_mem == rings->sz_pending);
+    }
+
+    assert(rings->sz_pending == 0);
+    assert(list_empty(&rings->pending));
+    assert(entity.sz_sock_mem == 0);
+    assert(!(usc->status & US_ERR));
+
+    printf("Late reader: %u packets, peak %zu bytes pending\n",
+            nr_sent, entity.peak_sz_sock_mem);
+
+    us_cleanup_client(server, usc);
+}
+
+/* The reader never consumes the ring. */
+static void test_stuck_reader(USServer *server)
+{
+    UpperEntity entity = { };
+    USClient *usc = make_client(server, &entity);
+    USRings *rings = usc->rings;
+    size_t sz_record = US_RING_RECORD_SIZE(SZ_PACKET);
+    unsigned nr_sent, max_sent;
+    int closed = nr_closed;
+
+    max_sent = (US_RING_MAX_PENDING + rings->out.size) / sz_record + 1;
+    for (nr_sent = 0; nr_sent <= max_sent; nr_sent++) {
+        if (send_packet(server, usc, nr_sent))
+            break;
+
+        assert(entity.sz_sock_mem == rings->sz_pending);
+    }
+
+    /* the queued records stop growing at the cap */
+    assert(nr_sent <= max_sent);
+    assert(rings->sz_pending >= US_RING_MAX_PENDING);
+    assert(rings->sz_pending < US_RING_MAX_PENDING + sz_record);
+    assert(usc->status & US_ERR);
+
+    printf("Stuck reader: refused the packet #%u, %zu bytes pending\n",
+            nr_sent, rings->sz_pending);
+
+    /* the owner cleans up the client when it gets the rings readable */
+    assert(us_handle_ring_reads(server, rings) != 0);
+    assert(nr_closed == closed + 1);
+}
+
+int main(void)
+{
+    USServer *server = us_init(NULL);
+    assert(server);
+
+    server->on_close = on_close;
+    server->on_error = on_error;
+
+    test_late_reader(server);
+    test_stuck_reader(server);
+
+    assert(server->nr_clients == 0);
+    assert(nr_closed == 2);
+    free(server);
+
+    printf("TEST DONE\n");
+    return 0;
+}
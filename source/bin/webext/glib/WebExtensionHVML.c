@@ -20,7 +20,14 @@
 ** along with this program.  If not, see http://www.gnu.org/licenses/.
 */
 
+#define _GNU_SOURCE
 #include <webkit2/webkit-web-extension.h>
+#include <gio/gunixfdlist.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "xguipro-version.h"
 #include "xguipro-features.h"
@@ -29,6 +36,7 @@
 #include "utils/load-asset.h"
 
 #include "webext/log.h"
+#include "webext/hvml-js.h"
 
 struct HVMLInfo {
     const char* vendor;
@@ -179,8 +187,6 @@ static void destroyed_notify(WebKitWebPage* web_page)
             free(info->appName);
         if (info->runnerName)
             free(info->runnerName);
-        if (info->runnerName)
-            free(info->runnerName);
         if (info->groupName)
             free(info->groupName);
         if (info->pageName)
@@ -265,9 +271,40 @@ console_message_sent_callback(WebKitWebPage *web_page,
             webkit_console_message_get_line(console_message));
 }
 
-#define PAGE_READY_FORMAT  "{"      \
-        "\"requestId\":\"%s\","     \
-        "\"state\":\"Ok\"}"
+/*
+ * hvml.js is minified and embedded at build time (see EmbedAsset.cmake).
+ * When the environment variable WEBKIT_WEBEXT_DIR is set for development,
+ * the one in the assets directory is used instead. Either is got once
+ * per web process.
+ */
+static const char *get_hvml_js(void)
+{
+    static const char *code;
+
+    if (code == NULL) {
+        if (g_getenv("WEBKIT_WEBEXT_DIR"))
+            code = load_asset_content("WEBKIT_WEBEXT_DIR", WEBKIT_WEBEXT_DIR,
+                    "assets/hvml.js", NULL, 0);
+        if (code == NULL)
+            code = hvml_js_code;
+    }
+
+    return code;
+}
+
+static void send_page_ready(WebKitWebPage *web_page, const char *request_id)
+{
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_add(&builder, "{sv}", "requestId",
+            g_variant_new_string(request_id));
+    g_variant_builder_add(&builder, "{sv}", "state",
+            g_variant_new_string("Ok"));
+    WebKitUserMessage * message = webkit_user_message_new("page-ready",
+            g_variant_builder_end(&builder));
+    webkit_web_page_send_message_to_view(web_page, message,
+            NULL, NULL, NULL);
+}
 
 static void
 document_loaded_callback(WebKitWebPage *web_page, gpointer user_data)
@@ -289,8 +326,7 @@ document_loaded_callback(WebKitWebPage *web_page, gpointer user_data)
     LOG_DEBUG("injecting hvml.js to page (%p)\n", web_page);
 
     /* inject hvml.js */
-    char *code = load_asset_content("WEBKIT_WEBEXT_DIR", WEBKIT_WEBEXT_DIR,
-            "assets/hvml.js", NULL, 0);
+    const char *code = get_hvml_js();
 
     if (code) {
         WebKitFrame *frame;
@@ -303,20 +339,13 @@ document_loaded_callback(WebKitWebPage *web_page, gpointer user_data)
         JSCValue *result;
         result = jsc_context_evaluate_with_source_uri(context, code, -1,
                 webkit_web_page_get_uri(web_page), 1);
-        free(code);
 
         char *json = jsc_value_to_json(result, 0);
         LOG_DEBUG("result of injected script: (%s)\n", json);
         if (json)
             free(json);
 
-        json = g_strdup_printf(PAGE_READY_FORMAT, request_id);
-        WebKitUserMessage * message = webkit_user_message_new("page-ready",
-                g_variant_new_string(json));
-        webkit_web_page_send_message_to_view(web_page, message,
-                NULL, NULL, NULL);
-        free(json);
-
+        send_page_ready(web_page, request_id);
         g_object_set_data(G_OBJECT(web_page), "hvml-js-injected", web_page);
     }
     else {
@@ -324,6 +353,295 @@ document_loaded_callback(WebKitWebPage *web_page, gpointer user_data)
     }
 }
 
+/*
+ * The requests from the renderer are dictionaries (a{sv}) of the same
+ * shape as the JSON ones, and they are passed to the handler as JS objects
+ * without JSON. The replies to them go back in the same way. A request
+ * in a JSON string is still accepted and answered in a JSON string.
+ */
+
+/* the containers nested deeper are converted to null */
+#define MAX_DEPTH       64
+
+static JSCValue *jsc_value_from_gvariant(JSCContext *context,
+        GVariant *gv, int depth)
+{
+    JSCValue *value = NULL;
+
+    if (depth >= MAX_DEPTH)
+        return jsc_value_new_null(context);
+
+    switch (g_variant_classify(gv)) {
+    case G_VARIANT_CLASS_BOOLEAN:
+        return jsc_value_new_boolean(context, g_variant_get_boolean(gv));
+    case G_VARIANT_CLASS_BYTE:
+        return jsc_value_new_number(context, g_variant_get_byte(gv));
+    case G_VARIANT_CLASS_INT16:
+        return jsc_value_new_number(context, g_variant_get_int16(gv));
+    case G_VARIANT_CLASS_UINT16:
+        return jsc_value_new_number(context, g_variant_get_uint16(gv));
+    case G_VARIANT_CLASS_INT32:
+        return jsc_value_new_number(context, g_variant_get_int32(gv));
+    case G_VARIANT_CLASS_UINT32:
+        return jsc_value_new_number(context, g_variant_get_uint32(gv));
+    case G_VARIANT_CLASS_INT64:
+        return jsc_value_new_number(context, g_variant_get_int64(gv));
+    case G_VARIANT_CLASS_UINT64:
+        return jsc_value_new_number(context, g_variant_get_uint64(gv));
+    case G_VARIANT_CLASS_DOUBLE:
+        return jsc_value_new_number(context, g_variant_get_double(gv));
+
+    case G_VARIANT_CLASS_STRING:
+        return jsc_value_new_string(context, g_variant_get_string(gv, NULL));
+
+    case G_VARIANT_CLASS_VARIANT: {
+        GVariant *inner = g_variant_get_variant(gv);
+        value = jsc_value_from_gvariant(context, inner, depth + 1);
+        g_variant_unref(inner);
+        return value;
+    }
+
+    case G_VARIANT_CLASS_MAYBE: {
+        GVariant *inner = g_variant_get_maybe(gv);
+        if (inner == NULL)
+            return jsc_value_new_null(context);
+
+        value = jsc_value_from_gvariant(context, inner, depth + 1);
+        g_variant_unref(inner);
+        return value;
+    }
+
+    case G_VARIANT_CLASS_ARRAY:
+        if (g_variant_is_of_type(gv, G_VARIANT_TYPE_VARDICT)) {
+            GVariantIter iter;
+            const char *key;
+            GVariant *item;
+
+            value = jsc_value_new_object(context, NULL, NULL);
+            g_variant_iter_init(&iter, gv);
+            while (g_variant_iter_next(&iter, "{&sv}", &key, &item)) {
+                JSCValue *member;
+                member = jsc_value_from_gvariant(context, item, depth + 1);
+                jsc_value_object_set_property(value, key, member);
+                g_object_unref(member);
+                g_variant_unref(item);
+            }
+            return value;
+        }
+        else if (!g_variant_type_is_dict_entry(
+                    g_variant_type_element(g_variant_get_type(gv)))) {
+            GVariantIter iter;
+            GVariant *item;
+            guint i = 0;
+
+            value = jsc_value_new_array(context, G_TYPE_NONE);
+            g_variant_iter_init(&iter, gv);
+            while ((item = g_variant_iter_next_value(&iter))) {
+                JSCValue *member;
+                member = jsc_value_from_gvariant(context, item, depth + 1);
+                jsc_value_object_set_property_at_index(value, i++, member);
+                g_object_unref(member);
+                g_variant_unref(item);
+            }
+            return value;
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    return jsc_value_new_null(context);
+}
+
+static GVariant *gvariant_from_jsc_value(JSCValue *value, int depth)
+{
+    if (depth >= MAX_DEPTH || jsc_value_is_undefined(value) ||
+            jsc_value_is_null(value) || jsc_value_is_function(value)) {
+        return g_variant_new_maybe(G_VARIANT_TYPE_VARIANT, NULL);
+    }
+    else if (jsc_value_is_boolean(value)) {
+        return g_variant_new_boolean(jsc_value_to_boolean(value));
+    }
+    else if (jsc_value_is_number(value)) {
+        return g_variant_new_double(jsc_value_to_double(value));
+    }
+    else if (jsc_value_is_string(value)) {
+        return g_variant_new_take_string(jsc_value_to_string(value));
+    }
+    else if (jsc_value_is_array(value)) {
+        GVariantBuilder builder;
+        JSCValue *length = jsc_value_object_get_property(value, "length");
+        gint32 n = jsc_value_to_int32(length);
+        g_object_unref(length);
+
+        g_variant_builder_init(&builder, G_VARIANT_TYPE("av"));
+        for (gint32 i = 0; i < n; i++) {
+            JSCValue *item = jsc_value_object_get_property_at_index(value, i);
+            g_variant_builder_add(&builder, "v",
+                    gvariant_from_jsc_value(item, depth + 1));
+            g_object_unref(item);
+        }
+        return g_variant_builder_end(&builder);
+    }
+
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
+
+    gchar **keys = jsc_value_object_enumerate_properties(value);
+    for (gchar **key = keys; key && *key; key++) {
+        JSCValue *member = jsc_value_object_get_property(value, *key);
+        /* like JSON, skip the members which are undefined or functions */
+        if (!jsc_value_is_undefined(member) &&
+                !jsc_value_is_function(member)) {
+            g_variant_builder_add(&builder, "{sv}", *key,
+                    gvariant_from_jsc_value(member, depth + 1));
+        }
+        g_object_unref(member);
+    }
+    g_strfreev(keys);
+
+    return g_variant_builder_end(&builder);
+}
+
+/*
+ * A large content comes in a sealed memfd passed along with the message:
+ * the request has the members `dataFd` and `dataLength` instead of `data`.
+ * Map the memfd and make the member `data` of the request object from it.
+ */
+static void set_data_from_memfd(JSCValue *request, GVariant *param,
+        WebKitUserMessage *message)
+{
+    gint32 handle;
+    guint64 length;
+
+    if (!g_variant_lookup(param, "dataFd", "h", &handle) ||
+            !g_variant_lookup(param, "dataLength", "t", &length))
+        return;
+
+    GUnixFDList *fds = webkit_user_message_get_fd_list(message);
+    if (fds == NULL || length == 0) {
+        LOG_ERROR("No memfd for the content of the request\n");
+        return;
+    }
+
+    int fd = g_unix_fd_list_get(fds, handle, NULL);
+    if (fd < 0) {
+        LOG_ERROR("Bad handle of the memfd: %d\n", handle);
+        return;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) || (guint64)st.st_size < length) {
+        LOG_ERROR("Bad size of the memfd for the content\n");
+        close(fd);
+        return;
+    }
+
+#ifdef F_GET_SEALS
+    /* a peer shrinking the memfd would crash us with SIGBUS */
+    int seals = fcntl(fd, F_GET_SEALS);
+    if (seals < 0 || !(seals & F_SEAL_SHRINK)) {
+        LOG_ERROR("The memfd for the content is not sealed\n");
+        close(fd);
+        return;
+    }
+#endif
+
+    void *addr = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        LOG_ERROR("Failed to map the memfd for the content\n");
+        return;
+    }
+
+    /* JSC copies the content into the string */
+    JSCContext *context = jsc_value_get_context(request);
+    JSCValue *data;
+    if (g_utf8_validate(addr, length, NULL)) {
+        GBytes *bytes = g_bytes_new_static(addr, length);
+        data = jsc_value_new_string_from_bytes(context, bytes);
+        g_bytes_unref(bytes);
+    }
+    else {
+        gchar *valid = g_utf8_make_valid(addr, length);
+        data = jsc_value_new_string(context, valid);
+        g_free(valid);
+    }
+    munmap(addr, length);
+
+    jsc_value_object_set_property(request, "data", data);
+    g_object_unref(data);
+}
+
+/*
+ * The renderer prewarms pages with a blank HVML page. When it takes one
+ * for a new page, it sends the message `bind` with the HVML URI of the
+ * new page instead of loading the URI: the HVML instance and the URL of
+ * the document are updated, and the page is ready at once.
+ */
+static void bind_hvml_instance(WebKitWebPage *web_page,
+        struct HVMLInfo *info, WebKitUserMessage *message)
+{
+    GVariant *param = webkit_user_message_get_parameters(message);
+    const char *uri = NULL;
+
+    if (param == NULL || !g_variant_is_of_type(param, G_VARIANT_TYPE_VARDICT)
+            || !g_variant_lookup(param, "uri", "&s", &uri)) {
+        LOG_ERROR("No URI to bind the page to\n");
+        return;
+    }
+
+    char *host = NULL, *app = NULL, *runner = NULL, *group = NULL, *page = NULL;
+    char *request_id = NULL;
+    if (!hvml_uri_split_alloc(uri, &host, &app, &runner, &group, &page) ||
+            !hvml_uri_get_query_value_alloc(uri, "irId", &request_id)) {
+        if (host) free(host);
+        if (app) free(app);
+        if (runner) free(runner);
+        if (group) free(group);
+        if (page) free(page);
+        if (request_id) free(request_id);
+
+        LOG_ERROR("Failed to split HVML URI to bind: %s\n", uri);
+        return;
+    }
+
+    free(info->hostName);
+    free(info->appName);
+    free(info->runnerName);
+    free(info->groupName);
+    free(info->pageName);
+    free(info->requestId);
+    info->hostName = host;
+    info->appName = app;
+    info->runnerName = runner;
+    info->groupName = group;
+    info->pageName = page;
+    info->requestId = request_id;
+
+    /* the URIs of the prewarmed page and the new page have the same origin */
+    JSCContext *context = webkit_frame_get_js_context_for_script_world(
+            webkit_web_page_get_main_frame(web_page),
+            webkit_script_world_get_default());
+    JSCValue *history = jsc_context_get_value(context, "history");
+    JSCValue *state = jsc_value_new_null(context);
+    JSCValue *result = jsc_value_object_invoke_method(history, "replaceState",
+            JSC_TYPE_VALUE, state, G_TYPE_STRING, "", G_TYPE_STRING, uri,
+            G_TYPE_NONE);
+    if (jsc_context_get_exception(context)) {
+        LOG_WARN("Failed to replace the URL of the page: %s\n",
+                jsc_exception_get_message(
+                    jsc_context_get_exception(context)));
+        jsc_context_clear_exception(context);
+    }
+    g_object_unref(result);
+    g_object_unref(state);
+    g_object_unref(history);
+
+    send_page_ready(web_page, request_id);
+}
+
 static gboolean
 user_message_received_callback(WebKitWebPage *web_page,
         WebKitUserMessage *message, gpointer userData)
@@ -336,7 +654,11 @@ user_message_received_callback(WebKitWebPage *web_page,
     LOG_DEBUG("Got a message with name (%s)\n", name);
 
     JSCValue *handler = NULL;
-    if (strcmp(name, "request") == 0) {
+    if (strcmp(name, "bind") == 0) {
+        bind_hvml_instance(web_page, info, message);
+        return TRUE;
+    }
+    else if (strcmp(name, "request") == 0) {
         handler = info->onrequest;
     }
     else if (strcmp(name, "response") == 0) {
@@ -357,25 +679,41 @@ user_message_received_callback(WebKitWebPage *web_page,
     }
 
     GVariant *param = webkit_user_message_get_parameters(message);
-    const char* type = g_variant_get_type_string(param);
-    if (strcmp(type, "s")) {
-        LOG_ERROR("the parameter of the message is not a string (%s)\n", type);
+    if (param == NULL) {
+        LOG_ERROR("No parameter in the message (%s)\n", name);
         return FALSE;
     }
 
-    JSCValue *result = jsc_value_function_call(handler,
-            G_TYPE_STRING, g_variant_get_string(param, NULL),
-            G_TYPE_NONE);
+    JSCValue *result;
+    if (g_variant_is_of_type(param, G_VARIANT_TYPE_STRING)) {
+        result = jsc_value_function_call(handler,
+                G_TYPE_STRING, g_variant_get_string(param, NULL),
+                G_TYPE_NONE);
+
+        char *result_in_json = jsc_value_to_json(result, 0);
+        LOG_DEBUG("result of onrequest: (%s)\n", result_in_json);
+        if (result_in_json) {
+            webkit_user_message_send_reply(message,
+                    webkit_user_message_new(name,
+                        g_variant_new_string(result_in_json)));
+            free(result_in_json);
+        }
+    }
+    else {
+        JSCValue *arg = jsc_value_from_gvariant(
+                jsc_value_get_context(handler), param, 0);
+        if (g_variant_is_of_type(param, G_VARIANT_TYPE_VARDICT))
+            set_data_from_memfd(arg, param, message);
+        result = jsc_value_function_call(handler,
+                JSC_TYPE_VALUE, arg, G_TYPE_NONE);
+        g_object_unref(arg);
 
-    char *result_in_json = jsc_value_to_json(result, 0);
-    LOG_DEBUG("result of onrequest: (%s)\n", result_in_json);
-    if (result_in_json) {
         webkit_user_message_send_reply(message,
                 webkit_user_message_new(name,
-                    g_variant_new_string(result_in_json)));
-        free(result_in_json);
+                    gvariant_from_jsc_value(result, 0)));
     }
 
+    g_object_unref(result);
     return TRUE;
 }
 
@@ -466,6 +804,9 @@ webkit_web_extension_initialize_with_user_data(WebKitWebExtension *extension,
         }
     }
 
+    /* off the critical path of the first page */
+    get_hvml_js();
+
     g_signal_connect(extension, "page-created",
             G_CALLBACK(web_page_created_callback),
             NULL);
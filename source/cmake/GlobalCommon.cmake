@@ -26,6 +26,9 @@ if (NOT HAS_RUN_XGUIPRO_COMMON)
     find_package(PythonInterp 2.7.0)
     find_package(Python3 COMPONENTS Interpreter)
 
+    # Generate the perfect hash tables of the keywords
+    find_package(Gperf REQUIRED)
+
     # -----------------------------------------------------------------------------
     # Helper macros and feature defines
     # -----------------------------------------------------------------------------
@@ -113,10 +113,34 @@ out:
 #endif
 
 #include <sys/mman.h>
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+void *cbuf_map(int fd, off_t offset, unsigned int order)
+{
+    unsigned long size = cbuf_size(order);
+    char *ret;
+
+    ret = mmap(NULL, size * 2, PROT_NONE, MAP_ANON | MAP_PRIVATE, -1, 0);
+    if (ret == MAP_FAILED)
+        return NULL;
+
+    if (mmap(ret, size, PROT_READ | PROT_WRITE, MAP_FIXED | MAP_SHARED,
+         fd, offset) != ret ||
+        mmap(ret + size, size, PROT_READ | PROT_WRITE,
+         MAP_FIXED | MAP_SHARED, fd, offset) != ret + size) {
+        munmap(ret, size * 2);
+        ret = NULL;
+    }
+
+    return ret;
+}
+
 void *cbuf_alloc(unsigned int order)
 {
     char path[] = "/tmp/cbuf-XXXXXX";
-    unsigned long size = cbuf_size(order);
     char *ret = NULL;
     int fd;
 
@@ -130,23 +154,7 @@ void *cbuf_alloc(unsigned int order)
     if (ftruncate(fd, cbuf_size(order)))
         goto close;
 
-#ifndef MAP_ANONYMOUS
-#define MAP_ANONYMOUS MAP_ANON
-#endif
-
-    ret = mmap(NULL, size * 2, PROT_NONE, MAP_ANON | MAP_PRIVATE, -1, 0);
-    if (ret == MAP_FAILED) {
-        ret = NULL;
-        goto close;
-    }
-
-    if (mmap(ret, size, PROT_READ | PROT_WRITE, MAP_FIXED | MAP_SHARED,
-         fd, 0) != ret ||
-        mmap(ret + size, size, PROT_READ | PROT_WRITE,
-         MAP_FIXED | MAP_SHARED, fd, 0) != ret + size) {
-        munmap(ret, size * 2);
-        ret = NULL;
-    }
+    ret = cbuf_map(fd, 0, order);
 
 close:
     close(fd);
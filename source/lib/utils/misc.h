@@ -282,6 +282,10 @@ extern "C" {
 #endif
 
 void *cbuf_alloc(unsigned int order);
+
+/* Map the area [offset, offset + cbuf_size(order)) of a file twice
+   contiguously, like cbuf_alloc() does; freed by cbuf_free(). */
+void *cbuf_map(int fd, off_t offset, unsigned int order);
 void cbuf_free(void *ptr, unsigned int order);
 
 /* hex must be long enough to hold the heximal characters */
@@ -0,0 +1,123 @@
+/*
+ * timer-wheel - a simple hierarchical timer wheel.
+ *
+ * Copyright (C) 2022 FMSoft <https://www.fmsoft.cn>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "timer-wheel.h"
+
+void timer_wheel_init(struct timer_wheel *tw, uint64_t now)
+{
+    int level, slot;
+
+    tw->now = now;
+    for (level = 0; level < TW_NR_LEVELS; level++) {
+        for (slot = 0; slot < TW_LEVEL_SIZE; slot++) {
+            list_head_init(&tw->slots[level][slot]);
+        }
+    }
+}
+
+/*
+ * A timer which expires in 64^(L+1) ticks goes to the level L, in the slot
+ * indexed by the L-th group of bits of the expiring tick. The slots of
+ * upper levels are cascaded to the lower levels when the wheel wraps.
+ */
+static void
+insert_timer(struct timer_wheel *tw, struct tw_timer *timer)
+{
+    uint64_t delta;
+    int level, shift;
+
+    if (timer->expires < tw->now)
+        timer->expires = tw->now;
+
+    delta = timer->expires - tw->now;
+    if (delta >= TW_MAX_TICKS) {
+        timer->expires = tw->now + TW_MAX_TICKS - 1;
+        delta = TW_MAX_TICKS - 1;
+    }
+
+    for (level = 0; level < TW_NR_LEVELS - 1; level++) {
+        if (delta < ((uint64_t)1 << (TW_LEVEL_BITS * (level + 1))))
+            break;
+    }
+
+    shift = TW_LEVEL_BITS * level;
+    list_add_tail(&timer->list,
+            &tw->slots[level][(timer->expires >> shift) & TW_LEVEL_MASK]);
+}
+
+void timer_wheel_add(struct timer_wheel *tw, struct tw_timer *timer,
+        uint64_t expires)
+{
+    list_del_init(&timer->list);
+    timer->expires = expires;
+    insert_timer(tw, timer);
+}
+
+/* move the timers in the current slot of the level to the lower levels */
+static int
+cascade(struct timer_wheel *tw, int level)
+{
+    int slot = (tw->now >> (TW_LEVEL_BITS * level)) & TW_LEVEL_MASK;
+    struct list_head *head = &tw->slots[level][slot];
+    struct list_head list;
+
+    list_head_init(&list);
+    list_splice_init(head, &list);
+    while (!list_empty(&list)) {
+        struct tw_timer *timer;
+
+        timer = list_first_entry(&list, struct tw_timer, list);
+        list_del_init(&timer->list);
+        insert_timer(tw, timer);
+    }
+
+    return slot;
+}
+
+unsigned int timer_wheel_advance(struct timer_wheel *tw, uint64_t now)
+{
+    unsigned int nr_fired = 0;
+
+    while (tw->now <= now) {
+        int level, slot = tw->now & TW_LEVEL_MASK;
+        struct list_head *head;
+
+        for (level = 1; slot == 0 && level < TW_NR_LEVELS; level++) {
+            slot = cascade(tw, level);
+        }
+
+        /* the callback may re-arm the timer or arm other timers */
+        head = &tw->slots[0][tw->now & TW_LEVEL_MASK];
+        while (!list_empty(head)) {
+            struct tw_timer *timer;
+
+            timer = list_first_entry(head, struct tw_timer, list);
+            list_del_init(&timer->list);
+            assert(timer->expires <= tw->now);
+            timer->cb(timer);
+            nr_fired++;
+        }
+
+        tw->now++;
+    }
+
+    return nr_fired;
+}
@@ -0,0 +1,90 @@
+/*
+ * timer-wheel - a simple hierarchical timer wheel.
+ *
+ * Copyright (C) 2022 FMSoft <https://www.fmsoft.cn>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#ifndef __LIB_UTILS_TIMER_WHEEL_H
+#define __LIB_UTILS_TIMER_WHEEL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "list.h"
+
+/* each level has 64 slots; four levels cover 2^24 ticks */
+#define TW_LEVEL_BITS       6
+#define TW_LEVEL_SIZE       (1 << TW_LEVEL_BITS)
+#define TW_LEVEL_MASK       (TW_LEVEL_SIZE - 1)
+#define TW_NR_LEVELS        4
+#define TW_MAX_TICKS        ((uint64_t)1 << (TW_LEVEL_BITS * TW_NR_LEVELS))
+
+struct tw_timer;
+
+typedef void (*tw_timer_cb)(struct tw_timer *timer);
+
+/* embed this structure in the object to be timed */
+struct tw_timer {
+    struct list_head list;
+    uint64_t expires;
+    tw_timer_cb cb;
+};
+
+struct timer_wheel {
+    /* the next tick to be processed */
+    uint64_t now;
+    struct list_head slots[TW_NR_LEVELS][TW_LEVEL_SIZE];
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* initialize a timer wheel starting from the specified tick */
+void timer_wheel_init(struct timer_wheel *tw, uint64_t now);
+
+/* arm (or re-arm) a timer to be fired at the specified tick */
+void timer_wheel_add(struct timer_wheel *tw, struct tw_timer *timer,
+        uint64_t expires);
+
+/* advance the wheel to the specified tick, and fire the expired timers;
+   returns the number of timers fired. */
+unsigned int timer_wheel_advance(struct timer_wheel *tw, uint64_t now);
+
+#ifdef __cplusplus
+}
+#endif
+
+static inline void
+tw_timer_init(struct tw_timer *timer, tw_timer_cb cb)
+{
+    list_head_init(&timer->list);
+    timer->expires = 0;
+    timer->cb = cb;
+}
+
+static inline bool
+tw_timer_pending(const struct tw_timer *timer)
+{
+    return !list_empty(&timer->list);
+}
+
+/* disarm a timer; it is safe to call this on a timer not armed. */
+static inline void
+tw_timer_del(struct tw_timer *timer)
+{
+    list_del_init(&timer->list);
+}
+
+#endif  /* __LIB_UTILS_TIMER_WHEEL_H */